@@ -0,0 +1,63 @@
+#include <cstdint>
+
+#include "BodyArray.h"
+
+namespace Crescent
+{
+	/**
+	 * Constructor
+	 */
+	BodyArray::BodyArray()
+		: _base(nullptr), _size(0), _storage(), _stride(0)
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	BodyArray::~BodyArray()
+	{
+	}
+
+	/**
+	 * Resize the block to hold the given number of bodies. All
+	 * columns are reset to zero
+	 *
+	 * @param[in] size The number of bodies
+	 */
+	void BodyArray::resize(size_t size)
+	{
+		_size   = size;
+		_stride = (size + lanes - 1) / lanes * lanes;
+
+		_storage.assign(ncolumns * _stride + lanes, 0.0);
+
+		const std::uintptr_t addr =
+			reinterpret_cast<std::uintptr_t>(_storage.data());
+
+		const std::uintptr_t offset =
+			(alignment - addr % alignment) % alignment;
+
+		_base = _storage.data() + offset / sizeof(double);
+	}
+
+	/**
+	 * Get the number of bodies
+	 *
+	 * @return The number of (non-padding) bodies
+	 */
+	size_t BodyArray::size() const
+	{
+		return _size;
+	}
+
+	/**
+	 * Get the padded length of each column
+	 *
+	 * @return The column stride
+	 */
+	size_t BodyArray::stride() const
+	{
+		return _stride;
+	}
+}
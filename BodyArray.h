@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * Structure-of-arrays copy of the hot fields of every EphemerisObject.
+	 * Positions, velocities, gravitational parameters and accelerations
+	 * each live in their own aligned, contiguous column so that the
+	 * gravity kernels can stream through them with vector loads. Cold
+	 * fields (e.g. names) are left behind in the EphemerisObject.
+	 *
+	 * Columns are padded out to a multiple of \ref lanes entries. Padding
+	 * bodies have zero mass and therefore contribute nothing
+	 */
+	class BodyArray
+	{
+
+	public:
+
+		/**
+		 * Byte alignment of each column (one cache line, which also
+		 * satisfies AVX-512 loads)
+		 */
+		static const size_t alignment = 64;
+
+		/**
+		 * Columns are padded to a multiple of this many doubles
+		 */
+		static const size_t lanes = alignment / sizeof(double);
+
+		BodyArray();
+
+		BodyArray(const BodyArray& other) = delete;
+
+		BodyArray& operator=(const BodyArray& other) = delete;
+
+		~BodyArray();
+
+		void resize(size_t size);
+
+		size_t size() const;
+
+		size_t stride() const;
+
+		/**
+		 * @{
+		 * Position columns, meters, ECI J2000
+		 */
+		double* x() { return _base + 0 * _stride; }
+		double* y() { return _base + 1 * _stride; }
+		double* z() { return _base + 2 * _stride; }
+		/** @} */
+
+		/**
+		 * @{
+		 * Velocity columns, meters/second, ECI J2000
+		 */
+		double* vx() { return _base + 3 * _stride; }
+		double* vy() { return _base + 4 * _stride; }
+		double* vz() { return _base + 5 * _stride; }
+		/** @} */
+
+		/**
+		 * Gravitational parameter (G * mass) column, m^3/s^2
+		 */
+		double* gm() { return _base + 6 * _stride; }
+
+		/**
+		 * @{
+		 * Acceleration columns, meters/second^2, ECI J2000
+		 */
+		double* ax() { return _base + 7 * _stride; }
+		double* ay() { return _base + 8 * _stride; }
+		double* az() { return _base + 9 * _stride; }
+		/** @} */
+
+		/**
+		 * The full state block, laid out as x|y|z|vx|vy|vz with each
+		 * column \ref stride() entries long
+		 *
+		 * @return A pointer to the first position column
+		 */
+		double* state() { return _base; }
+
+	private:
+
+		/**
+		 * The number of columns in the block
+		 */
+		static const size_t ncolumns = 10;
+
+		/**
+		 * Aligned pointer into \ref _storage
+		 */
+		double* _base;
+
+		/**
+		 * The number of bodies
+		 */
+		size_t _size;
+
+		/**
+		 * Backing storage, over-allocated so that \ref _base can be
+		 * aligned
+		 */
+		std::vector<double>
+			_storage;
+
+		/**
+		 * Padded length of each column
+		 */
+		size_t _stride;
+	};
+}
@@ -0,0 +1,489 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "abort.h"
+#include "Chebyshev.h"
+
+namespace Crescent
+{
+	const char ChebyshevEphemeris::magic[8] =
+		{ 'C', 'R', 'E', 'S', 'C', 'H', 'E', 'B' };
+
+	/**
+	 * Constructor
+	 */
+	ChebyshevEphemeris::ChebyshevEphemeris()
+		: _coeffs(nullptr),
+		_file(),
+		_header(),
+		_names()
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	ChebyshevEphemeris::~ChebyshevEphemeris()
+	{
+	}
+
+	/**
+	 * Evaluate the state of a body. Within each record the series
+	 * are evaluated together with their first two derivatives using
+	 * the three-term recurrence of the Chebyshev polynomials
+	 *
+	 * @param[in]  body The index of the body, see \ref find()
+	 * @param[in]  t    The time, seconds since the simulation began
+	 * @param[out] r    Position, 3 elements
+	 * @param[out] v    Velocity, 3 elements
+	 * @param[out] a    Acceleration, 3 elements
+	 *
+	 * @return True on success, or false if \a t is not covered by the
+	 *         file
+	 */
+	bool ChebyshevEphemeris::evaluate(size_t body, double t, double* r,
+		double* v, double* a) const
+	{
+		const size_t nc = _header.ncoeff;
+
+		const double offset = (t - _header.t0) / _header.interval;
+
+		if (offset < 0.0 || offset > double(_header.nrecords))
+			return false;
+
+		/*
+		 * The end of the last record belongs to that record
+		 */
+		const size_t record = std::min<size_t>(size_t(offset),
+			_header.nrecords - 1);
+
+		const double tau = 2.0 * (offset - record) - 1.0;
+
+		/*
+		 * Chebyshev polynomials and their first and second
+		 * derivatives with respect to tau
+		 */
+		double p[max_coefficients], dp[max_coefficients],
+			d2p[max_coefficients];
+
+		p[0] = 1.0; dp[0] = 0.0; d2p[0] = 0.0;
+		p[1] = tau; dp[1] = 1.0; d2p[1] = 0.0;
+
+		for (size_t j = 2; j < nc; j++)
+		{
+			p[j]   = 2.0 * tau * p[j - 1] - p[j - 2];
+			dp[j]  = 2.0 * p[j - 1] + 2.0 * tau * dp[j - 1] - dp[j - 2];
+			d2p[j] = 4.0 * dp[j - 1] + 2.0 * tau * d2p[j - 1]
+				- d2p[j - 2];
+		}
+
+		const double scale = 2.0 / _header.interval;
+
+		const double* c = _coeffs +
+			(record * _header.nbodies + body) * 3 * nc;
+
+		for (size_t k = 0; k < 3; k++, c += nc)
+		{
+			double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0;
+
+			for (size_t j = 0; j < nc; j++)
+			{
+				sum0 += c[j] * p[j];
+				sum1 += c[j] * dp[j];
+				sum2 += c[j] * d2p[j];
+			}
+
+			r[k] = sum0;
+			v[k] = sum1 * scale;
+			a[k] = sum2 * scale * scale;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Look up a body by name
+	 *
+	 * @param[in] name The name of the body
+	 *
+	 * @return Its index, or -1 if the file does not contain it
+	 */
+	int ChebyshevEphemeris::find(const std::string& name) const
+	{
+		for (size_t i = 0; i < _names.size(); i++)
+		{
+			if (_names[i] == name) return int(i);
+		}
+
+		return -1;
+	}
+
+	/**
+	 * Map a Chebyshev ephemeris file into memory and validate it
+	 *
+	 * @param[in] path The file to read
+	 *
+	 * @return True on success
+	 */
+	bool ChebyshevEphemeris::open(const std::string& path)
+	{
+		AbortIfNot_2(_file.open(path), false);
+
+		AbortIf(_file.size() < sizeof(ChebyshevHeader), false,
+			"'%s' is truncated", path.c_str());
+
+		std::memcpy(&_header, _file.data(), sizeof(ChebyshevHeader));
+
+		AbortIf(std::memcmp(_header.magic, magic, sizeof(magic)) != 0,
+			false, "'%s' is not a Chebyshev ephemeris", path.c_str());
+
+		AbortIf(_header.version != version, false,
+			"'%s' has unsupported version %u", path.c_str(),
+			_header.version);
+
+		AbortIf(_header.ncoeff < 2 || _header.ncoeff > max_coefficients ||
+			_header.nrecords == 0 || !(_header.interval > 0.0), false,
+			"'%s' has an invalid header", path.c_str());
+
+		const size_t names_size = _header.nbodies * name_size;
+
+		const size_t record_size =
+			size_t(_header.nbodies) * 3 * _header.ncoeff;
+
+		const size_t expected = sizeof(ChebyshevHeader) + names_size +
+			_header.nrecords * record_size * sizeof(double);
+
+		AbortIf(_file.size() != expected, false,
+			"'%s' is %zu bytes, expected %zu", path.c_str(),
+			_file.size(), expected);
+
+		const char* names = _file.data() + sizeof(ChebyshevHeader);
+
+		_names.clear();
+
+		for (size_t i = 0; i < _header.nbodies; i++)
+		{
+			const char* name = names + i * name_size;
+
+			_names.push_back(std::string(name,
+				strnlen(name, name_size)));
+		}
+
+		_coeffs = reinterpret_cast<const double*>(names + names_size);
+
+		return true;
+	}
+
+	/**
+	 * Get the number of bodies in the file
+	 *
+	 * @return The number of bodies
+	 */
+	size_t ChebyshevEphemeris::size() const
+	{
+		return _names.size();
+	}
+
+	/**
+	 * Get the start of the time span covered by the file
+	 *
+	 * @return The time, seconds since the simulation began
+	 */
+	double ChebyshevEphemeris::t_begin() const
+	{
+		return _header.t0;
+	}
+
+	/**
+	 * Get the end of the time span covered by the file
+	 *
+	 * @return The time, seconds since the simulation began
+	 */
+	double ChebyshevEphemeris::t_end() const
+	{
+		return _header.t0 + _header.nrecords * _header.interval;
+	}
+
+	/**
+	 * Constructor
+	 */
+	ChebyshevFitter::ChebyshevFitter()
+		: _basis(),
+		_coeffs(),
+		_count(0),
+		_factor(),
+		_interval(0.0),
+		_names(),
+		_ncoeff(0),
+		_samples(),
+		_segments(0),
+		_t0(0.0)
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	ChebyshevFitter::~ChebyshevFitter()
+	{
+	}
+
+	/**
+	 * Add the positions of all bodies at the next sample time. Samples
+	 * must be spaced interval / segments apart. Each time a record's
+	 * worth of samples has been gathered, the record is fitted
+	 *
+	 * @param[in] t      The sample time, seconds
+	 * @param[in] r      The x|y|z position columns, holding the bodies
+	 *                   passed to \ref init() first
+	 * @param[in] stride The length of each column
+	 *
+	 * @return True on success
+	 */
+	bool ChebyshevFitter::add(double t, const double* r, size_t stride)
+	{
+		const size_t nbodies = _names.size();
+
+		const double spacing = _interval / _segments;
+
+		if (_count == 0 && _coeffs.empty())
+			_t0 = t;
+
+		const double expected = _t0 + records() * _interval +
+			_count * spacing;
+
+		AbortIf(std::abs(t - expected) > 1e-6 * spacing, false,
+			"Chebyshev sample at t = %g, expected t = %g", t, expected);
+
+		double* sample = &_samples[_count * nbodies * 3];
+
+		for (size_t i = 0; i < nbodies; i++)
+		{
+			for (size_t k = 0; k < 3; k++)
+				sample[3 * i + k] = r[k * stride + i];
+		}
+
+		if (++_count <= _segments) return true;
+
+		_fit();
+
+		/*
+		 * The last sample of this record is the first of the next
+		 */
+		std::copy(sample, sample + 3 * nbodies, _samples.begin());
+
+		_count = 1;
+		return true;
+	}
+
+	/**
+	 * Initialize. Builds the least squares system shared by all
+	 * records
+	 *
+	 * @param[in] names    The names of the bodies to fit
+	 * @param[in] ncoeff   Coefficients per series
+	 * @param[in] interval Time span of each record, seconds
+	 * @param[in] segments The number of sampling intervals per record,
+	 *                     at least ncoeff - 1
+	 *
+	 * @return True on success
+	 */
+	bool ChebyshevFitter::init(const std::vector<std::string>& names,
+		size_t ncoeff, double interval, size_t segments)
+	{
+		AbortIf(ncoeff < 2 ||
+			ncoeff > ChebyshevEphemeris::max_coefficients, false,
+			"invalid Chebyshev coefficient count: %zu", ncoeff);
+
+		AbortIf(!(interval > 0.0), false,
+			"invalid Chebyshev interval: %g", interval);
+
+		AbortIf(segments + 1 < ncoeff, false,
+			"%zu samples cannot determine %zu coefficients",
+			segments + 1, ncoeff);
+
+		for (const auto& name : names)
+		{
+			AbortIf(name.size() >= ChebyshevEphemeris::name_size, false,
+				"name too long: '%s'", name.c_str());
+		}
+
+		_names    = names;
+		_ncoeff   = ncoeff;
+		_interval = interval;
+		_segments = segments;
+
+		_coeffs.clear();
+		_count = 0;
+
+		_samples.assign((segments + 1) * names.size() * 3, 0.0);
+
+		/*
+		 * Basis functions at evenly spaced points spanning [-1, 1]
+		 */
+		_basis.assign((segments + 1) * ncoeff, 0.0);
+
+		for (size_t i = 0; i <= segments; i++)
+		{
+			const double tau = 2.0 * i / segments - 1.0;
+
+			double* row = &_basis[i * ncoeff];
+
+			row[0] = 1.0;
+			row[1] = tau;
+
+			for (size_t j = 2; j < ncoeff; j++)
+				row[j] = 2.0 * tau * row[j - 1] - row[j - 2];
+		}
+
+		/*
+		 * Form and factor the normal equations, which are well
+		 * conditioned because the polynomials are nearly orthogonal
+		 * over evenly spaced points
+		 */
+		_factor.assign(ncoeff * ncoeff, 0.0);
+
+		for (size_t j = 0; j < ncoeff; j++)
+		{
+			for (size_t k = 0; k <= j; k++)
+			{
+				double sum = 0.0;
+
+				for (size_t i = 0; i <= segments; i++)
+					sum += _basis[i * ncoeff + j] * _basis[i * ncoeff + k];
+
+				for (size_t m = 0; m < k; m++)
+					sum -= _factor[j * ncoeff + m] * _factor[k * ncoeff + m];
+
+				if (j == k)
+				{
+					AbortIf(sum <= 0.0, false,
+						"Chebyshev normal equations are singular");
+
+					_factor[j * ncoeff + j] = std::sqrt(sum);
+				}
+				else
+					_factor[j * ncoeff + k] = sum / _factor[k * ncoeff + k];
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Get the number of records fitted so far
+	 *
+	 * @return The number of records
+	 */
+	size_t ChebyshevFitter::records() const
+	{
+		const size_t record_size = _names.size() * 3 * _ncoeff;
+
+		return record_size ? _coeffs.size() / record_size : 0;
+	}
+
+	/**
+	 * Write all records fitted so far to a file. Samples gathered for
+	 * an incomplete record are discarded
+	 *
+	 * @param[in] path The file to write
+	 *
+	 * @return True on success
+	 */
+	bool ChebyshevFitter::write(const std::string& path) const
+	{
+		AbortIf(records() == 0, false,
+			"no complete Chebyshev records to write");
+
+		ChebyshevHeader header;
+		std::memset(&header, 0, sizeof(header));
+
+		std::memcpy(header.magic, ChebyshevEphemeris::magic,
+			sizeof(header.magic));
+
+		header.version  = ChebyshevEphemeris::version;
+		header.nbodies  = uint32_t(_names.size());
+		header.ncoeff   = uint32_t(_ncoeff);
+		header.t0       = _t0;
+		header.interval = _interval;
+		header.nrecords = records();
+
+		std::ofstream file(path.c_str(),
+			std::ios::out | std::ios::binary | std::ios::trunc);
+
+		AbortIfNot(file, false, "unable to open '%s'", path.c_str());
+
+		file.write(reinterpret_cast<const char*>(&header),
+			sizeof(header));
+
+		for (const auto& name : _names)
+		{
+			char entry[ChebyshevEphemeris::name_size] = { 0 };
+			std::memcpy(entry, name.data(), name.size());
+
+			file.write(entry, sizeof(entry));
+		}
+
+		file.write(reinterpret_cast<const char*>(_coeffs.data()),
+			_coeffs.size() * sizeof(double));
+
+		AbortIfNot(file, false, "unable to write '%s'", path.c_str());
+
+		return true;
+	}
+
+	/**
+	 * Fit a record to the samples gathered for it and append the
+	 * coefficients
+	 */
+	void ChebyshevFitter::_fit()
+	{
+		const size_t nbodies = _names.size();
+		const size_t nc      = _ncoeff;
+
+		double c[ChebyshevEphemeris::max_coefficients];
+
+		for (size_t i = 0; i < nbodies; i++)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				for (size_t j = 0; j < nc; j++)
+				{
+					double sum = 0.0;
+
+					for (size_t s = 0; s <= _segments; s++)
+					{
+						sum += _basis[s * nc + j] *
+							_samples[(s * nbodies + i) * 3 + k];
+					}
+
+					c[j] = sum;
+				}
+
+				/*
+				 * Forward and back substitution with the Cholesky
+				 * factor
+				 */
+				for (size_t j = 0; j < nc; j++)
+				{
+					for (size_t m = 0; m < j; m++)
+						c[j] -= _factor[j * nc + m] * c[m];
+
+					c[j] /= _factor[j * nc + j];
+				}
+
+				for (size_t j = nc; j-- > 0; )
+				{
+					for (size_t m = j + 1; m < nc; m++)
+						c[j] -= _factor[m * nc + j] * c[m];
+
+					c[j] /= _factor[j * nc + j];
+				}
+
+				_coeffs.insert(_coeffs.end(), c, c + nc);
+			}
+		}
+	}
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace Crescent
+{
+	/**
+	 * Layout of a Chebyshev ephemeris file, in the spirit of the JPL
+	 * DE files. All values are stored in native byte order:
+	 *
+	 *   header                  see \ref ChebyshevHeader
+	 *   names                   nbodies entries of name_size bytes,
+	 *                           nul-padded
+	 *   records                 nrecords entries, each holding for
+	 *                           every body the x, y and z series of
+	 *                           ncoeff coefficients
+	 *
+	 * Record k covers [t0 + k * interval, t0 + (k + 1) * interval]. Every
+	 * section is a multiple of 8 bytes, so the coefficients are
+	 * aligned when the file is memory mapped
+	 */
+	struct ChebyshevHeader
+	{
+		/**
+		 * Identifies the file format; see \ref ChebyshevEphemeris::magic
+		 */
+		char magic[8];
+
+		/**
+		 * Format version
+		 */
+		uint32_t version;
+
+		/**
+		 * The number of bodies
+		 */
+		uint32_t nbodies;
+
+		/**
+		 * Coefficients per series, i.e. the polynomial degree plus 1
+		 */
+		uint32_t ncoeff;
+
+		/**
+		 * Unused, keeps the header 8-byte aligned
+		 */
+		uint32_t reserved;
+
+		/**
+		 * Start of the first record, seconds since the simulation began
+		 */
+		double t0;
+
+		/**
+		 * Time span of each record, seconds
+		 */
+		double interval;
+
+		/**
+		 * The number of records
+		 */
+		uint64_t nrecords;
+	};
+
+	/**
+	 * Plays back the positions, velocities and accelerations of bodies
+	 * from a file of piecewise Chebyshev series. The file is memory
+	 * mapped, so every process running from the same file shares one
+	 * copy of the coefficients
+	 */
+	class ChebyshevEphemeris
+	{
+
+	public:
+
+		/**
+		 * The eight bytes that begin every file
+		 */
+		static const char magic[8];
+
+		/**
+		 * The most coefficients per series supported
+		 */
+		static const size_t max_coefficients = 32;
+
+		/**
+		 * Length of each name entry, including the terminating nul
+		 */
+		static const size_t name_size = 32;
+
+		/**
+		 * The current format version
+		 */
+		static const uint32_t version = 1;
+
+		ChebyshevEphemeris();
+
+		~ChebyshevEphemeris();
+
+		bool evaluate(size_t body, double t, double* r, double* v,
+			double* a) const;
+
+		int find(const std::string& name) const;
+
+		bool open(const std::string& path);
+
+		size_t size() const;
+
+		double t_begin() const;
+
+		double t_end() const;
+
+	private:
+
+		/**
+		 * Start of the coefficient records within \ref _file
+		 */
+		const double* _coeffs;
+
+		/**
+		 * The mapped file
+		 */
+		MappedFile _file;
+
+		/**
+		 * Copy of the file header
+		 */
+		ChebyshevHeader _header;
+
+		/**
+		 * The body names, in file order
+		 */
+		std::vector<std::string>
+			_names;
+	};
+
+	/**
+	 * Fits piecewise Chebyshev series to positions sampled at evenly
+	 * spaced times and writes them out in the format read by
+	 * \ref ChebyshevEphemeris. Each record is a least squares fit over
+	 * its samples, including the two at either end, which are shared
+	 * with the neighboring records
+	 */
+	class ChebyshevFitter
+	{
+
+	public:
+
+		ChebyshevFitter();
+
+		~ChebyshevFitter();
+
+		bool add(double t, const double* r, size_t stride);
+
+		bool init(const std::vector<std::string>& names, size_t ncoeff,
+			double interval, size_t segments);
+
+		size_t records() const;
+
+		bool write(const std::string& path) const;
+
+	private:
+
+		void _fit();
+
+		/**
+		 * Chebyshev polynomials evaluated at each sample time, one
+		 * row of \ref _ncoeff values per sample
+		 */
+		std::vector<double> _basis;
+
+		/**
+		 * Coefficients of all records fitted so far, in file order
+		 */
+		std::vector<double> _coeffs;
+
+		/**
+		 * The number of samples held for the current record
+		 */
+		size_t _count;
+
+		/**
+		 * Cholesky factor of the normal equations, row-major lower
+		 * triangle
+		 */
+		std::vector<double> _factor;
+
+		/**
+		 * Time span of each record, seconds
+		 */
+		double _interval;
+
+		/**
+		 * The body names
+		 */
+		std::vector<std::string>
+			_names;
+
+		/**
+		 * Coefficients per series
+		 */
+		size_t _ncoeff;
+
+		/**
+		 * Samples of the current record: x, y and z of every body,
+		 * sample by sample
+		 */
+		std::vector<double>
+			_samples;
+
+		/**
+		 * The number of sampling intervals per record
+		 */
+		size_t _segments;
+
+		/**
+		 * The time of the first sample, seconds
+		 */
+		double _t0;
+	};
+}
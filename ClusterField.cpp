@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cmath>
+
+#include "abort.h"
+#include "ClusterField.h"
+#include "Gravity.h"
+
+namespace Crescent
+{
+	/**
+	 * Constructor
+	 */
+	ClusterField::ClusterField()
+		: _ax(), _ay(), _az(),
+		_cell_size(1.0e9),
+		_clusters(),
+		_fx(), _fy(), _fz(), _fgm(),
+		_order(),
+		_sx(), _sy(), _sz(), _sgm()
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	ClusterField::~ClusterField()
+	{
+	}
+
+	/**
+	 * Sort bodies into clusters. Must be called again whenever the
+	 * bodies move
+	 *
+	 * @param[in] x        Position x column
+	 * @param[in] y        Position y column
+	 * @param[in] z        Position z column
+	 * @param[in] gm       Gravitational parameter column
+	 * @param[in] first    The first target. Sources before it feel no
+	 *                     acceleration, e.g. because they are played
+	 *                     back from a table
+	 * @param[in] nmassive The number of sources, which come first
+	 * @param[in] n        The total number of bodies
+	 * @param[in] threads  The number of threads that will call
+	 *                     \ref evaluate()
+	 */
+	void ClusterField::build(const double* x, const double* y,
+		const double* z,
+		const double* gm,
+		size_t first, size_t nmassive, size_t n, size_t threads)
+	{
+		const double scale = 1.0 / _cell_size;
+
+		auto cell = [=](size_t i, int k) {
+			const double* r[3] = { x, y, z };
+			return std::int64_t(std::floor(r[k][i] * scale));
+		};
+
+		_order.resize(n);
+		for (size_t i = 0; i < n; i++)
+			_order[i] = i;
+
+		/*
+		 * Group by cell, with each cell's sources ahead of its test
+		 * particles. Sources stay in index order, so any that are not
+		 * targets lead their cell
+		 */
+		std::sort(_order.begin(), _order.end(),
+			[&](size_t a, size_t b) {
+				for (int k = 0; k < 3; k++)
+				{
+					const std::int64_t ca = cell(a, k), cb = cell(b, k);
+					if (ca != cb) return ca < cb;
+				}
+
+				if ((a < nmassive) != (b < nmassive))
+					return a < nmassive;
+
+				return a < b;
+			});
+
+		_sx.resize(n); _sy.resize(n); _sz.resize(n); _sgm.resize(n);
+		_ax.resize(n); _ay.resize(n); _az.resize(n);
+
+		_fx.resize(threads * n);
+		_fy.resize(threads * n);
+		_fz.resize(threads * n);
+		_fgm.resize(threads * n);
+
+		_clusters.clear();
+
+		for (size_t s = 0; s < n; s++)
+		{
+			const size_t i = _order[s];
+
+			_sx[s]  = x[i];
+			_sy[s]  = y[i];
+			_sz[s]  = z[i];
+			_sgm[s] = i < nmassive ? gm[i] : 0.0;
+
+			const std::int64_t c[3] = { cell(i, 0), cell(i, 1), cell(i, 2) };
+
+			if (_clusters.empty() || c[0] != _clusters.back().cell[0] ||
+				c[1] != _clusters.back().cell[1] ||
+				c[2] != _clusters.back().cell[2])
+			{
+				Cluster cluster;
+
+				for (int k = 0; k < 3; k++)
+				{
+					cluster.cell[k]   = c[k];
+					cluster.origin[k] = (c[k] + 0.5) * _cell_size;
+				}
+
+				cluster.begin = cluster.source_end = cluster.end =
+					cluster.target_begin = std::uint32_t(s);
+
+				_clusters.push_back(cluster);
+			}
+
+			Cluster& cluster = _clusters.back();
+
+			cluster.end = std::uint32_t(s + 1);
+
+			if (i < nmassive)
+				cluster.source_end = cluster.end;
+
+			if (i < first)
+				cluster.target_begin = cluster.end;
+		}
+	}
+
+	/**
+	 * Compute the accelerations of the bodies in a range of clusters.
+	 * Concurrent calls on disjoint ranges are safe, provided each
+	 * passes its own thread index
+	 *
+	 * @param[in]  c_begin The first cluster
+	 * @param[in]  c_end   One past the last cluster
+	 * @param[in]  thread  The index of the calling thread, less than
+	 *                     the count passed to \ref build()
+	 * @param[out] ax      Acceleration x column, indexed as the
+	 *                     columns passed to \ref build()
+	 * @param[out] ay      Acceleration y column
+	 * @param[out] az      Acceleration z column
+	 */
+	void ClusterField::evaluate(size_t c_begin, size_t c_end,
+		size_t thread, double* ax, double* ay, double* az)
+	{
+		const size_t n = _order.size();
+
+		float* fx  = _fx.data()  + thread * n;
+		float* fy  = _fy.data()  + thread * n;
+		float* fz  = _fz.data()  + thread * n;
+		float* fgm = _fgm.data() + thread * n;
+
+		double* tx = _ax.data();
+		double* ty = _ay.data();
+		double* tz = _az.data();
+
+		for (size_t c = c_begin; c < c_end; c++)
+		{
+			const Cluster& target = _clusters[c];
+
+			const double ox = target.origin[0];
+			const double oy = target.origin[1];
+			const double oz = target.origin[2];
+
+			for (size_t i = target.target_begin; i < target.end; i++)
+				tx[i] = ty[i] = tz[i] = 0.0;
+
+			/*
+			 * Near field in double precision; far sources are
+			 * gathered relative to this cluster's origin
+			 */
+			size_t nfar = 0;
+
+			for (const Cluster& source : _clusters)
+			{
+				if (source.source_end == source.begin) continue;
+
+				if (std::abs(source.cell[0] - target.cell[0]) <= 1 &&
+					std::abs(source.cell[1] - target.cell[1]) <= 1 &&
+					std::abs(source.cell[2] - target.cell[2]) <= 1)
+				{
+					Gravity::accumulate(_sx.data(), _sy.data(),
+						_sz.data(), _sgm.data(),
+						source.begin, source.source_end,
+						target.target_begin, target.end, tx, ty, tz);
+					continue;
+				}
+
+				for (size_t j = source.begin; j < source.source_end; j++)
+				{
+					fx[nfar]  = float(_sx[j] - ox);
+					fy[nfar]  = float(_sy[j] - oy);
+					fz[nfar]  = float(_sz[j] - oz);
+					fgm[nfar] = float(_sgm[j]);
+					nfar++;
+				}
+			}
+
+			for (size_t i = target.target_begin; i < target.end; i++)
+			{
+				Gravity::accumulate_float(fx, fy, fz, fgm, 0, nfar,
+					float(_sx[i] - ox), float(_sy[i] - oy),
+					float(_sz[i] - oz), tx[i], ty[i], tz[i]);
+
+				const size_t body = _order[i];
+
+				ax[body] = tx[i];
+				ay[body] = ty[i];
+				az[body] = tz[i];
+			}
+		}
+	}
+
+	/**
+	 * Set the edge length of the cells
+	 *
+	 * @param[in] size The edge length, meters
+	 *
+	 * @return True on success
+	 */
+	bool ClusterField::set_cell_size(double size)
+	{
+		AbortIf(!(size > 0.0), false, "invalid cluster size: %g", size);
+
+		_cell_size = size;
+		return true;
+	}
+
+	/**
+	 * Get the number of clusters found by the last \ref build()
+	 *
+	 * @return The number of occupied cells
+	 */
+	size_t ClusterField::size() const
+	{
+		return _clusters.size();
+	}
+
+	/**
+	 * Get the number of bodies in a range of clusters, e.g. to split
+	 * the work evenly between threads
+	 *
+	 * @param[in] c_begin The first cluster
+	 * @param[in] c_end   One past the last cluster
+	 *
+	 * @return The number of bodies
+	 */
+	size_t ClusterField::targets(size_t c_begin, size_t c_end) const
+	{
+		if (c_begin >= c_end) return 0;
+
+		return _clusters[c_end - 1].end - _clusters[c_begin].begin;
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * @class ClusterField
+	 *
+	 * Direct-sum gravity with a single-precision far field. Space is
+	 * cut into cubic cells, and the bodies in each occupied cell form
+	 * a cluster whose origin is the cell center, e.g. the Earth-Moon
+	 * system and the spacecraft near it. For the targets of a cluster:
+	 *
+	 *   near field  Sources in the same or an adjacent cell (the 27
+	 *               cells around it) are summed in double precision,
+	 *               exactly as by the direct solver
+	 *
+	 *   far field   All other sources are summed in single precision,
+	 *               at twice the SIMD width, from positions taken
+	 *               relative to the target cluster's origin
+	 *
+	 * Error budget: the far-field positions are differenced in double
+	 * and only then rounded, so float resolution applies to the
+	 * separations, not to the 1.5e11 m distance from the ECI origin.
+	 * A far source is at least one cell edge L away, and a target is
+	 * within (sqrt(3)/2) L of its origin, so rounding moves the
+	 * separation by at most u (1 + sqrt(3)) d, with u = 2^-24 and d the
+	 * separation. Together with the arithmetic in single precision,
+	 * each far-field term carries a relative error of roughly 10 u,
+	 * i.e. 6e-7, and partial sums are flushed into double every 256
+	 * sources, adding at most about 16 u more. In practice the error is
+	 * around 1e-7 of the far-field acceleration; relative to the total
+	 * it can reach about 1e-6 at bodies where the far-field terms
+	 * largely cancel. Since every member of a cluster sees nearly the
+	 * same far field, most of the error is common to the cluster, and
+	 * its effect on motion within the cluster is smaller still. The
+	 * cell edge should be chosen so that the bodies which strongly
+	 * perturb each other share a cell or neighboring cells
+	 */
+	class ClusterField
+	{
+		/**
+		 * The bodies in one cell
+		 */
+		struct Cluster
+		{
+			/**
+			 * Index of the cell along each axis
+			 */
+			std::int64_t cell[3];
+
+			/**
+			 * The cell center, meters
+			 */
+			double origin[3];
+
+			/**
+			 * Range of bodies in sorted order owned by this cluster.
+			 * The sources come first, in [begin, source_end)
+			 */
+			std::uint32_t begin, source_end, end;
+
+			/**
+			 * The first body in sorted order whose acceleration is
+			 * computed. Sources that are not targets come first
+			 */
+			std::uint32_t target_begin;
+		};
+
+	public:
+
+		ClusterField();
+
+		~ClusterField();
+
+		void build(const double* x, const double* y, const double* z,
+			const double* gm,
+			size_t first, size_t nmassive, size_t n, size_t threads);
+
+		void evaluate(size_t c_begin, size_t c_end, size_t thread,
+			double* ax, double* ay, double* az);
+
+		bool set_cell_size(double size);
+
+		size_t size() const;
+
+		size_t targets(size_t c_begin, size_t c_end) const;
+
+	private:
+
+		/**
+		 * Accelerations in sorted order, accumulated in double
+		 * precision. Shared by all threads, which write disjoint
+		 * clusters
+		 */
+		std::vector<double> _ax, _ay, _az;
+
+		/**
+		 * Edge length of the cells, meters
+		 */
+		double _cell_size;
+
+		/**
+		 * The occupied cells, in sorted order
+		 */
+		std::vector<Cluster>
+			_clusters;
+
+		/**
+		 * Far-field sources gathered relative to the target cluster's
+		 * origin, in single precision. Each thread owns a run of
+		 * \ref _order.size() entries
+		 */
+		std::vector<float> _fx, _fy, _fz, _fgm;
+
+		/**
+		 * Original index of each body, in sorted order
+		 */
+		std::vector<size_t>
+			_order;
+
+		/**
+		 * Body positions and gravitational parameters, in sorted
+		 * order
+		 */
+		std::vector<double> _sx, _sy, _sz, _sgm;
+	};
+}
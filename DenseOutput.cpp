@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cmath>
+
+#include "DenseOutput.h"
+#include "Hermite.h"
+
+namespace Crescent
+{
+	/**
+	 * Copy the x|y|z columns of positions, velocities and
+	 * accelerations into one block
+	 *
+	 * @param[in]  r      Position columns
+	 * @param[in]  v      Velocity columns
+	 * @param[in]  a      Acceleration columns
+	 * @param[in]  stride The length of each column
+	 * @param[out] block  The x|y|z|vx|vy|vz|ax|ay|az columns
+	 */
+	static void gather(const double* r, const double* v, const double* a,
+		size_t stride, std::vector<double>& block)
+	{
+		std::copy(r, r + 3 * stride, block.begin());
+		std::copy(v, v + 3 * stride, block.begin() + 3 * stride);
+		std::copy(a, a + 3 * stride, block.begin() + 6 * stride);
+	}
+
+	/**
+	 * Constructor
+	 */
+	DenseOutput::DenseOutput()
+		: _begin(), _end(),
+		_ready(false),
+		_size(0),
+		_stride(0),
+		_t_begin(0.0), _t_end(0.0)
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	DenseOutput::~DenseOutput()
+	{
+	}
+
+	/**
+	 * Interpolate the state of a body within the last step
+	 *
+	 * @param[in]  body The index of the body
+	 * @param[in]  t    The time, seconds, between \ref t_begin() and
+	 *                  \ref t_end()
+	 * @param[out] r    Position, meters, ECI J2000
+	 * @param[out] v    Velocity, meters/second, ECI J2000
+	 * @param[out] a    Acceleration, meters/second^2, ECI J2000
+	 *
+	 * @return True on success, or false if no step has been finished
+	 *         or \a t lies outside of it
+	 */
+	bool DenseOutput::evaluate(size_t body, double t, double* r,
+		double* v, double* a) const
+	{
+		return _interpolate(body, _size, t, r, v, a);
+	}
+
+	/**
+	 * Record the end of a step
+	 *
+	 * @param[in] t The time, seconds
+	 * @param[in] r The x|y|z position columns of all bodies at \a t
+	 * @param[in] v The x|y|z velocity columns, same layout
+	 * @param[in] a The x|y|z acceleration columns, same layout
+	 */
+	void DenseOutput::finish(double t, const double* r, const double* v,
+		const double* a)
+	{
+		gather(r, v, a, _stride, _end);
+
+		_t_end = t;
+		_ready = true;
+	}
+
+	/**
+	 * Interpolate the state of a body relative to another within the
+	 * last step. The endpoint states are differenced before they are
+	 * interpolated, which keeps the relative motion of two nearby
+	 * bodies far from the origin (e.g. a spacecraft about the Moon)
+	 * clear of the rounding of their absolute positions
+	 *
+	 * @param[in]  body      The index of the body
+	 * @param[in]  reference The index of the reference body
+	 * @param[in]  t         The time, seconds, between \ref t_begin()
+	 *                       and \ref t_end()
+	 * @param[out] r         Relative position, meters
+	 * @param[out] v         Relative velocity, meters/second
+	 * @param[out] a         Relative acceleration, meters/second^2
+	 *
+	 * @return True on success, or false if no step has been finished
+	 *         or \a t lies outside of it
+	 */
+	bool DenseOutput::relative(size_t body, size_t reference, double t,
+		double* r, double* v, double* a) const
+	{
+		if (reference >= _size) return false;
+
+		return _interpolate(body, reference, t, r, v, a);
+	}
+
+	/**
+	 * Set the number of bodies and the layout of their columns
+	 *
+	 * @param[in] size   The number of bodies
+	 * @param[in] stride The length of each column, at least \a size
+	 */
+	void DenseOutput::resize(size_t size, size_t stride)
+	{
+		_begin.assign(9 * stride, 0.0);
+		_end.assign(9 * stride, 0.0);
+
+		_ready  = false;
+		_size   = size;
+		_stride = stride;
+	}
+
+	/**
+	 * Record the start of a step. Until the step is finished, no
+	 * states are available
+	 *
+	 * @param[in] t The time, seconds
+	 * @param[in] r The x|y|z position columns of all bodies at \a t
+	 * @param[in] v The x|y|z velocity columns, same layout
+	 * @param[in] a The x|y|z acceleration columns, same layout
+	 */
+	void DenseOutput::start(double t, const double* r, const double* v,
+		const double* a)
+	{
+		gather(r, v, a, _stride, _begin);
+
+		_t_begin = t;
+		_ready   = false;
+	}
+
+	/**
+	 * Get the start of the last step
+	 *
+	 * @return The time, seconds
+	 */
+	double DenseOutput::t_begin() const
+	{
+		return _t_begin;
+	}
+
+	/**
+	 * Get the end of the last step
+	 *
+	 * @return The time, seconds
+	 */
+	double DenseOutput::t_end() const
+	{
+		return _t_end;
+	}
+
+	/**
+	 * Interpolate the state of a body, optionally relative to another,
+	 * within the last step
+	 *
+	 * @param[in]  body      The index of the body
+	 * @param[in]  reference The index of the reference body, or the
+	 *                       number of bodies for absolute states
+	 * @param[in]  t         The time, seconds
+	 * @param[out] r         Position, meters
+	 * @param[out] v         Velocity, meters/second
+	 * @param[out] a         Acceleration, meters/second^2
+	 *
+	 * @return True on success
+	 */
+	bool DenseOutput::_interpolate(size_t body, size_t reference,
+		double t, double* r, double* v, double* a) const
+	{
+		/*
+		 * Allow for the rounding of times given in cycles
+		 */
+		const double slack = 1.0e-9 * std::max(1.0, std::abs(_t_end));
+
+		if (!_ready || body >= _size ||
+			!(t >= _t_begin - slack && t <= _t_end + slack))
+		{
+			return false;
+		}
+
+		const double h = _t_end - _t_begin;
+
+		const double theta = h > 0.0 ?
+			std::min(1.0, std::max(0.0, (t - _t_begin) / h)) : 1.0;
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			double begin[3], end[3];
+
+			for (size_t c = 0; c < 3; c++)
+			{
+				const size_t i = (3 * c + k) * _stride + body;
+
+				begin[c] = _begin[i];
+				end[c]   = _end[i];
+
+				if (reference < _size)
+				{
+					const size_t j = (3 * c + k) * _stride + reference;
+
+					begin[c] -= _begin[j];
+					end[c]   -= _end[j];
+				}
+			}
+
+			if (h > 0.0)
+			{
+				hermite5(theta, h, begin[0], begin[1], begin[2],
+					end[0], end[1], end[2], r[k], v[k], a[k]);
+			}
+			else
+			{
+				r[k] = end[0];
+				v[k] = end[1];
+				a[k] = end[2];
+			}
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * @class DenseOutput
+	 *
+	 * Gives the state of every body at any time within the last step
+	 * taken, so that consumers are not limited to the step boundaries.
+	 * The positions, velocities and accelerations at either end of the
+	 * step are kept, and joined by quintic Hermite interpolation (see
+	 * \ref hermite5()). This works the same for every integrator, needs
+	 * no extra force evaluations, and is accurate to O(h^6) in position
+	 * and O(h^4) in acceleration
+	 */
+	class DenseOutput
+	{
+
+	public:
+
+		DenseOutput();
+
+		~DenseOutput();
+
+		bool evaluate(size_t body, double t, double* r, double* v,
+			double* a) const;
+
+		void finish(double t, const double* r, const double* v,
+			const double* a);
+
+		bool relative(size_t body, size_t reference, double t,
+			double* r, double* v, double* a) const;
+
+		void resize(size_t size, size_t stride);
+
+		void start(double t, const double* r, const double* v,
+			const double* a);
+
+		double t_begin() const;
+
+		double t_end() const;
+
+	private:
+
+		bool _interpolate(size_t body, size_t reference, double t,
+			double* r, double* v, double* a) const;
+
+		/**
+		 * The states of all bodies at the start and end of the step,
+		 * x|y|z|vx|vy|vz|ax|ay|az columns of \ref _stride entries
+		 */
+		std::vector<double>
+			_begin, _end;
+
+		/**
+		 * True once a step has been finished, until the next starts
+		 */
+		bool _ready;
+
+		/**
+		 * The number of bodies
+		 */
+		size_t _size;
+
+		/**
+		 * The length of each column
+		 */
+		size_t _stride;
+
+		/**
+		 * The times at which the step starts and ends, seconds
+		 */
+		double _t_begin, _t_end;
+	};
+}
@@ -1,4 +1,14 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <random>
+
 #include "EphemerisManager.h"
+#include "Gravity.h"
+#include "Hermite.h"
+#include "Kepler.h"
+#include "Symplectic.h"
 #include "Verbosity.h"
 
 namespace Crescent
@@ -8,11 +18,71 @@ namespace Crescent
 	 */
 	EphemerisManager::EphemerisManager()
 		: Event("Ephemeris"),
-		_dxdt_i(0),
+		_absolute(),
+		_accel_time(0.0),
+		_accel_valid(false),
+		_bodies(),
+		_clusters(),
+		_coasts(),
+		_conic(),
+		_conic_failed(false),
+		_dense(),
+		_dense_output(false),
+		_embedded(EmbeddedRK::dormand_prince54()),
+		_ensemble(),
+		_events(),
+		_extrapolation(),
+		_fit_interval(86400.0),
+		_fit_ncoeff(14),
+		_fit_path(),
+		_fit_period(0),
+		_fitter(),
+		_formulation(Formulation::cowell),
+		_kepler(),
+		_kepler_dt(),
+		_kepler_mu(),
+		_groups(),
+		_harmonic_accel(),
+		_harmonics(),
 		_ids(),
+		_integrator(Integrator::euler),
 		_is_init(false),
-		_rk4(0.02),
-		_subdir()
+		_locator(),
+		_multistep(),
+		_nmassive(0),
+		_octree(),
+		_parareal(),
+		_parareal_begin(0),
+		_parareal_coarse_step(60.0),
+		_parareal_count(0),
+		_parareal_slices(),
+		_parareal_span(86400.0),
+		_parareal_steps(0),
+		_period(period),
+		_perturbers(),
+		_phase(0),
+		_predicted(),
+		_patched(),
+		_patched_init(false),
+		_pool(),
+		_radiation(),
+		_radiation_config(),
+		_rectify(0.01),
+		_references(),
+		_rk4(period / 100.0),
+		_solver(Solver::direct),
+		_step_begin(),
+		_step_end(),
+		_stm(false),
+		_subdir(),
+		_sundman(1.0),
+		_sundman_steps(360),
+		_sundman_work(),
+		_table(),
+		_tabulated(),
+		_thread_accel(),
+		_tree_targets(),
+		_variational()
 	{
 	}
 
@@ -23,63 +93,137 @@ namespace Crescent
 	{
 	}
 
+	/**
+	 * Register an event function, whose crossings are located after
+	 * every step on the dense output (see \ref EventLocator). Events
+	 * can be added at any time once initialized
+	 *
+	 * @param[in] body      The name of the body whose state is passed
+	 *                      to \a g
+	 * @param[in] reference States are taken relative to this body, or
+	 *                      to the inertial origin if empty
+	 * @param[in] g         The event function
+	 * @param[in] direction  The crossings to report
+	 * @param[in] hysteresis How far \a g must stray from zero between
+	 *                       crossings, in the units of \a g
+	 * @param[in] handler    Called at each crossing, after the step
+	 *                       containing it
+	 *
+	 * @return The index of the event, as passed to \a handler, or -1
+	 *         on error
+	 */
+	int EphemerisManager::add_event(const std::string& body,
+		const std::string& reference,
+		const EventLocator::Function& g,
+		EventLocator::Direction direction, double hysteresis,
+		const EventLocator::Handler& handler)
+	{
+		AbortIfNot_2(_is_init, -1);
+
+		AbortIfNot(g, -1, "no event function for '%s'", body.c_str());
+
+		const int i = find(body);
+		AbortIf(i < 0, -1, "unknown body '%s'", body.c_str());
+
+		size_t j = EventLocator::inertial;
+
+		if (!reference.empty())
+		{
+			const int k = find(reference);
+			AbortIf(k < 0, -1, "unknown body '%s'", reference.c_str());
+
+			j = k;
+		}
+
+		return int(_locator.add(i, j, g, direction, hysteresis,
+			handler));
+	}
+
 	/**
 	 * Compute the accelerations of all objects in the system. The
-	 * governing equation is 1.2-10 in reference (1)
+	 * governing equation is 1.2-10 in reference (1). Operates on the
+	 * structure-of-arrays block filled in by \ref _load_bodies()
 	 */
 	void EphemerisManager::compute_accel()
 	{
-		for (size_t i = 0; i < _ids.size(); i++)
-		{
-			auto& m_i =
-				_subdir->load<EphemerisObject>(_ids[i].object_id);
+		compute_accel(_bodies.x(), _bodies.ax());
 
-			m_i.accel.zeroify();
+		if (Verbosity::is_debug())
+		{
+			const double* ax = _bodies.ax();
+			const double* ay = _bodies.ay();
+			const double* az = _bodies.az();
 
-			if (Verbosity::is_debug())
+			for (size_t i = 0; i < _bodies.size(); i++)
 			{
-				std::printf("computing accel for '%s':\n",
-					m_i.name.c_str());
+				std::printf("accel[%s] = \n",
+					_ids[i].name.c_str());
+				std::printf("%14.6f \n%14.6f \n%14.6f \n",
+					ax[i], ay[i], az[i]);
 			}
 
-			for (size_t j = 0; j < _ids.size(); j++)
-			{
-				if (i == j) continue;
-
-				auto& m_j =
-					_subdir->load<EphemerisObject>(_ids[j].object_id);
+			std::fflush(stdout);
+		}
+	}
 
-				if (Verbosity::is_debug())
-				{
-					std::printf("perturbing body: '%s'\n",
-						m_j.name.c_str());
-				}
+	/**
+	 * Compute the accelerations of all objects at the given positions.
+	 * Only the massive bodies [0, _nmassive) act as sources, so each
+	 * test particle costs O(M) rather than O(N). Gravitational
+	 * parameters are taken from the structure-of-arrays block
+	 *
+	 * @param[in]  r The x|y|z position columns, each laid out with
+	 *               \ref BodyArray::stride() entries
+	 * @param[out] a The x|y|z acceleration columns, same layout
+	 */
+	void EphemerisManager::compute_accel(const double* r, double* a)
+	{
+		const size_t stride = _bodies.stride();
 
-				Vector<3> r_ji =
-					m_i.rv_eci.sub<3>(0) - m_j.rv_eci.sub<3>(0);
+		double* ax = a;
+		double* ay = a + stride;
+		double* az = a + 2 * stride;
 
-				if (Verbosity::is_debug())
-				{
-					std::printf("position from '%s' to '%s':\n",
-						m_j.name.c_str(), m_i.name.c_str());
-					r_ji.print();
-				}
+		if (_solver == Solver::tree)
+		{
+			_compute_accel_tree(r, a);
+		}
+		else if (_solver == Solver::cluster)
+		{
+			_compute_accel_clustered(r, a);
+		}
+		else if (_solver == Solver::culled)
+		{
+			_compute_accel_culled(r, a);
+		}
+		else if (_pool)
+		{
+			_compute_accel_parallel(r, a);
+		}
+		else
+		{
+			_compute_accel_direct(r, a);
+		}
 
-				const double norm = r_ji.norm();
+		/*
+		 * Bodies played back from the Chebyshev ephemeris come first
+		 * and are not targets; \ref _play_back() fills in their
+		 * accelerations
+		 */
+		const size_t first = _tabulated.size();
 
-				if (norm == 0.0) continue;
+		if (!_harmonics.empty())
+			_add_harmonics(r, first, _bodies.size(), a);
 
-				m_i.accel -=
-					G * m_j.mass / pow(norm, 3) * r_ji;
+		if (!_radiation.empty())
+			_radiation.accumulate(r, stride, first, _bodies.size(), a);
 
-				if (Verbosity::is_debug())
-				{
-					std::printf("accel[%s] = \n",
-						m_i.name.c_str());
-					m_i.accel.print();
-				}
-			}
-		}
+		/*
+		 * Keep padding bodies at rest so they never disturb the
+		 * integrators' error estimates
+		 */
+		for (size_t i = _bodies.size(); i < stride; i++)
+			ax[i] = ay[i] = az[i] = 0.0;
 	}
 
 	/**
@@ -91,27 +235,190 @@ namespace Crescent
 	 */
 	int64 EphemerisManager::dispatch(int64 t_now)
 	{
-		if (t_now % period) return 0;
+		/*
+		 * Between steps, publish states from the dense output
+		 */
+		if (t_now % _period)
+		{
+			if (_dense_output)
+				AbortIfNot_2(_update_telemetry(t_now / 100.0), -1);
+
+			return 0;
+		}
 
 		/*
-		 * 1. Compute the accelerations of all objects
+		 * 1. Gather the hot fields of all objects
 		 */
-		compute_accel();
+		_load_bodies();
+
+		if (!_fit_path.empty() && t_now % _fit_period == 0)
+		{
+			AbortIfNot_2(_fitter.add(t_now / 100.0, _bodies.x(),
+				_bodies.stride()), -1);
+		}
+
+		/*
+		 * 2. Propagate forward by 1 step. Bodies played back from
+		 *    a Chebyshev ephemeris are put back on their tabulated
+		 *    trajectories on either side of the step
+		 */
+		if (_table)
+		{
+			const double t_end = (t_now + _period) / 100.0;
+
+			AbortIf(t_now / 100.0 < _table->t_begin() ||
+				t_end > _table->t_end(), -1,
+				"t = %g is outside of the Chebyshev ephemeris", t_end);
+
+			_play_back(t_now / 100.0,
+				_bodies.x(), _bodies.vx(), _bodies.ax());
+		}
+
+		const bool dense = _dense_output || !_locator.empty() ||
+			_formulation == Formulation::sundman;
+
+		if (dense)
+		{
+			/*
+			 * A change from outside leaves the accelerations at the
+			 * start of the step stale
+			 */
+			if (!_accel_valid)
+			{
+				_accel_time = t_now / 100.0;
+				compute_accel(_bodies.x(), _bodies.ax());
+
+				if (_table)
+				{
+					_play_back(t_now / 100.0,
+						_bodies.x(), _bodies.vx(), _bodies.ax());
+				}
+			}
+
+			_dense.start(t_now / 100.0,
+				_bodies.x(), _bodies.vx(), _bodies.ax());
+		}
+
+		if (_formulation == Formulation::encke)
+			AbortIfNot_2(_to_deviations(t_now / 100.0), -1);
+
+		AbortIfNot_2(propagate(t_now), -1);
+
+		if (_solver == Solver::culled)
+			_perturbers.accumulate(_period / 100.0);
+
+		if (_table)
+		{
+			_play_back((t_now + _period) / 100.0,
+				_bodies.x(), _bodies.vx(), _bodies.ax());
+		}
+
+		if (_formulation == Formulation::encke)
+			AbortIfNot_2(_from_deviations(t_now / 100.0), -1);
+
+		if (dense)
+		{
+			/*
+			 * Some integrators (e.g. Euler and RK4) leave the
+			 * accelerations at the start of the step. Those at the
+			 * end are needed next step anyway
+			 */
+			if (!_accel_valid)
+			{
+				_accel_time = (t_now + _period) / 100.0;
+				compute_accel(_bodies.x(), _bodies.ax());
+
+				if (_table)
+				{
+					_play_back(_accel_time,
+						nullptr, nullptr, _bodies.ax());
+				}
+
+				_accel_valid = true;
+			}
+
+			_dense.finish((t_now + _period) / 100.0,
+				_bodies.x(), _bodies.vx(), _bodies.ax());
+		}
+
+		/*
+		 * Test particles under the Sundman formulation were held
+		 * still through the step. Move them now that the massive
+		 * bodies can be sampled anywhere within it
+		 */
+		if (_formulation == Formulation::sundman)
+		{
+			AbortIfNot_2(_propagate_sundman(t_now / 100.0), -1);
+
+			_dense.finish((t_now + _period) / 100.0,
+				_bodies.x(), _bodies.vx(), _bodies.ax());
+		}
+
+		if (!_locator.empty())
+			AbortIfNot_2(_locator.locate(_dense), -1);
 
 		/*
-		 * 2. Propagate forward by 1 step
+		 * 3. Scatter results back to the objects
 		 */
-		propagate();
+		_store_bodies();
 
 		/*
-		 * 3. Update telemetry output values
+		 * 4. Update telemetry output values
 		 */
-		AbortIfNot_2(_update_telemetry(),
+		AbortIfNot_2(_update_telemetry(t_now / 100.0),
 			false);
 
 		return 0;
 	}
 
+	/**
+	 * Look up a body by name
+	 *
+	 * @param[in] name The name of the body
+	 *
+	 * @return Its index, as passed to \ref state_at(), or -1 if there
+	 *         is no such body
+	 */
+	int EphemerisManager::find(const std::string& name) const
+	{
+		for (size_t i = 0; i < _ids.size(); i++)
+		{
+			if (_ids[i].name == name)
+				return int(i);
+		}
+
+		return -1;
+	}
+
+	/**
+	 * Called once the simulation has ended. If recording, fits and
+	 * writes out the Chebyshev ephemeris of the massive bodies
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::finish()
+	{
+		if (!_radiation.empty() && Verbosity::level >= verbose)
+		{
+			std::printf("radiation pressure: %zu shadows found outside "
+				"the cache\n", _radiation.evaluations());
+			std::fflush(stdout);
+		}
+
+		if (_fit_path.empty()) return true;
+
+		AbortIfNot_2(_fitter.write(_fit_path), false);
+
+		if (Verbosity::level >= terse)
+		{
+			std::printf("wrote %zu Chebyshev records to '%s'\n",
+				_fitter.records(), _fit_path.c_str());
+			std::fflush(stdout);
+		}
+
+		return true;
+	}
+
 	/**
 	 * Initialize.
 	 *
@@ -137,7 +444,7 @@ namespace Crescent
 			std::vector<std::string> tokens;
 			Util::split(line, tokens);
 
-			AbortIf(tokens.size() != 7, false,
+			AbortIf(tokens.size() != 7 && tokens.size() != 8, false,
 				"incomplete ephemeris for '%s'", tokens[0].c_str());
 
 			const std::string path = tokens[0];
@@ -148,6 +455,13 @@ namespace Crescent
 			SharedIDs ids(path);
 			ids.object_id = dir->get_element_id("internal");
 
+			if (tokens.size() == 8)
+			{
+				AbortIf(!Util::from_string<int>(tokens[7], ids.rate) ||
+					ids.rate < 1, false, "invalid rate for '%s'",
+					path.c_str());
+			}
+
 			auto object =
 				dir->get_element<EphemerisObject>(ids.object_id);
 
@@ -162,6 +476,125 @@ namespace Crescent
 			}
 		}
 
+		AbortIfNot_2(_init_ensemble(), false);
+
+		/*
+		 * Place the massive bodies first so that the sources of
+		 * gravity form a contiguous prefix of the block
+		 */
+		auto first_massless = std::stable_partition(
+			_ids.begin(), _ids.end(), [this](const SharedIDs& ids) {
+				return _subdir->load<EphemerisObject>(
+					ids.object_id).massive;
+			});
+
+		_nmassive = first_massless - _ids.begin();
+
+		/*
+		 * Within each block, order bodies from the slowest rate to
+		 * the fastest so that each multirate group is contiguous
+		 */
+		auto slower = [](const SharedIDs& a, const SharedIDs& b) {
+			return a.rate > b.rate;
+		};
+
+		std::stable_sort(_ids.begin(), first_massless, slower);
+		std::stable_sort(first_massless, _ids.end(), slower);
+
+		/*
+		 * Massive bodies played back from a Chebyshev ephemeris go
+		 * first, so the solvers can skip them as targets. Playback
+		 * is not supported by the multirate integrator, which is the
+		 * only one that needs the order by rate
+		 */
+		if (_table)
+		{
+			std::stable_partition(_ids.begin(), first_massless,
+				[this](const SharedIDs& ids) {
+					return _table->find(ids.name) >= 0;
+				});
+		}
+
+		AbortIfNot_2(_init_groups(), false);
+
+		_bodies.resize(_ids.size());
+		_step_begin.resize(_ids.size());
+		_step_end.resize(_ids.size());
+
+		_dense.resize(_ids.size(), _bodies.stride());
+
+		_predicted.assign(3 * _bodies.stride(), 0.0);
+
+		_absolute.assign(3 * _bodies.stride(), 0.0);
+		_sundman_work.assign(6 * _bodies.stride(), 0.0);
+		_conic.assign(6 * _bodies.stride(), 0.0);
+		_kepler_dt.assign(_bodies.stride(), 0.0);
+		_kepler_mu.assign(_bodies.stride(), 0.0);
+
+		_coasts.clear();
+		_patched_init = false;
+
+		ReferenceConic conic;
+		conic.valid = false;
+
+		_references.assign(_ids.size() - _nmassive, conic);
+
+		AbortIf(_formulation != Formulation::cowell &&
+			(_integrator == Integrator::euler    ||
+			 _integrator == Integrator::leapfrog ||
+			 _integrator == Integrator::yoshida4 ||
+			 _integrator == Integrator::multirate ||
+			 _integrator == Integrator::kepler), false,
+			"the %s formulation requires rk4, dopri5, rkf78, abm "
+			"or gbs", _formulation == Formulation::encke ?
+			"Encke" : "Sundman");
+
+		AbortIf(_formulation != Formulation::cowell && _nmassive == 0 &&
+			_ids.size() > 0, false, "the %s formulation requires a "
+			"massive body", _formulation == Formulation::encke ?
+			"Encke" : "Sundman");
+
+		AbortIf(_stm && (_formulation != Formulation::cowell ||
+			_integrator == Integrator::euler    ||
+			_integrator == Integrator::leapfrog ||
+			_integrator == Integrator::yoshida4 ||
+			_integrator == Integrator::multirate ||
+			_integrator == Integrator::kepler ||
+			_parareal_count > 0), false,
+			"the state transition matrix requires the Cowell "
+			"formulation with rk4, dopri5, rkf78, abm or gbs, and no "
+			"Parareal");
+
+		const size_t size = (_stm ? 42 : 6) * _bodies.stride();
+
+		_embedded.resize(size);
+		_extrapolation.resize(size);
+		_rk4.resize(size);
+		_multistep.resize(size);
+
+		if (_stm)
+		{
+			_variational.assign(size, 0.0);
+			AbortIfNot_2(reset_stm(), false);
+		}
+
+		AbortIfNot_2(_init_chebyshev(), false);
+
+		AbortIfNot_2(_init_harmonics(), false);
+
+		AbortIfNot_2(_init_radiation(), false);
+
+		AbortIfNot_2(_init_events(), false);
+
+		AbortIfNot_2(_init_parareal(), false);
+
+		if (Verbosity::level >= verbose)
+		{
+			std::printf("gravity kernel: %s, %zu bodies (%zu massive)\n",
+				Gravity::isa(), _bodies.size(), _nmassive);
+			std::fflush(stdout);
+		}
+
 		AbortIfNot_2(_init_telemetry(), false);
 
 		_is_init = true;
@@ -169,104 +602,3552 @@ namespace Crescent
 	}
 
 	/**
-	 * Propagate the ephemerides of all bodies forward by one
-	 * step (0.02 seconds)
+	 * Propagate the ephemerides of all bodies forward by one step
+	 * using the selected integrator. On return, the acceleration
+	 * columns hold the accelerations last used by the integrator:
+	 * at the start of the step for Euler and RK4, and at the end of
+	 * the step for all others
+	 *
+	 * @param[in] t_now The current simulation time
+	 *
+	 * @return True on success
 	 */
-	void EphemerisManager::propagate()
+	bool EphemerisManager::propagate(int64 t_now)
 	{
-		for (auto iter = _ids.begin(), end = _ids.end();
-			iter != end; ++iter)
-		{
-			auto& obj = _subdir->load<EphemerisObject>(iter->object_id);
+		if (!_parareal_slices.empty())
+			return _propagate_parareal(t_now);
+
+		const double dt = 1.0 / 100 * _period;
 
-			Vector<3> v_eci = obj.rv_eci.sub<3>(3);
+		_accel_time = t_now / 100.0;
 
-			Vector<6> dxdt = v_eci.vcat(obj.accel);
+		const size_t size = 6 * _bodies.stride();
 
-			double dt = 1.0 / 100 * period;
+		if (_stm)
+		{
+			std::copy(_bodies.state(), _bodies.state() + size,
+				_variational.begin());
+		}
+
+		switch (_integrator)
+		{
+		case Integrator::euler:
+			_propagate_euler(dt);
+			break;
+		case Integrator::rk4:
+			_propagate_rk4(t_now / 100.0);
+			break;
+		case Integrator::leapfrog:
+		case Integrator::yoshida4:
+			_propagate_symplectic(t_now / 100.0, dt);
+			break;
+		case Integrator::gbs:
+			AbortIfNot(_propagate_extrapolation(t_now / 100.0, dt),
+				false, "step size underflow at t = %g", t_now / 100.0);
+			break;
+		case Integrator::multirate:
+			_propagate_multirate(t_now / 100.0, dt);
+			break;
+		case Integrator::abm:
+			AbortIfNot(_propagate_multistep(t_now / 100.0, dt), false,
+				"step size underflow at t = %g", t_now / 100.0);
+			break;
+		case Integrator::kepler:
+			AbortIfNot_2(_propagate_kepler(t_now / 100.0, dt), false);
+			break;
+		default:
+			AbortIfNot(_propagate_embedded(t_now / 100.0, dt), false,
+				"step size underflow at t = %g", t_now / 100.0);
+		}
 
-			obj.rv_eci += dxdt * dt;
+		if (_stm)
+		{
+			std::copy(_variational.begin(), _variational.begin() + size,
+				_bodies.state());
 		}
+
+		return true;
 	}
 
 	/**
-	 * Initialize telemetry outputs
+	 * Restart the state transition matrices of all test particles
+	 * from the identity, so that they map deviations from their
+	 * current states. Call between steps, e.g. after a burn whose
+	 * effect is to be studied. Only valid once initialized with the
+	 * matrices enabled (see \ref set_stm())
 	 *
 	 * @return True on success
 	 */
-	bool EphemerisManager::_init_telemetry()
+	bool EphemerisManager::reset_stm()
 	{
-		for (auto iter = _ids.begin(), end = _ids.end();
-			iter != end; ++iter)
+		AbortIf(_variational.empty(), false,
+			"state transition matrices are not being propagated");
+
+		const size_t stride = _bodies.stride();
+
+		for (size_t r = 0; r < 6; r++)
 		{
-			iter->telemetry = _subdir->subdir(iter->name)->subdir("telemetry");
-			AbortIfNot_2(iter->telemetry, false);
+			for (size_t c = 0; c < 6; c++)
+			{
+				double* phi = &_variational[(6 + 6 * r + c) * stride];
 
-			int id = iter->telemetry->create_element<double>("a_eci.0");
-			iter->a_eci_id[0] = id;
+				std::fill(phi, phi + stride, r == c ? 1.0 : 0.0);
+			}
+		}
 
-			id = iter->telemetry->create_element<double>("a_eci.1");
-			iter->a_eci_id[1] = id;
+		for (size_t i = 0; i < _ids.size(); i++)
+		{
+			_subdir->load<EphemerisObject>(
+				_ids[i].object_id).stm.identify();
+		}
 
-			id = iter->telemetry->create_element<double>("a_eci.2");
-			iter->a_eci_id[2] = id;
+		_accel_valid = false;
+		return true;
+	}
 
-			id = iter->telemetry->create_element<double>("r_eci.0");
-			iter->r_eci_id[0] = id;
+	/**
+	 * Play back bodies from a Chebyshev ephemeris instead of
+	 * integrating them. Massive bodies in the ephemeris config that
+	 * the file contains follow their tabulated trajectories and act on
+	 * all others, but are not themselves perturbed, so no solver
+	 * spends any work on their accelerations. Since the file is
+	 * memory mapped, concurrent runs share a single copy of it
+	 *
+	 * @param[in] path The file written by \ref finish() during an
+	 *                 earlier run
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_chebyshev_input(const std::string& path)
+	{
+		AbortIf_2(_is_init, false);
 
-			id = iter->telemetry->create_element<double>("r_eci.1");
-			iter->r_eci_id[1] = id;
+		Handle<ChebyshevEphemeris> table(new ChebyshevEphemeris());
 
-			id = iter->telemetry->create_element<double>("r_eci.2");
-			iter->r_eci_id[2] = id;
+		AbortIfNot_2(table->open(path), false);
 
-			id = iter->telemetry->create_element<double>("v_eci.0");
-			iter->v_eci_id[0] = id;
+		_table = table;
+		return true;
+	}
 
-			id = iter->telemetry->create_element<double>("v_eci.1");
-			iter->v_eci_id[1] = id;
+	/**
+	 * Record the trajectories of the massive bodies and, once the
+	 * simulation has ended, fit them with piecewise Chebyshev series
+	 * and write them out for playback with \ref set_chebyshev_input().
+	 * Positions are sampled several times per coefficient over each
+	 * record, at a multiple of the ephemeris step
+	 *
+	 * @param[in] path     The file to write
+	 * @param[in] interval Time span of each record, seconds. Must be a
+	 *                     multiple of the ephemeris step
+	 * @param[in] ncoeff   Coefficients per series, i.e. the degree of
+	 *                     the polynomials plus 1
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_chebyshev_output(const std::string& path,
+		double interval, int ncoeff)
+	{
+		AbortIf_2(_is_init, false);
 
-			id = iter->telemetry->create_element<double>("v_eci.2");
-			iter->v_eci_id[2] = id;
+		AbortIf(!(interval > 0.0), false,
+			"invalid Chebyshev interval: %g", interval);
 
-			for (int i = 0; i <= 2; i++)
-			{
-				AbortIf_2(iter->a_eci_id[i] < 0, false);
-				AbortIf_2(iter->r_eci_id[i] < 0, false);
-				AbortIf_2(iter->v_eci_id[i] < 0, false);
-			}
-		}
+		AbortIf(ncoeff < 2 ||
+			size_t(ncoeff) > ChebyshevEphemeris::max_coefficients,
+			false, "invalid Chebyshev coefficient count: %d", ncoeff);
 
-		AbortIfNot_2(_update_telemetry(), false);
+		_fit_path     = path;
+		_fit_interval = interval;
+		_fit_ncoeff   = ncoeff;
 
 		return true;
 	}
 
 	/**
-	 * Update telemetry outputs with freshly computed values
+	 * Set the edge length of the cells used by the cluster solver.
+	 * Bodies which strongly perturb each other, such as a planet and
+	 * its moons, should fall in the same or neighboring cells
+	 *
+	 * @param[in] size The edge length, meters
 	 *
 	 * @return True on success
 	 */
-	bool EphemerisManager::_update_telemetry()
+	bool EphemerisManager::set_cluster_size(double size)
 	{
-		for (auto iter = _ids.begin(), end = _ids.end();
-			iter != end; ++iter)
-		{
-			auto& object = _subdir->load<EphemerisObject>(iter->object_id);
-
-			for (int i = 0; i <= 2; i++)
-			{
-				iter->telemetry->load<double>(iter->a_eci_id[i])
-					= object.accel(i);
-
-				iter->telemetry->load<double>(iter->r_eci_id[i])
-					= object.rv_eci(i);
-
-				iter->telemetry->load<double>(iter->v_eci_id[i])
-					= object.rv_eci(i + 3);
-			}
-		}
+		AbortIfNot_2(_clusters.set_cell_size(size), false);
 
 		return true;
 	}
+
+	/**
+	 * Keep the states of all bodies over each step, so that they can
+	 * be sampled at any time within it (see \ref DenseOutput). Then
+	 * telemetry is published at every cycle, holding the states at
+	 * that cycle, rather than once per step holding the states at
+	 * the end of the step just taken. This lets the step be much
+	 * longer than the telemetry period
+	 *
+	 * @param[in] enable True to enable dense output
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_dense_output(bool enable)
+	{
+		AbortIf_2(_is_init, false);
+
+		_dense_output = enable;
+		return true;
+	}
+
+	/**
+	 * Propagate perturbed copies of a test particle alongside it, e.g.
+	 * for dispersion analysis. Copy k, for k = 1 to \a count, is named
+	 * "<body>.k" and starts from the state of \a body in the ephemeris
+	 * config file plus independent Gaussian errors in every position
+	 * and velocity component. The copies are test particles, held
+	 * contiguously next to \a body in the structure-of-arrays block,
+	 * so each fills a lane of the vectorized gravity kernel and the
+	 * massive bodies are propagated once for all of them
+	 *
+	 * @param[in] body    The name of the test particle to copy
+	 * @param[in] count   The number of copies, or 0 for none
+	 * @param[in] sigma_r The standard deviation of each position
+	 *                    component, meters
+	 * @param[in] sigma_v The standard deviation of each velocity
+	 *                    component, meters/second
+	 * @param[in] seed    The seed of the random dispersions, so that a
+	 *                    run can be repeated
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_ensemble(const std::string& body,
+		int count, double sigma_r, double sigma_v, unsigned int seed)
+	{
+		AbortIf_2(_is_init, false);
+
+		AbortIf(count < 0, false, "invalid ensemble size: %d", count);
+
+		AbortIf(!(sigma_r >= 0.0) || !(sigma_v >= 0.0), false,
+			"invalid ensemble dispersion: sigma_r = %g, sigma_v = %g",
+			sigma_r, sigma_v);
+
+		AbortIf(count > 0 && body.empty(), false,
+			"no body to make an ensemble of");
+
+		_ensemble.body    = Util::trim(body);
+		_ensemble.count   = count;
+		_ensemble.seed    = seed;
+		_ensemble.sigma_r = sigma_r;
+		_ensemble.sigma_v = sigma_v;
+
+		return true;
+	}
+
+	/**
+	 * Set how closely the times of event crossings are located
+	 *
+	 * @param[in] seconds The tolerance
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_event_tolerance(double seconds)
+	{
+		AbortIfNot_2(_locator.set_tolerance(seconds), false);
+		return true;
+	}
+
+	/**
+	 * Read events whose crossings are logged as they happen. Each line
+	 * of the config file reads
+	 *
+	 *   name  body  reference  function  [value]  direction
+	 *
+	 * where reference is a body or "inertial", function is either
+	 * "range_rate" (rising at periapsis, falling at apoapsis) or
+	 * "distance" followed by a distance in km (e.g. the radius of the
+	 * reference body to catch impact, or that of its sphere of
+	 * influence), and direction is "rising", "falling" or "both"
+	 *
+	 * @param[in] config The events config file
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_events(const std::string& config)
+	{
+		AbortIf_2(_is_init, false);
+
+		std::vector<std::string> lines;
+		AbortIfNot_2(read_config(config, lines), false);
+
+		_events.clear();
+
+		for (auto& line : lines)
+		{
+			std::vector<std::string> tokens;
+			Util::split(line, tokens);
+
+			AbortIf(tokens.size() < 5, false,
+				"incomplete event entry for '%s'", tokens[0].c_str());
+
+			EventConfig event;
+			event.name      = tokens[0];
+			event.body      = tokens[1];
+			event.reference = Util::to_lower(tokens[2]) == "inertial" ?
+				"" : tokens[2];
+
+			const std::string function  = Util::to_lower(tokens[3]);
+			const std::string direction = Util::to_lower(tokens.back());
+
+			if (function == "range_rate" && tokens.size() == 5)
+			{
+				event.function   = EventLocator::range_rate();
+				event.hysteresis = 1.0e-3;
+			}
+			else if (function == "distance" && tokens.size() == 6)
+			{
+				double d;
+				AbortIf(!Util::from_string<double>(tokens[4], d) ||
+					d < 0.0, false, "invalid distance for event '%s'",
+					event.name.c_str());
+
+				event.function   = EventLocator::distance(d * 1.0e3);
+				event.hysteresis = 1.0;
+			}
+			else
+			{
+				Abort(false, "invalid function for event '%s'",
+					event.name.c_str());
+			}
+
+			if (direction == "rising")
+				event.direction = EventLocator::Direction::rising;
+			else if (direction == "falling")
+				event.direction = EventLocator::Direction::falling;
+			else if (direction == "both")
+				event.direction = EventLocator::Direction::both;
+			else
+			{
+				Abort(false, "invalid direction for event '%s'",
+					event.name.c_str());
+			}
+
+			_events.push_back(event);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Select the equations of motion integrated for the test particles
+	 * (e.g. spacecraft). Under the Cowell formulation their total
+	 * acceleration is integrated directly. Under the Encke formulation
+	 * each follows an osculating two-body orbit about its primary,
+	 * propagated analytically, and only the small deviation from it is
+	 * integrated, which lets the adaptive integrators take much larger
+	 * steps. Under the Sundman formulation each is held still while
+	 * the massive bodies take their step, and is then integrated on
+	 * its own relative to its primary, with its own steps shortened
+	 * near periapsis (see \ref set_sundman_steps()), so that close
+	 * approaches do not shorten the step of the rest of the bodies.
+	 * Massive bodies always use the Cowell formulation
+	 *
+	 * @param[in] name Either "cowell", "encke" or "sundman"
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_formulation(const std::string& name)
+	{
+		AbortIf_2(_is_init, false);
+
+		const std::string formulation = Util::to_lower(Util::trim(name));
+
+		if (formulation == "cowell")
+			_formulation = Formulation::cowell;
+		else if (formulation == "encke")
+			_formulation = Formulation::encke;
+		else if (formulation == "sundman")
+			_formulation = Formulation::sundman;
+		else
+		{
+			Abort(false, "unknown formulation '%s'",
+				name.c_str());
+		}
+
+		_accel_valid = false;
+		return true;
+	}
+
+	/**
+	 * Read the bodies whose gravity is expanded in spherical
+	 * harmonics. Each line of the config file reads
+	 *
+	 *   name  degree  field  model  parameters...
+	 *
+	 * where field is a gravity field file (see
+	 * \ref SphericalHarmonics::load()), relative to the config file
+	 * unless absolute, truncated to the given degree and order, and
+	 * the model and its parameters give the body's orientation (see
+	 * \ref Orientation::create()). A field listed earlier may then be
+	 * cached over a shell (see \ref GravityGrid) by a line reading
+	 *
+	 *   grid  name  file  inner  outer  spacing
+	 *
+	 * with the inner and outer altitudes of the shell above the
+	 * reference radius of the field and the spacing of the nodes, all
+	 * in km. The grid is read from file if it matches the field, and
+	 * otherwise built when the manager is initialized and written to
+	 * the file for later runs
+	 *
+	 * @param[in] config The harmonics config file
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_harmonics(const std::string& config)
+	{
+		AbortIf_2(_is_init, false);
+
+		std::vector<std::string> lines;
+		AbortIfNot_2(read_config(config, lines), false);
+
+		const size_t slash = config.find_last_of("/\\");
+
+		const std::string dir = slash == std::string::npos ?
+			"" : config.substr(0, slash + 1);
+
+		auto resolve = [&](const std::string& path) {
+			if (path[0] != '/' && path[0] != '\\' &&
+				path.find(':') == std::string::npos)
+			{
+				return dir + path;
+			}
+
+			return path;
+		};
+
+		_harmonics.clear();
+
+		for (auto& line : lines)
+		{
+			std::vector<std::string> tokens;
+			Util::split(line, tokens);
+
+			if (Util::to_lower(tokens[0]) == "grid")
+			{
+				AbortIf(tokens.size() != 6, false,
+					"grid entries take a name, a file and 3 values");
+
+				auto iter = std::find_if(_harmonics.begin(),
+					_harmonics.end(), [&](const HarmonicField& field) {
+						return field.name == tokens[1];
+					});
+
+				AbortIf(iter == _harmonics.end(), false,
+					"no harmonics entry for '%s' precedes its grid",
+					tokens[1].c_str());
+
+				AbortIf(iter->grid, false, "duplicate grid for '%s'",
+					tokens[1].c_str());
+
+				double values[3];
+
+				for (int i = 0; i < 3; i++)
+				{
+					AbortIfNot(Util::from_string<double>(tokens[i + 3],
+						values[i]), false, "invalid grid value '%s'",
+						tokens[i + 3].c_str());
+				}
+
+				const double radius = iter->field->radius();
+
+				iter->grid.reset(new GravityGrid());
+
+				AbortIfNot_2(iter->grid->init(iter->field,
+					radius + values[0] * 1.0e3,
+					radius + values[1] * 1.0e3,
+					values[2] * 1.0e3), false);
+
+				iter->grid_path = resolve(tokens[2]);
+				continue;
+			}
+
+			AbortIf(tokens.size() < 4, false,
+				"incomplete harmonics entry for '%s'", tokens[0].c_str());
+
+			HarmonicField field;
+			field.body = 0;
+			field.name = tokens[0];
+
+			for (const auto& other : _harmonics)
+			{
+				AbortIf(other.name == field.name, false,
+					"duplicate harmonics entry for '%s'",
+					field.name.c_str());
+			}
+
+			int degree;
+			AbortIf(!Util::from_string<int>(tokens[1], degree) ||
+				degree < 2, false, "invalid degree for '%s'",
+				field.name.c_str());
+
+			field.field.reset(new SphericalHarmonics());
+			AbortIfNot_2(field.field->load(resolve(tokens[2]), degree),
+				false);
+
+			field.orientation = Orientation::create(
+				std::vector<std::string>(tokens.begin() + 3, tokens.end()));
+
+			AbortIfNot(field.orientation, false,
+				"invalid orientation for '%s'", field.name.c_str());
+
+			_harmonics.push_back(field);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Select the method used to propagate the ephemerides
+	 *
+	 * @param[in] name One of "euler", "rk4", "leapfrog", "yoshida4",
+	 *                 "dopri5", "rkf78", "gbs", "abm", "multirate" or
+	 *                 "kepler"
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_integrator(const std::string& name)
+	{
+		AbortIf_2(_is_init, false);
+
+		const std::string integrator = Util::to_lower(Util::trim(name));
+
+		if (integrator == "euler")
+			_integrator = Integrator::euler;
+		else if (integrator == "rk4")
+			_integrator = Integrator::rk4;
+		else if (integrator == "leapfrog")
+			_integrator = Integrator::leapfrog;
+		else if (integrator == "yoshida4")
+			_integrator = Integrator::yoshida4;
+		else if (integrator == "dopri5")
+		{
+			_integrator = Integrator::dopri5;
+			_embedded.set_tableau(EmbeddedRK::dormand_prince54());
+		}
+		else if (integrator == "rkf78")
+		{
+			_integrator = Integrator::rkf78;
+			_embedded.set_tableau(EmbeddedRK::fehlberg78());
+		}
+		else if (integrator == "gbs")
+			_integrator = Integrator::gbs;
+		else if (integrator == "abm")
+			_integrator = Integrator::abm;
+		else if (integrator == "multirate")
+			_integrator = Integrator::multirate;
+		else if (integrator == "kepler")
+			_integrator = Integrator::kepler;
+		else
+		{
+			Abort(false, "unknown integrator '%s'",
+				name.c_str());
+		}
+
+		_accel_valid = false;
+		return true;
+	}
+
+	/**
+	 * Set the number of steps used by the Adams-Bashforth-Moulton
+	 * integrator, which is also its order of accuracy
+	 *
+	 * @param[in] order The number of steps
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_multistep_order(int order)
+	{
+		AbortIf(order < 1 || !_multistep.set_order(order), false,
+			"invalid multistep order: %d", order);
+
+		_multistep.resize((_stm ? 42 : 6) * _bodies.stride());
+
+		_accel_valid = false;
+		return true;
+	}
+
+	/**
+	 * Set the opening angle used by the tree solver. Smaller angles are
+	 * more accurate and more expensive; 0 degenerates to the direct
+	 * sum
+	 *
+	 * @param[in] theta The opening angle, radians, in [0, 1]
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_opening_angle(double theta)
+	{
+		AbortIfNot(_octree.set_theta(theta), false,
+			"invalid opening angle: %g", theta);
+
+		return true;
+	}
+
+	/**
+	 * Replace the orientation model of a body with a spherical-harmonic
+	 * field, e.g. with one that includes librations
+	 *
+	 * @param[in] body        The name of the body, which must appear
+	 *                        in the harmonics config file
+	 * @param[in] orientation The new model
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_orientation(const std::string& body,
+		Handle<Orientation> orientation)
+	{
+		AbortIfNot(orientation, false, "no orientation model for '%s'",
+			body.c_str());
+
+		for (auto& field : _harmonics)
+		{
+			if (field.name == body)
+			{
+				field.orientation = orientation;
+				return true;
+			}
+		}
+
+		Abort(false, "'%s' has no spherical-harmonic field",
+			body.c_str());
+	}
+
+	/**
+	 * Propagate in parallel in time with Parareal (see \ref Parareal).
+	 * The run is cut into windows of about \a span seconds, each cut
+	 * into \a slices slices of whole steps. When a step begins
+	 * outside the current window, or after the state was changed from
+	 * outside (e.g. by a burn), the window starting there is solved:
+	 * RK4 with steps of about \a coarse_step seconds is the coarse
+	 * propagator, and the selected integrator, stepping as it would
+	 * serially, is the fine one. The fine propagator records every
+	 * step, and the steps of the window are then played back one per
+	 * dispatch. Slices are shared among the threads set by
+	 * \ref set_threads(), and the iterations converge within the
+	 * tolerance set by \ref set_tolerance().
+	 *
+	 * The window is held in memory, taking 72 bytes per body per step.
+	 * Requires the rk4, dopri5, rkf78 or gbs integrator, the direct
+	 * solver and the Cowell formulation, without spherical harmonics
+	 * or Chebyshev playback
+	 *
+	 * @param[in] slices      The number of slices per window, or zero
+	 *                        to propagate serially
+	 * @param[in] span        The length of each window, seconds
+	 * @param[in] coarse_step The step size of the coarse propagator,
+	 *                        seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_parareal(int slices, double span,
+		double coarse_step)
+	{
+		AbortIf_2(_is_init, false);
+
+		AbortIf(slices < 0, false, "invalid Parareal slice count: %d",
+			slices);
+
+		AbortIf(!(span > 0.0) || !(coarse_step > 0.0), false,
+			"invalid Parareal window: span = %g, coarse step = %g",
+			span, coarse_step);
+
+		_parareal_coarse_step = coarse_step;
+		_parareal_count       = slices;
+		_parareal_span        = span;
+
+		return true;
+	}
+
+	/**
+	 * Configure the culled solver. Perturbers are sorted by the
+	 * acceleration they exert on each body whenever the lists are
+	 * refreshed
+	 *
+	 * @param[in] drop    Weaker perturbers are ignored, m/s^2
+	 * @param[in] hold    Weaker perturbers are evaluated only when the
+	 *                    lists are refreshed and held in between, m/s^2
+	 * @param[in] refresh The number of force evaluations between
+	 *                    refreshes
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_perturber_culling(double drop, double hold,
+		int refresh)
+	{
+		AbortIfNot_2(_perturbers.set_thresholds(drop, hold), false);
+
+		AbortIfNot_2(_perturbers.set_refresh_interval(refresh), false);
+
+		return true;
+	}
+
+	/**
+	 * Load the config file of solar radiation pressure, which lists
+	 * the Sun, the bodies that may eclipse it and the spacecraft that
+	 * feel it (see \ref SolarPressure)
+	 *
+	 * @param[in] config The path to the config file
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_radiation_pressure(const std::string& config)
+	{
+		AbortIf_2(_is_init, false);
+
+		std::vector<std::string> lines;
+		AbortIfNot_2(read_config(config, lines), false);
+
+		_radiation_config.clear();
+
+		for (auto& line : lines)
+		{
+			std::vector<std::string> tokens;
+			Util::split(line, tokens);
+
+			RadiationConfig entry;
+			entry.area_to_mass = 0.0;
+			entry.radius       = 0.0;
+			entry.reflectivity = 0.0;
+			entry.sun          = false;
+
+			const std::string kind = Util::to_lower(tokens[0]);
+
+			if (kind == "sun" || kind == "occulter")
+			{
+				AbortIf(tokens.size() != 3, false,
+					"%s entries take a name and a radius", kind.c_str());
+
+				entry.name = tokens[1];
+				entry.sun  = kind == "sun";
+
+				AbortIf(!Util::from_string<double>(tokens[2],
+					entry.radius) || !(entry.radius > 0.0), false,
+					"invalid radius for '%s'", entry.name.c_str());
+
+				entry.radius *= 1.0e3;
+			}
+			else
+			{
+				AbortIf(tokens.size() != 3, false,
+					"incomplete radiation pressure entry for '%s'",
+					tokens[0].c_str());
+
+				entry.name = tokens[0];
+
+				AbortIf(!Util::from_string<double>(tokens[1],
+					entry.area_to_mass) || !(entry.area_to_mass >= 0.0) ||
+					!Util::from_string<double>(tokens[2],
+					entry.reflectivity) || !(entry.reflectivity >= 0.0),
+					false, "invalid radiation pressure parameters for "
+					"'%s'", entry.name.c_str());
+			}
+
+			_radiation_config.push_back(entry);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Set how far a test particle may deviate from its reference conic
+	 * under the Encke formulation before the conic is rectified, i.e.
+	 * replaced by the osculating orbit at the current state
+	 *
+	 * @param[in] ratio The largest deviation, as a fraction of the
+	 *                  position and velocity relative to the primary
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_rectify_threshold(double ratio)
+	{
+		AbortIf(!(ratio > 0.0), false,
+			"invalid rectification threshold: %g", ratio);
+
+		_rectify = ratio;
+		return true;
+	}
+
+	/**
+	 * Select the method used to compute gravity
+	 *
+	 * @param[in] name One of "direct", "tree", "cluster" or "culled"
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_solver(const std::string& name)
+	{
+		AbortIf_2(_is_init, false);
+
+		const std::string solver = Util::to_lower(Util::trim(name));
+
+		if (solver == "direct")
+			_solver = Solver::direct;
+		else if (solver == "tree")
+			_solver = Solver::tree;
+		else if (solver == "cluster")
+			_solver = Solver::cluster;
+		else if (solver == "culled")
+			_solver = Solver::culled;
+		else
+		{
+			Abort(false, "unknown gravity solver '%s'",
+				name.c_str());
+		}
+
+		return true;
+	}
+
+	/**
+	 * Set the propagation step size. The ephemerides are propagated
+	 * once every step, so this also sets the dispatch rate
+	 *
+	 * @param[in] seconds The step size, which must be a positive
+	 *                    multiple of the 0.01 second cycle period
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_step(double seconds)
+	{
+		AbortIf_2(_is_init, false);
+
+		const int64 ticks = std::llround(seconds * 100);
+
+		AbortIf(ticks < 1 || std::abs(seconds * 100 - ticks) > 1e-6,
+			false, "invalid ephemeris step: %g", seconds);
+
+		_period = ticks;
+
+		_rk4.set_step_size(ticks / 100.0);
+		return true;
+	}
+
+	/**
+	 * Set how finely test particles are stepped under the Sundman
+	 * formulation. Each particle advances in a fictitious time s,
+	 * where dt = r^(3/2) / sqrt(mu) ds and r is its distance from its
+	 * primary, with fixed steps in s. On a circular orbit s is the
+	 * mean anomaly, so the steps are even; on an eccentric one they
+	 * shorten in proportion to r^(3/2) towards periapsis. A particle
+	 * far from every massive body whose steps would outlast the
+	 * ephemeris step takes a single step in physical time instead
+	 *
+	 * @param[in] steps The number of steps per revolution of a
+	 *                  circular orbit
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_sundman_steps(int steps)
+	{
+		AbortIf(steps < 4, false, "invalid Sundman step count: %d",
+			steps);
+
+		_sundman_steps = steps;
+		return true;
+	}
+
+	/**
+	 * Integrate the variational equations of the test particles along
+	 * with their states, so that each carries its 6x6 state
+	 * transition matrix, i.e. the partial derivatives of its state
+	 * with respect to that at the start of the run (or at the last
+	 * \ref reset_stm()). The matrix obeys
+	 *
+	 *   d(Phi)/dt = | 0  I | Phi
+	 *               | G  0 |
+	 *
+	 * where G is the gradient of the point-mass gravity of the
+	 * massive bodies at the particle's position. The massive bodies
+	 * are held fixed in the derivatives, and the gradients of any
+	 * spherical harmonics beyond the central term and of radiation
+	 * pressure are left out. One run yields what would otherwise take
+	 * seven runs of one-sided finite differences, at a fraction of
+	 * their cost. Adaptive integrators hold the matrix elements to the
+	 * same tolerance as the states
+	 *
+	 * @param[in] enable True to enable
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_stm(bool enable)
+	{
+		AbortIf_2(_is_init, false);
+
+		_stm = enable;
+		return true;
+	}
+
+	/**
+	 * Set the error tolerance of the adaptive and extrapolation
+	 * integrators. Each step
+	 * keeps the local error of every position (m) and velocity (m/s)
+	 * component below atol + rtol * |value|
+	 *
+	 * @param[in] rtol Relative tolerance
+	 * @param[in] atol Absolute tolerance
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_tolerance(double rtol, double atol)
+	{
+		AbortIfNot(_embedded.set_tolerance(rtol, atol), false,
+			"invalid tolerance: rtol = %g, atol = %g", rtol, atol);
+
+		_extrapolation.set_tolerance(rtol, atol);
+		_parareal.set_tolerance(rtol, atol);
+
+		return true;
+	}
+
+	/**
+	 * Set the number of threads used to compute gravity. With more
+	 * than one thread, each unordered pair of bodies is evaluated once
+	 * and the pair matrix is tiled across a persistent worker pool
+	 *
+	 * @param[in] nthreads The number of threads; 1 runs the serial
+	 *                     kernel
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::set_threads(int nthreads)
+	{
+		AbortIf(nthreads < 1, false, "invalid thread count: %d",
+			nthreads);
+
+		if (nthreads == 1)
+			_pool.reset();
+		else
+			_pool.reset(new ThreadPool(nthreads));
+
+		return true;
+	}
+
+	/**
+	 * Get the state of a body at any time within the last step. The
+	 * step taken at the dispatch of cycle t_now spans from t_now to
+	 * t_now plus the step size. Requires dense output (see
+	 * \ref set_dense_output())
+	 *
+	 * @param[in]  body The index of the body (see \ref find())
+	 * @param[in]  t    The time, seconds
+	 * @param[out] r    Position, meters, ECI J2000
+	 * @param[out] v    Velocity, meters/second, ECI J2000
+	 * @param[out] a    Acceleration, meters/second^2, ECI J2000
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::state_at(size_t body, double t, double* r,
+		double* v, double* a) const
+	{
+		AbortIf(!_dense_output && _locator.empty(), false,
+			"dense output is disabled");
+
+		AbortIfNot(_dense.evaluate(body, t, r, v, a), false,
+			"no state of body %zu at t = %g; the last step spans "
+			"[%g, %g]", body, t, _dense.t_begin(), _dense.t_end());
+
+		return true;
+	}
+
+	/**
+	 * Add the accelerations due to the spherical-harmonic fields,
+	 * beyond their central terms, to a range of bodies. Each field
+	 * also pulls on its own body in reaction to the massive bodies it
+	 * accelerates, so that momentum is conserved. The orientation of
+	 * every field is evaluated once per call, at \ref _accel_time, and
+	 * shared by all targets
+	 *
+	 * @param[in]     r     The x|y|z position columns
+	 * @param[in]     begin The first body
+	 * @param[in]     end   One past the last body
+	 * @param[in,out] a     The x|y|z acceleration columns
+	 */
+	void EphemerisManager::_add_harmonics(const double* r, size_t begin,
+		size_t end, double* a)
+	{
+		const size_t n      = _bodies.size();
+		const size_t stride = _bodies.stride();
+
+		const double* gm = _bodies.gm();
+
+		for (const auto& field : _harmonics)
+		{
+			const size_t k = field.body;
+
+			const bool owner = k >= begin && k < end;
+
+			auto target = [&](size_t i) {
+				return i != k && ((i >= begin && i < end) ||
+					(owner && i < _nmassive));
+			};
+
+			const Matrix<3, 3> rotation =
+				field.orientation->to_fixed(_accel_time);
+
+			double dcm[3][3];
+
+			for (size_t row = 0; row < 3; row++)
+			{
+				for (size_t col = 0; col < 3; col++)
+					dcm[row][col] = rotation(row, col);
+			}
+
+			auto work = [&](size_t thread)
+			{
+				const size_t nthread = _pool ? _pool->size() : 1;
+				const size_t chunk   = (n + nthread - 1) / nthread;
+
+				const size_t i_begin = std::min(n, chunk * thread);
+				const size_t i_end   = std::min(n, i_begin + chunk);
+
+				for (size_t i = i_begin; i < i_end; i++)
+				{
+					if (!target(i)) continue;
+
+					double d[3], fixed[3], accel[3];
+
+					for (size_t c = 0; c < 3; c++)
+						d[c] = r[c * stride + i] - r[c * stride + k];
+
+					for (size_t c = 0; c < 3; c++)
+					{
+						fixed[c] = dcm[c][0] * d[0] + dcm[c][1] * d[1] +
+							dcm[c][2] * d[2];
+					}
+
+					if (!field.grid ||
+						!field.grid->acceleration(fixed, accel))
+					{
+						field.field->acceleration(fixed, accel, thread);
+					}
+
+					for (size_t c = 0; c < 3; c++)
+					{
+						_harmonic_accel[c * stride + i] =
+							dcm[0][c] * accel[0] + dcm[1][c] * accel[1] +
+							dcm[2][c] * accel[2];
+					}
+				}
+			};
+
+			if (_pool)
+				_pool->run(work);
+			else
+				work(0);
+
+			double reaction[3] = { 0.0, 0.0, 0.0 };
+
+			for (size_t i = 0; i < n; i++)
+			{
+				if (!target(i)) continue;
+
+				for (size_t c = 0; c < 3; c++)
+				{
+					const double accel = _harmonic_accel[c * stride + i];
+
+					if (i >= begin && i < end)
+						a[c * stride + i] += accel;
+
+					if (owner && i < _nmassive)
+						reaction[c] += gm[i] * accel;
+				}
+			}
+
+			if (owner && gm[k] > 0.0)
+			{
+				for (size_t c = 0; c < 3; c++)
+					a[c * stride + k] -= reaction[c] / gm[k];
+			}
+		}
+	}
+
+	/**
+	 * Compute the accelerations of all objects with the far field in
+	 * single precision (see \ref ClusterField). With a worker pool,
+	 * the clusters are split into contiguous runs holding roughly equal
+	 * numbers of bodies, one run per thread
+	 *
+	 * @param[in]  r The x|y|z position columns
+	 * @param[out] a The x|y|z acceleration columns
+	 */
+	void EphemerisManager::_compute_accel_clustered(const double* r,
+		double* a)
+	{
+		const size_t n      = _bodies.size();
+		const size_t stride = _bodies.stride();
+
+		double* ax = a;
+		double* ay = a + stride;
+		double* az = a + 2 * stride;
+
+		for (size_t i = n; i < stride; i++)
+			ax[i] = ay[i] = az[i] = 0.0;
+
+		_clusters.build(r, r + stride, r + 2 * stride, _bodies.gm(),
+			_tabulated.size(), _nmassive, n, _pool ? _pool->size() : 1);
+
+		const size_t nclusters = _clusters.size();
+
+		if (!_pool)
+		{
+			_clusters.evaluate(0, nclusters, 0, ax, ay, az);
+			return;
+		}
+
+		const size_t nthread = _pool->size();
+
+		std::vector<size_t> split(nthread + 1, nclusters);
+		split[0] = 0;
+
+		for (size_t c = 0, thread = 1; c < nclusters && thread < nthread;
+			 c++)
+		{
+			if (_clusters.targets(0, c + 1) * nthread >= n * thread)
+				split[thread++] = c + 1;
+		}
+
+		_pool->run([&](size_t thread)
+		{
+			_clusters.evaluate(split[thread], split[thread + 1], thread,
+				ax, ay, az);
+		});
+	}
+
+	/**
+	 * Compute the accelerations of all objects over the perturber
+	 * lists (see \ref PerturberLists). With a worker pool, each thread
+	 * takes a contiguous run of bodies
+	 *
+	 * @param[in]  r The x|y|z position columns
+	 * @param[out] a The x|y|z acceleration columns
+	 */
+	void EphemerisManager::_compute_accel_culled(const double* r,
+		double* a)
+	{
+		const size_t n      = _bodies.size();
+		const size_t stride = _bodies.stride();
+
+		const double* x = r;
+		const double* y = r + stride;
+		const double* z = r + 2 * stride;
+
+		double* ax = a;
+		double* ay = a + stride;
+		double* az = a + 2 * stride;
+
+		for (size_t i = n; i < stride; i++)
+			ax[i] = ay[i] = az[i] = 0.0;
+
+		const bool refresh = _perturbers.start_evaluation(n);
+
+		/*
+		 * Played back bodies are skipped
+		 */
+		const size_t first = _tabulated.size();
+
+		if (!_pool)
+		{
+			_perturbers.evaluate(x, y, z, _bodies.gm(), _nmassive,
+				first, n, refresh, ax, ay, az);
+			return;
+		}
+
+		const size_t nthread = _pool->size();
+
+		_pool->run([&](size_t thread)
+		{
+			const size_t chunk = (n - first + nthread - 1) / nthread;
+
+			const size_t begin = std::min(n, first + chunk * thread);
+			const size_t end   = std::min(n, begin + chunk);
+
+			_perturbers.evaluate(x, y, z, _bodies.gm(), _nmassive,
+				begin, end, refresh, ax, ay, az);
+		});
+	}
+
+	/**
+	 * Compute the accelerations of all objects by direct summation over
+	 * the massive bodies, on the calling thread. Reads nothing but the
+	 * gravitational parameters, so it may be called concurrently
+	 *
+	 * @param[in]  r The x|y|z position columns
+	 * @param[out] a The x|y|z acceleration columns
+	 */
+	void EphemerisManager::_compute_accel_direct(const double* r,
+		double* a)
+	{
+		const size_t stride = _bodies.stride();
+
+		double* ax = a;
+		double* ay = a + stride;
+		double* az = a + 2 * stride;
+
+		for (size_t i = 0; i < stride; i++)
+			ax[i] = ay[i] = az[i] = 0.0;
+
+		/*
+		 * Targets run over the padded stride so the vector loop
+		 * never needs a remainder. Played back bodies are skipped
+		 */
+		Gravity::accumulate(r, r + stride, r + 2 * stride,
+			_bodies.gm(), 0, _nmassive, _tabulated.size(), stride,
+			ax, ay, az);
+	}
+
+	/**
+	 * Compute the accelerations of all objects using the worker pool.
+	 * The upper triangle of the massive-body pair matrix is cut into
+	 * tiles which are dealt round-robin to the threads; each thread
+	 * accumulates into a private buffer, so no two threads ever write
+	 * the same memory. The buffers are then summed in thread order.
+	 * Test particles are split into contiguous runs, one per thread,
+	 * and written directly. Because the tile assignment and reduction
+	 * order depend only on the thread count, results are bitwise
+	 * reproducible for a given number of threads
+	 *
+	 * @param[in]  r The x|y|z position columns
+	 * @param[out] a The x|y|z acceleration columns
+	 */
+	void EphemerisManager::_compute_accel_parallel(const double* r,
+		double* a)
+	{
+		const size_t n       = _bodies.size();
+		const size_t m       = _nmassive;
+		const size_t stride  = _bodies.stride();
+		const size_t nthread = _pool->size();
+
+		const size_t ntiles  = (m + tile_size - 1) / tile_size;
+
+		/*
+		 * Pairs of played back bodies are skipped
+		 */
+		const size_t first   = _tabulated.size();
+
+		if (_thread_accel.size() != 3 * stride * nthread)
+			_thread_accel.assign(3 * stride * nthread, 0.0);
+
+		const double* x  = r;
+		const double* y  = r + stride;
+		const double* z  = r + 2 * stride;
+		const double* gm = _bodies.gm();
+
+		_pool->run([&](size_t thread)
+		{
+			double* ax = &_thread_accel[3 * stride * thread];
+			double* ay = ax + stride;
+			double* az = ay + stride;
+
+			for (size_t i = 0; i < m; i++)
+				ax[i] = ay[i] = az[i] = 0.0;
+
+			size_t tile = 0;
+
+			for (size_t bi = 0; bi < ntiles; bi++)
+			{
+				for (size_t bj = bi; bj < ntiles; bj++, tile++)
+				{
+					if (tile % nthread != thread) continue;
+
+					const size_t i_end =
+						std::min(m, (bi + 1) * tile_size);
+					const size_t j_end =
+						std::min(m, (bj + 1) * tile_size);
+
+					if (j_end <= first) continue;
+
+					Gravity::accumulate_pairs(x, y, z, gm,
+						bi * tile_size, i_end,
+						bj * tile_size, j_end,
+						ax, ay, az);
+				}
+			}
+
+			const size_t chunk = (n - m + nthread - 1) / nthread;
+
+			const size_t begin = std::min(n, m + chunk * thread);
+			const size_t end   = std::min(n, begin + chunk);
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				for (size_t i = begin; i < end; i++)
+					a[k * stride + i] = 0.0;
+			}
+
+			Gravity::accumulate(x, y, z, gm, 0, m, begin, end,
+				a, a + stride, a + 2 * stride);
+		});
+
+		/*
+		 * Reduce the per-thread buffers. Each thread owns a slice of
+		 * the massive bodies, and sums buffers in thread order
+		 */
+		_pool->run([&](size_t thread)
+		{
+			const size_t chunk = (m + nthread - 1) / nthread;
+
+			const size_t begin = std::min(m, chunk * thread);
+			const size_t end   = std::min(m, begin + chunk);
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					double sum = 0.0;
+
+					for (size_t t = 0; t < nthread; t++)
+						sum += _thread_accel[(3 * t + k) * stride + i];
+
+					a[k * stride + i] = sum;
+				}
+			}
+		});
+	}
+
+	/**
+	 * Compute the accelerations of a contiguous range of bodies with
+	 * the direct kernel, splitting the range across the worker pool if
+	 * there is one
+	 *
+	 * @param[in]  r     The x|y|z position columns
+	 * @param[in]  begin The first body
+	 * @param[in]  end   One past the last body
+	 * @param[out] a     The x|y|z acceleration columns. Only entries
+	 *                   in [begin, end) are written
+	 */
+	void EphemerisManager::_compute_accel_range(const double* r,
+		size_t begin, size_t end, double* a)
+	{
+		if (begin == end) return;
+
+		const size_t stride  = _bodies.stride();
+		const size_t nthread = _pool ? _pool->size() : 1;
+
+		auto work = [&](size_t thread)
+		{
+			const size_t chunk = (end - begin + nthread - 1) / nthread;
+
+			const size_t i_begin = std::min(end, begin + chunk * thread);
+			const size_t i_end   = std::min(end, i_begin + chunk);
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				for (size_t i = i_begin; i < i_end; i++)
+					a[k * stride + i] = 0.0;
+			}
+
+			Gravity::accumulate(r, r + stride, r + 2 * stride,
+				_bodies.gm(), 0, _nmassive, i_begin, i_end,
+				a, a + stride, a + 2 * stride);
+		};
+
+		if (_pool)
+			_pool->run(work);
+		else
+			work(0);
+
+		if (!_harmonics.empty())
+			_add_harmonics(r, begin, end, a);
+
+		if (!_radiation.empty())
+			_radiation.accumulate(r, stride, begin, end, a);
+	}
+
+	/**
+	 * Compute the accelerations of all objects with the Barnes-Hut
+	 * tree. The tree is built over the massive bodies only and is
+	 * rebuilt from scratch on every call. Massive targets are walked in
+	 * Morton order so that consecutive traversals touch the same
+	 * cells; test particles follow in index order. With a worker
+	 * pool, each thread takes a contiguous run of each. Every body's
+	 * acceleration is computed independently, so the split does not
+	 * affect results
+	 *
+	 * @param[in]  r The x|y|z position columns
+	 * @param[out] a The x|y|z acceleration columns
+	 */
+	void EphemerisManager::_compute_accel_tree(const double* r, double* a)
+	{
+		const size_t n      = _bodies.size();
+		const size_t stride = _bodies.stride();
+
+		const double* x = r;
+		const double* y = r + stride;
+		const double* z = r + 2 * stride;
+
+		double* ax = a;
+		double* ay = a + stride;
+		double* az = a + 2 * stride;
+
+		_octree.build(x, y, z, _bodies.gm(), _nmassive);
+
+		/*
+		 * Massive targets in Morton order, less those played back
+		 */
+		_tree_targets.clear();
+
+		for (size_t i : _octree.order())
+		{
+			if (i >= _tabulated.size())
+				_tree_targets.push_back(i);
+		}
+
+		const size_t* order = _tree_targets.data();
+
+		const size_t nmassive = _tree_targets.size();
+		const size_t ntest    = n - _nmassive;
+
+		if (!_pool)
+		{
+			_octree.evaluate(x, y, z, order, nmassive, ax, ay, az);
+
+			_octree.evaluate(x + _nmassive, y + _nmassive, z + _nmassive,
+				nullptr, ntest,
+				ax + _nmassive, ay + _nmassive, az + _nmassive);
+			return;
+		}
+
+		const size_t nthread = _pool->size();
+
+		_pool->run([&](size_t thread)
+		{
+			size_t chunk = (nmassive + nthread - 1) / nthread;
+
+			size_t begin = std::min(nmassive, chunk * thread);
+			size_t end   = std::min(nmassive, begin + chunk);
+
+			_octree.evaluate(x, y, z, order + begin, end - begin,
+				ax, ay, az);
+
+			chunk = (ntest + nthread - 1) / nthread;
+
+			begin = _nmassive + std::min(ntest, chunk * thread);
+			end   = std::min(n, begin + chunk);
+
+			_octree.evaluate(x + begin, y + begin, z + begin,
+				nullptr, end - begin,
+				ax + begin, ay + begin, az + begin);
+		});
+	}
+
+	/**
+	 * Propagate with an adaptive embedded Runge-Kutta pair. The
+	 * integrator picks its own internal steps,
+	 * which may be shorter than the dispatch period during close
+	 * approaches and span the whole period during quiet coasts
+	 *
+	 * @param[in] t  The time at the start of the step, seconds
+	 * @param[in] dt The step size, seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_propagate_embedded(double t, double dt)
+	{
+		const size_t stride = _bodies.stride();
+
+		if (!_accel_valid)
+			_embedded.invalidate();
+
+		auto deriv = [this](double t, const double* x, double* dxdt) {
+			_derivative(t, x, dxdt);
+		};
+
+		AbortIfNot_2(_embedded.propagate(deriv, t, dt,
+			_state()), false);
+
+		const double* a = _embedded.derivative() + 3 * stride;
+
+		std::copy(a, a + 3 * stride, _bodies.ax());
+
+		_accel_valid = true;
+		return true;
+	}
+
+	/**
+	 * Propagate with the Gragg-Bulirsch-Stoer method, which picks its
+	 * own internal step size and order
+	 *
+	 * @param[in] t  The time at the start of the step, seconds
+	 * @param[in] dt The step size, seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_propagate_extrapolation(double t, double dt)
+	{
+		const size_t stride = _bodies.stride();
+
+		if (!_accel_valid)
+			_extrapolation.invalidate();
+
+		auto deriv = [this](double t, const double* x, double* dxdt) {
+			_derivative(t, x, dxdt);
+		};
+
+		AbortIfNot_2(_extrapolation.propagate(deriv, t, dt,
+			_state()), false);
+
+		const double* a = _extrapolation.derivative() + 3 * stride;
+
+		std::copy(a, a + 3 * stride, _bodies.ax());
+
+		_accel_valid = true;
+		return true;
+	}
+
+	/**
+	 * Propagate with multirate kick-drift-kick leapfrog. Each group of
+	 * bodies takes steps of its rate times the base step. Groups are
+	 * advanced from the slowest to the fastest whenever their current
+	 * step ends, so when a group steps, every slower group has already
+	 * stepped past it and supplies positions by quintic Hermite
+	 * interpolation. Faster groups have not yet moved, and their
+	 * positions are extrapolated from a second order Taylor series.
+	 * Between its step boundaries, a body's published state is
+	 * interpolated. Gravity always uses the direct kernel
+	 *
+	 * @param[in] t  The time at the start of the base step, seconds
+	 * @param[in] dt The base step size, seconds
+	 */
+	void EphemerisManager::_propagate_multirate(double t, double dt)
+	{
+		const size_t stride = _bodies.stride();
+
+		/*
+		 * After a change from outside, all groups restart together
+		 * from the current state
+		 */
+		if (!_accel_valid)
+		{
+			compute_accel();
+
+			std::copy(_bodies.x(), _bodies.x() + 10 * stride,
+				_step_end.x());
+
+			_phase = 0;
+		}
+
+		const double* now_r = _bodies.x();
+		const double* now_v = _bodies.vx();
+		const double* now_a = _bodies.ax();
+
+		double* begin_r = _step_begin.x();
+		double* begin_v = _step_begin.vx();
+		double* begin_a = _step_begin.ax();
+
+		double* end_r = _step_end.x();
+		double* end_v = _step_end.vx();
+		double* end_a = _step_end.ax();
+
+		for (const auto& group : _groups)
+		{
+			if (_phase % group.rate) continue;
+
+			const double h = dt * group.rate;
+
+			const size_t ranges[2][2] = {
+				{ group.massive_begin, group.massive_end },
+				{ group.test_begin,    group.test_end    }
+			};
+
+			/*
+			 * Start a new step from where the last one ended, then
+			 * kick and drift
+			 */
+			for (auto& range : ranges)
+			{
+				for (size_t k = 0; k < 3 * stride; k += stride)
+				{
+					for (size_t i = range[0]; i < range[1]; i++)
+					{
+						begin_r[k + i] = end_r[k + i];
+						begin_v[k + i] = end_v[k + i];
+						begin_a[k + i] = end_a[k + i];
+
+						end_v[k + i] += end_a[k + i] * h / 2;
+						end_r[k + i] += end_v[k + i] * h;
+					}
+				}
+			}
+
+			/*
+			 * Positions of all bodies at the end of the step
+			 */
+			for (const auto& other : _groups)
+			{
+				const size_t others[2][2] = {
+					{ other.massive_begin, other.massive_end },
+					{ other.test_begin,    other.test_end    }
+				};
+
+				const double theta = double(_phase % other.rate +
+					group.rate) / other.rate;
+
+				/*
+				 * Test particles of other groups are not sources
+				 */
+				const size_t nranges = other.rate == group.rate ? 2 : 1;
+
+				for (size_t j = 0; j < nranges; j++)
+				{
+					const size_t* range = others[j];
+
+					for (size_t k = 0; k < 3 * stride; k += stride)
+					{
+						for (size_t i = range[0]; i < range[1]; i++)
+						{
+							double& p = _predicted[k + i];
+
+							if (other.rate == group.rate)
+							{
+								p = end_r[k + i];
+							}
+							else if (other.rate > group.rate)
+							{
+								double v;
+								hermite5(theta, dt * other.rate,
+									begin_r[k + i], begin_v[k + i],
+									begin_a[k + i],
+									end_r[k + i], end_v[k + i],
+									end_a[k + i], p, v);
+							}
+							else
+							{
+								p = now_r[k + i] + now_v[k + i] * h +
+									now_a[k + i] * h * h / 2;
+							}
+						}
+					}
+				}
+			}
+
+			/*
+			 * Kick
+			 */
+			_accel_time = t + h;
+
+			for (auto& range : ranges)
+			{
+				_compute_accel_range(_predicted.data(), range[0],
+					range[1], end_a);
+
+				for (size_t k = 0; k < 3 * stride; k += stride)
+				{
+					for (size_t i = range[0]; i < range[1]; i++)
+						end_v[k + i] += end_a[k + i] * h / 2;
+				}
+			}
+		}
+
+		_phase++;
+
+		/*
+		 * Publish every body's state at the end of the base step
+		 */
+		double* r = _bodies.x();
+		double* v = _bodies.vx();
+		double* a = _bodies.ax();
+
+		for (const auto& group : _groups)
+		{
+			const size_t ranges[2][2] = {
+				{ group.massive_begin, group.massive_end },
+				{ group.test_begin,    group.test_end    }
+			};
+
+			const int64 local = _phase % group.rate;
+
+			const double theta = local ? double(local) / group.rate : 1.0;
+
+			for (auto& range : ranges)
+			{
+				for (size_t k = 0; k < 3 * stride; k += stride)
+				{
+					for (size_t i = range[0]; i < range[1]; i++)
+					{
+						if (local == 0)
+						{
+							r[k + i] = end_r[k + i];
+							v[k + i] = end_v[k + i];
+							a[k + i] = end_a[k + i];
+							continue;
+						}
+
+						hermite5(theta, dt * group.rate,
+							begin_r[k + i], begin_v[k + i],
+							begin_a[k + i],
+							end_r[k + i], end_v[k + i], end_a[k + i],
+							r[k + i], v[k + i]);
+
+						a[k + i] = begin_a[k + i] +
+							theta * (end_a[k + i] - begin_a[k + i]);
+					}
+				}
+			}
+		}
+
+		if (!_groups.empty() && _phase == _groups.front().rate)
+			_phase = 0;
+
+		_accel_valid = true;
+	}
+
+	/**
+	 * Propagate with the Adams-Bashforth-Moulton method. Until enough
+	 * history has been built up, which happens at startup and again
+	 * whenever the state was changed from outside (e.g. by a burn or
+	 * staging), steps are taken with the embedded Runge-Kutta
+	 * integrator instead
+	 *
+	 * @param[in] t  The time at the start of the step, seconds
+	 * @param[in] dt The step size, seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_propagate_multistep(double t, double dt)
+	{
+		const size_t stride = _bodies.stride();
+
+		double* x = _state();
+
+		auto deriv = [this](double t, const double* x, double* dxdt) {
+			_derivative(t, x, dxdt);
+		};
+
+		if (!_accel_valid)
+		{
+			_multistep.start(deriv, t, x);
+			_embedded.invalidate();
+		}
+
+		if (_multistep.ready())
+		{
+			_multistep.step(deriv, t, dt, x);
+		}
+		else
+		{
+			AbortIfNot_2(_embedded.propagate(deriv, t, dt, x), false);
+
+			_multistep.push(_embedded.derivative());
+		}
+
+		const double* a = _multistep.derivative() + 3 * stride;
+
+		std::copy(a, a + 3 * stride, _bodies.ax());
+
+		_accel_valid = true;
+		return true;
+	}
+
+	/**
+	 * Take a step under Parareal (see \ref set_parareal()), solving a
+	 * new window first if this step is not the next one recorded
+	 *
+	 * @param[in] t_now The current simulation time
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_propagate_parareal(int64 t_now)
+	{
+		const size_t n      = _bodies.size();
+		const size_t stride = _bodies.stride();
+
+		const int64 steps  = _parareal_steps;
+		const int64 window = steps * _parareal_slices.size() * _period;
+
+		/*
+		 * A change from outside invalidates the rest of the window
+		 */
+		if (!_accel_valid || t_now < _parareal_begin ||
+			t_now >= _parareal_begin + window)
+		{
+			auto coarse = [this](size_t, double t0, double t1,
+				double* x)
+			{
+				return _parareal_coarse(t0, t1, x);
+			};
+
+			auto fine = [this](size_t slice, double t0, double,
+				double* x)
+			{
+				return _parareal_fine(slice, t0, x);
+			};
+
+			_parareal_begin = t_now;
+
+			AbortIfNot_2(_parareal.solve(coarse, fine, t_now / 100.0,
+				(t_now + window) / 100.0, _bodies.state(), _pool.get()),
+				false);
+
+			if (Verbosity::level >= verbose)
+			{
+				std::printf("parareal: t = %g to %g s converged in %d "
+					"iterations\n", t_now / 100.0,
+					(t_now + window) / 100.0, _parareal.iterations());
+				std::fflush(stdout);
+			}
+		}
+
+		const int64 step = (t_now - _parareal_begin) / _period;
+
+		const double* state =
+			&_parareal_slices[step / steps].states[9 * n * (step % steps)];
+
+		double* x = _bodies.x();
+		double* a = _bodies.ax();
+
+		for (size_t c = 0; c < 6; c++)
+		{
+			for (size_t i = 0; i < n; i++)
+				x[c * stride + i] = state[c * n + i];
+		}
+
+		for (size_t c = 0; c < 3; c++)
+		{
+			for (size_t i = 0; i < n; i++)
+				a[c * stride + i] = state[(c + 6) * n + i];
+		}
+
+		_accel_valid = true;
+		return true;
+	}
+
+	/**
+	 * Coast every body through the patched-conic model, ignoring all
+	 * other perturbations. Massive bodies follow fixed conics about
+	 * their primaries, and test particles switch primaries as they
+	 * cross spheres of influence. Since no force evaluations are
+	 * needed, the step size is limited only by the telemetry rate.
+	 * The accelerations returned are those of the two-body motion
+	 *
+	 * @param[in] t  The time at the start of the step, seconds
+	 * @param[in] dt The step size, seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_propagate_kepler(double t, double dt)
+	{
+		if (!_patched_init)
+			AbortIfNot_2(_init_patched(t), false);
+
+		const size_t m = _nmassive;
+
+		double* r[3] = { _bodies.x(),  _bodies.y(),  _bodies.z() };
+		double* v[3] = { _bodies.vx(), _bodies.vy(), _bodies.vz() };
+		double* a[3] = { _bodies.ax(), _bodies.ay(), _bodies.az() };
+
+		/*
+		 * Test particles are picked up from their current states, so
+		 * that changes made elsewhere (e.g. burns) are honored
+		 */
+		for (size_t j = 0; j < _coasts.size(); j++)
+		{
+			PatchedConics::Coast& coast = _coasts[j];
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				coast.r[k] = r[k][m + j] - r[k][coast.primary];
+				coast.v[k] = v[k][m + j] - v[k][coast.primary];
+			}
+
+			coast.t = t;
+		}
+
+		AbortIfNot_2(_patched.body_states(t + dt, _bodies.x(),
+			_bodies.stride()), false);
+
+		for (size_t i = 0; i < m; i++)
+		{
+			for (size_t k = 0; k < 3; k++)
+				a[k][i] = 0.0;
+
+			for (size_t j = i; _patched.primary(j) != j;
+				j = _patched.primary(j))
+			{
+				const size_t p = _patched.primary(j);
+
+				const double rel[3] = {
+					r[0][j] - r[0][p], r[1][j] - r[1][p], r[2][j] - r[2][p]
+				};
+
+				const double d2 = rel[0] * rel[0] + rel[1] * rel[1] +
+					rel[2] * rel[2];
+
+				const double mu_r3 = (_patched.gm(j) + _patched.gm(p)) /
+					(d2 * std::sqrt(d2));
+
+				for (size_t k = 0; k < 3; k++)
+					a[k][i] -= mu_r3 * rel[k];
+			}
+		}
+
+		for (size_t j = 0; j < _coasts.size(); j++)
+		{
+			PatchedConics::Coast& coast = _coasts[j];
+
+			AbortIfNot_2(_patched.propagate(coast, t + dt), false);
+
+			const size_t p = coast.primary;
+
+			const double d2 = coast.r[0] * coast.r[0] +
+				coast.r[1] * coast.r[1] + coast.r[2] * coast.r[2];
+
+			const double mu_r3 = _patched.gm(p) / (d2 * std::sqrt(d2));
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				r[k][m + j] = r[k][p] + coast.r[k];
+				v[k][m + j] = v[k][p] + coast.v[k];
+				a[k][m + j] = a[k][p] - mu_r3 * coast.r[k];
+			}
+		}
+
+		_accel_valid = true;
+		return true;
+	}
+
+	/**
+	 * Propagate with explicit Euler
+	 *
+	 * @param[in] dt The step size, seconds
+	 */
+	void EphemerisManager::_propagate_euler(double dt)
+	{
+		compute_accel();
+
+		double* r[3] = { _bodies.x(),  _bodies.y(),  _bodies.z() };
+		double* v[3] = { _bodies.vx(), _bodies.vy(), _bodies.vz() };
+
+		const double* a[3] = { _bodies.ax(), _bodies.ay(), _bodies.az() };
+
+		for (int k = 0; k < 3; k++)
+		{
+			for (size_t i = 0; i < _bodies.size(); i++)
+			{
+				r[k][i] += v[k][i] * dt;
+				v[k][i] += a[k][i] * dt;
+			}
+		}
+
+		_accel_valid = false;
+	}
+
+	/**
+	 * Propagate with the classic 4th order Runge-Kutta method, which
+	 * operates on the whole x|y|z|vx|vy|vz block in one batch
+	 *
+	 * @param[in] t The time at the start of the step, seconds
+	 */
+	void EphemerisManager::_propagate_rk4(double t)
+	{
+		const size_t stride = _bodies.stride();
+
+		auto deriv = [this](double t, const double* x, double* dxdt) {
+			_derivative(t, x, dxdt);
+		};
+
+		_rk4.step(deriv, t, _state());
+
+		const double* a = _rk4.derivative() + 3 * stride;
+
+		std::copy(a, a + 3 * stride, _bodies.ax());
+
+		_accel_valid = false;
+	}
+
+	/**
+	 * Move the test particles over the step just taken by the massive
+	 * bodies, under the Sundman formulation. Each particle is
+	 * integrated relative to whichever massive body pulls hardest on
+	 * it at the start of the step, in the fictitious time s described
+	 * under \ref set_sundman_steps(), with the time carried as a
+	 * seventh state. The massive bodies, which the particles do not
+	 * disturb, are sampled from the dense output. Once another step
+	 * in s would pass the end of the step, the particle finishes with
+	 * a step in physical time, which is no longer than the step in s
+	 * would have been. Gravity always uses the direct kernel
+	 *
+	 * @param[in] t The time at the start of the step, seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_propagate_sundman(double t)
+	{
+		const size_t n      = _bodies.size();
+		const size_t m      = _nmassive;
+		const size_t stride = _bodies.stride();
+
+		const double t_end = t + _period / 100.0;
+		const double ds    = 2.0 * 3.14159265358979323846 / _sundman_steps;
+
+		/*
+		 * Guards against a particle falling into its primary, where
+		 * the steps in s shrink to nothing
+		 */
+		const size_t max_steps = 1000000;
+
+		const double* gm = _bodies.gm();
+
+		double* r = _bodies.x();
+		double* v = _bodies.vx();
+		double* a = _bodies.ax();
+
+		for (size_t i = m; i < n; i++)
+		{
+			if (_table && _ids[i].table_id >= 0) continue;
+
+			size_t p    = 0;
+			double pull = -1.0;
+
+			for (size_t j = 0; j < m; j++)
+			{
+				double rj[3], vj[3], aj[3];
+				_dense.evaluate(j, t, rj, vj, aj);
+
+				double d2 = 0.0;
+
+				for (size_t k = 0; k < 3; k++)
+				{
+					const double d = r[k * stride + i] - rj[k];
+					d2 += d * d;
+				}
+
+				if (gm[j] / d2 > pull)
+				{
+					pull = gm[j] / d2;
+					p    = j;
+				}
+			}
+
+			const double mu = gm[p];
+
+			/*
+			 * The relative position and velocity, and the time
+			 */
+			double y[7], accel[3];
+
+			AbortIfNot_2(_dense.relative(i, p, t, y, y + 3, accel), false);
+			y[6] = t;
+
+			auto rate = [mu](const double* rho) {
+				const double d = std::sqrt(rho[0] * rho[0] +
+					rho[1] * rho[1] + rho[2] * rho[2]);
+
+				return d * std::sqrt(d / mu);
+			};
+
+			auto deriv_s = [&](double, const double* x, double* dxds) {
+				const double g = rate(x);
+
+				_sundman_accel(i, p, x[6], x, dxds + 3);
+
+				for (size_t k = 0; k < 3; k++)
+				{
+					dxds[k]      = g * x[k + 3];
+					dxds[k + 3] *= g;
+				}
+
+				dxds[6] = g;
+			};
+
+			auto deriv_t = [&](double time, const double* x,
+				double* dxdt)
+			{
+				_sundman_accel(i, p, time, x, dxdt + 3);
+
+				for (size_t k = 0; k < 3; k++)
+					dxdt[k] = x[k + 3];
+
+				dxdt[6] = 1.0;
+			};
+
+			_sundman.set_step_size(ds);
+
+			for (size_t steps = 0;; steps++)
+			{
+				AbortIf(steps == max_steps, false,
+					"'%s' has fallen into '%s' at t = %g",
+					_ids[i].name.c_str(), _ids[p].name.c_str(), y[6]);
+
+				if (y[6] + rate(y) * ds >= t_end) break;
+
+				double before[7];
+				std::copy(y, y + 7, before);
+
+				_sundman.step(deriv_s, 0.0, y);
+
+				/*
+				 * The step lengthened on the way out, overshooting
+				 */
+				if (y[6] > t_end)
+				{
+					std::copy(before, before + 7, y);
+					break;
+				}
+			}
+
+			if (y[6] < t_end)
+			{
+				_sundman.set_step_size(t_end - y[6]);
+				_sundman.step(deriv_t, y[6], y);
+			}
+
+			_sundman_accel(i, p, t_end, y, accel);
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				r[k * stride + i] = r[k * stride + p] + y[k];
+				v[k * stride + i] = v[k * stride + p] + y[k + 3];
+				a[k * stride + i] = a[k * stride + p] + accel[k];
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Propagate with one of the symplectic integrators
+	 *
+	 * @param[in] t  The time at the start of the step, seconds
+	 * @param[in] dt The step size, seconds
+	 */
+	void EphemerisManager::_propagate_symplectic(double t, double dt)
+	{
+		/*
+		 * The symplectic methods reuse the accelerations left over
+		 * from the previous step, which are only recomputed if the
+		 * state was changed from outside
+		 */
+		if (!_accel_valid)
+			compute_accel();
+
+		auto accel = [this](double t, const double* r, double* a) {
+			_accel_time = t;
+			compute_accel(r, a);
+
+			if (_table) _play_back(t, nullptr, nullptr, a);
+		};
+
+		/*
+		 * The x|y|z and vx|vy|vz columns are each contiguous, so the
+		 * integrators can treat them as flat arrays
+		 */
+		const size_t n = 3 * _bodies.stride();
+
+		if (_integrator == Integrator::leapfrog)
+		{
+			Leapfrog::step(accel, t, dt, n,
+				_bodies.x(), _bodies.vx(), _bodies.ax());
+		}
+		else
+		{
+			Yoshida4::step(accel, t, dt, n,
+				_bodies.x(), _bodies.vx(), _bodies.ax());
+		}
+
+		_accel_valid = true;
+	}
+
+	/**
+	 * Compute the time derivative of the contiguous x|y|z|vx|vy|vz
+	 * state block, which is vx|vy|vz|ax|ay|az. Bodies played back from
+	 * a Chebyshev ephemeris take their velocities and accelerations
+	 * from the table, so the integrators merely reproduce their
+	 * tabulated trajectories
+	 *
+	 * @param[in]  t    The time, seconds
+	 * @param[in]  x    The state
+	 * @param[out] dxdt The derivative of the state
+	 */
+	void EphemerisManager::_derivative(double t, const double* x,
+		double* dxdt)
+	{
+		const size_t stride = _bodies.stride();
+
+		const double* v = x + 3 * stride;
+
+		for (size_t i = 0; i < 3 * stride; i++)
+			dxdt[i] = v[i];
+
+		_accel_time = t;
+
+		if (_formulation != Formulation::encke)
+		{
+			compute_accel(x, dxdt + 3 * stride);
+
+			if (_table)
+				_play_back(t, nullptr, dxdt, dxdt + 3 * stride);
+
+			/*
+			 * Under the Sundman formulation, test particles stay put
+			 * until \ref _propagate_sundman() moves them. With zero
+			 * derivatives, every integrator leaves them exactly where
+			 * they were
+			 */
+			if (_formulation == Formulation::sundman)
+			{
+				for (size_t k = 0; k < 6 * stride; k += stride)
+				{
+					for (size_t i = _nmassive; i < _bodies.size(); i++)
+						dxdt[k + i] = 0.0;
+				}
+			}
+
+			if (_stm)
+				_variational_derivative(x, dxdt);
+
+			return;
+		}
+
+		/*
+		 * Under the Encke formulation, test particles carry their
+		 * deviations from their reference conics. Rebuild absolute
+		 * positions to compute gravity
+		 */
+		const size_t n = _bodies.size();
+		const size_t m = _nmassive;
+
+		/*
+		 * The integrators cannot be told of a failure, so it is
+		 * reported by \ref _from_deviations() at the end of the step
+		 */
+		if (!_conic_at(t))
+			_conic_failed = true;
+
+		for (size_t k = 0; k < 3 * stride; k += stride)
+		{
+			for (size_t i = 0; i < m; i++)
+				_absolute[k + i] = x[k + i];
+
+			for (size_t i = m; i < n; i++)
+			{
+				const size_t p = _references[i - m].primary;
+
+				_absolute[k + i] = x[k + p] + _conic[k + i] + x[k + i];
+			}
+
+			for (size_t i = n; i < stride; i++)
+				_absolute[k + i] = x[k + i];
+		}
+
+		double* a = dxdt + 3 * stride;
+
+		compute_accel(_absolute.data(), a);
+
+		if (_table)
+			_play_back(t, nullptr, dxdt, a);
+
+		/*
+		 * The deviation obeys d^2(delta)/dt^2 =
+		 * mu / rho_ref^3 * (f(q) * rho - delta) + a_pert, where rho
+		 * and rho_ref are the actual and reference positions relative
+		 * to the primary. f(q) = 1 - (rho_ref / rho)^3 is evaluated in
+		 * a form which does not lose precision as delta vanishes (see
+		 * R. H. Battin, "An Introduction to the Mathematics and
+		 * Methods of Astrodynamics", section 9.3)
+		 */
+		const double* gm = _bodies.gm();
+
+		for (size_t i = m; i < n; i++)
+		{
+			const size_t p  = _references[i - m].primary;
+			const double mu = gm[p];
+
+			double delta[3], rho[3], rho_ref[3];
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				delta[k]   = x[k * stride + i];
+				rho_ref[k] = _conic[k * stride + i];
+				rho[k]     = rho_ref[k] + delta[k];
+			}
+
+			const double rho_sq = rho[0] * rho[0] + rho[1] * rho[1] +
+				rho[2] * rho[2];
+
+			const double ref_sq = rho_ref[0] * rho_ref[0] +
+				rho_ref[1] * rho_ref[1] + rho_ref[2] * rho_ref[2];
+
+			const double q = (delta[0] * (delta[0] - 2.0 * rho[0]) +
+				delta[1] * (delta[1] - 2.0 * rho[1]) +
+				delta[2] * (delta[2] - 2.0 * rho[2])) / rho_sq;
+
+			const double f = -q * (3.0 + 3.0 * q + q * q) /
+				(1.0 + std::pow(1.0 + q, 1.5));
+
+			const double mu_ref = mu / (ref_sq * std::sqrt(ref_sq));
+			const double mu_rho = mu / (rho_sq * std::sqrt(rho_sq));
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				double& ai = a[k * stride + i];
+
+				const double a_pert = ai - a[k * stride + p] +
+					mu_rho * rho[k];
+
+				ai = mu_ref * (f * rho[k] - delta[k]) + a_pert;
+			}
+		}
+	}
+
+	/**
+	 * Replace the deviations carried by test particles under the
+	 * Encke formulation with their absolute states. The accelerations
+	 * are converted too; they refer to the start of the step for RK4
+	 * and to the end of the step otherwise
+	 *
+	 * @param[in] t The time at the start of the step, seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_from_deviations(double t)
+	{
+		AbortIf(_conic_failed, false, "a reference conic failed to "
+			"converge during the step from t = %g", t);
+
+		const size_t n      = _bodies.size();
+		const size_t m      = _nmassive;
+		const size_t stride = _bodies.stride();
+
+		double* r = _bodies.x();
+		double* v = _bodies.vx();
+		double* a = _bodies.ax();
+
+		const double* gm = _bodies.gm();
+
+		const double t_end = t + _period / 100.0;
+
+		/*
+		 * d^2(rho_ref)/dt^2 is the two-body acceleration
+		 */
+		AbortIfNot_2(_conic_at(_integrator == Integrator::rk4 ?
+			t : t_end), false);
+
+		for (size_t i = m; i < n; i++)
+		{
+			const size_t p = _references[i - m].primary;
+
+			const double* rho = &_conic[i];
+
+			const double rho_sq = rho[0] * rho[0] +
+				rho[stride] * rho[stride] +
+				rho[2 * stride] * rho[2 * stride];
+
+			const double mu_ref = gm[p] / (rho_sq * std::sqrt(rho_sq));
+
+			for (size_t k = 0; k < 3 * stride; k += stride)
+				a[k + i] += a[k + p] - mu_ref * _conic[k + i];
+		}
+
+		if (_integrator == Integrator::rk4)
+			AbortIfNot_2(_conic_at(t_end), false);
+
+		for (size_t i = m; i < n; i++)
+		{
+			const size_t p = _references[i - m].primary;
+
+			for (size_t k = 0; k < 3 * stride; k += stride)
+			{
+				r[k + i] += r[k + p] + _conic[k + i];
+				v[k + i] += v[k + p] + _conic[3 * stride + k + i];
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Match bodies against the Chebyshev ephemeris being played back,
+	 * or set up sampling of the one being recorded
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_init_chebyshev()
+	{
+		_tabulated.clear();
+
+		if (_table)
+		{
+			AbortIf(!_fit_path.empty(), false,
+				"cannot record and play back a Chebyshev ephemeris "
+				"at the same time");
+
+			for (size_t i = 0; i < _nmassive; i++)
+			{
+				_ids[i].table_id = _table->find(_ids[i].name);
+
+				if (_ids[i].table_id >= 0)
+					_tabulated.push_back(i);
+			}
+
+			AbortIf(!_tabulated.empty() &&
+				(_integrator == Integrator::multirate ||
+				 _integrator == Integrator::kepler), false,
+				"the %s integrator cannot play back a Chebyshev "
+				"ephemeris", _integrator == Integrator::kepler ?
+				"kepler" : "multirate");
+
+			if (Verbosity::level >= verbose)
+			{
+				std::printf("playing back %zu of %zu bodies from a "
+					"Chebyshev ephemeris\n", _tabulated.size(),
+					_table->size());
+				std::fflush(stdout);
+			}
+		}
+
+		if (_fit_path.empty()) return true;
+
+		const int64 ticks = std::llround(_fit_interval * 100);
+
+		AbortIf(ticks % _period ||
+			std::abs(_fit_interval * 100 - ticks) > 1e-6, false,
+			"Chebyshev interval %g is not a multiple of the "
+			"ephemeris step", _fit_interval);
+
+		/*
+		 * Aim for four samples per coefficient, on step boundaries
+		 * which divide the record evenly
+		 */
+		const int64 steps = ticks / _period;
+
+		int64 skip = std::max<int64>(1, steps / (4 * _fit_ncoeff));
+
+		while (steps % skip) skip--;
+
+		_fit_period = skip * _period;
+
+		std::vector<std::string> names;
+
+		for (size_t i = 0; i < _nmassive; i++)
+			names.push_back(_ids[i].name);
+
+		AbortIfNot_2(_fitter.init(names, _fit_ncoeff, _fit_interval,
+			steps / skip), false);
+
+		return true;
+	}
+
+	/**
+	 * Create the perturbed copies of a test particle requested by
+	 * \ref set_ensemble(), and list them right after it
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_init_ensemble()
+	{
+		if (_ensemble.count == 0)
+			return true;
+
+		auto iter = std::find_if(_ids.begin(), _ids.end(),
+			[this](const SharedIDs& ids) {
+				return ids.name == _ensemble.body;
+			});
+
+		AbortIf(iter == _ids.end(), false,
+			"unknown body '%s' in ensemble", _ensemble.body.c_str());
+
+		const SharedIDs nominal = *iter;
+
+		const EphemerisObject object =
+			_subdir->load<EphemerisObject>(nominal.object_id);
+
+		AbortIf(object.massive, false, "ensemble body '%s' must be "
+			"massless", _ensemble.body.c_str());
+
+		std::mt19937 engine(_ensemble.seed);
+		std::normal_distribution<double> normal;
+
+		std::vector<SharedIDs> copies;
+
+		for (int k = 1; k <= _ensemble.count; k++)
+		{
+			const std::string name =
+				nominal.name + "." + std::to_string(k);
+
+			auto dir = _subdir->subdir(name);
+			AbortIfNot_2(dir, false);
+
+			SharedIDs ids(nominal);
+			ids.name      = name;
+			ids.object_id = dir->create_element<EphemerisObject>(
+				"internal");
+
+			AbortIf(ids.object_id < 0, false,
+				"unable to create ensemble body '%s'", name.c_str());
+
+			auto& copy = dir->load<EphemerisObject>(ids.object_id);
+
+			copy      = object;
+			copy.name = name;
+
+			for (int i = 0; i < 6; i++)
+			{
+				copy.rv_eci(i) += normal(engine) *
+					(i < 3 ? _ensemble.sigma_r : _ensemble.sigma_v);
+			}
+
+			copies.push_back(ids);
+		}
+
+		_ids.insert(iter + 1, copies.begin(), copies.end());
+
+		return true;
+	}
+
+	/**
+	 * Register the events read from the events config file. Each
+	 * crossing is logged with the range and speed relative to the
+	 * reference body
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_init_events()
+	{
+		for (const auto& event : _events)
+		{
+			const int i = find(event.body);
+			AbortIf(i < 0, false, "unknown body '%s' in event '%s'",
+				event.body.c_str(), event.name.c_str());
+
+			size_t j = EventLocator::inertial;
+
+			if (!event.reference.empty())
+			{
+				const int k = find(event.reference);
+				AbortIf(k < 0, false, "unknown body '%s' in event '%s'",
+					event.reference.c_str(), event.name.c_str());
+
+				j = k;
+			}
+
+			const std::string name = event.name;
+
+			auto log = [name](size_t, double t, const double* r,
+				const double* v)
+			{
+				if (Verbosity::level < terse) return;
+
+				std::printf("%s: t = %.6f s, range %.3f km, speed %.3f "
+					"m/s\n", name.c_str(), t,
+					std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2])
+						/ 1.0e3,
+					std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]));
+				std::fflush(stdout);
+			};
+
+			_locator.add(i, j, event.function, event.direction,
+				event.hysteresis, log);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Build the multirate groups from the rates of the (already
+	 * sorted) bodies. Rates must divide one another so that the steps
+	 * of slower groups always end on step boundaries of faster ones
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_init_groups()
+	{
+		_groups.clear();
+
+		for (size_t i = 0; i < _ids.size(); i++)
+		{
+			const int rate = _ids[i].rate;
+
+			auto iter = std::find_if(_groups.begin(), _groups.end(),
+				[rate](const RateGroup& group) {
+					return group.rate == rate;
+				});
+
+			if (iter == _groups.end())
+			{
+				RateGroup group;
+				group.rate = rate;
+				group.massive_begin = group.massive_end = _nmassive;
+				group.test_begin    = group.test_end    = _ids.size();
+
+				_groups.push_back(group);
+				iter = _groups.end() - 1;
+			}
+
+			if (i < _nmassive)
+			{
+				if (iter->massive_begin == _nmassive)
+					iter->massive_begin = i;
+				iter->massive_end = i + 1;
+			}
+			else
+			{
+				if (iter->test_begin == _ids.size())
+					iter->test_begin = i;
+				iter->test_end = i + 1;
+			}
+		}
+
+		std::sort(_groups.begin(), _groups.end(),
+			[](const RateGroup& a, const RateGroup& b) {
+				return a.rate > b.rate;
+			});
+
+		for (size_t i = 1; i < _groups.size(); i++)
+		{
+			AbortIf(_groups[i - 1].rate % _groups[i].rate, false,
+				"rate %d is not a multiple of rate %d",
+				_groups[i - 1].rate, _groups[i].rate);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Match the spherical-harmonic fields to their bodies, and map or
+	 * build their grids
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_init_harmonics()
+	{
+		AbortIf(!_harmonics.empty() && _integrator == Integrator::kepler,
+			false, "the kepler integrator does not support spherical "
+			"harmonics");
+
+		for (auto& field : _harmonics)
+		{
+			auto iter = std::find_if(_ids.begin(),
+				_ids.begin() + _nmassive, [&](const SharedIDs& ids) {
+					return ids.name == field.name;
+				});
+
+			AbortIf(iter == _ids.begin() + _nmassive, false,
+				"'%s' is not a massive body", field.name.c_str());
+
+			field.body = iter - _ids.begin();
+
+			AbortIfNot_2(field.field->set_threads(
+				_pool ? _pool->size() : 1), false);
+
+			if (Verbosity::level >= verbose)
+			{
+				std::printf("%s: spherical harmonics to degree %zu\n",
+					field.name.c_str(), field.field->degree());
+				std::fflush(stdout);
+			}
+
+			if (!field.grid ||
+				(field.grid->matches(field.grid_path) &&
+				 field.grid->open(field.grid_path)))
+			{
+				continue;
+			}
+
+			if (Verbosity::level >= verbose)
+			{
+				std::printf("%s: building a gravity grid of %zu nodes\n",
+					field.name.c_str(), field.grid->nodes());
+				std::fflush(stdout);
+			}
+
+			AbortIfNot_2(field.grid->build(_pool.get()), false);
+			AbortIfNot_2(field.grid->write(field.grid_path), false);
+			AbortIfNot_2(field.grid->open(field.grid_path), false);
+		}
+
+		_harmonic_accel.assign(3 * _bodies.stride(), 0.0);
+
+		return true;
+	}
+
+	/**
+	 * Check that Parareal can be used with the other settings, and set
+	 * up the slices of its windows
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_init_parareal()
+	{
+		_parareal_slices.clear();
+
+		if (_parareal_count == 0) return true;
+
+		AbortIf(_stm, false, "Parareal cannot be used with the state "
+			"transition matrix");
+
+		AbortIf(_integrator != Integrator::rk4    &&
+			_integrator != Integrator::dopri5 &&
+			_integrator != Integrator::rkf78  &&
+			_integrator != Integrator::gbs, false,
+			"Parareal requires rk4, dopri5, rkf78 or gbs");
+
+		AbortIf(_solver != Solver::direct, false,
+			"Parareal requires the direct solver");
+
+		AbortIf(_formulation != Formulation::cowell, false,
+			"Parareal requires the Cowell formulation");
+
+		AbortIf(!_harmonics.empty() || !_radiation_config.empty() ||
+			_table, false, "Parareal cannot be used with spherical "
+			"harmonics, radiation pressure or a Chebyshev ephemeris");
+
+		const size_t count = _parareal_count;
+
+		_parareal_steps = std::max(int64(1), int64(std::ceil(
+			_parareal_span * 100.0 / (_period * count))));
+
+		const size_t size = 6 * _bodies.stride();
+
+		AbortIfNot_2(_parareal.resize(size, count), false);
+
+		for (size_t k = 0; k < count; k++)
+		{
+			_parareal_slices.push_back(
+				PararealSlice(_embedded, _extrapolation, _rk4));
+
+			_parareal_slices.back().derivative.assign(size, 0.0);
+			_parareal_slices.back().states.assign(
+				9 * _bodies.size() * _parareal_steps, 0.0);
+		}
+
+		_rk4.set_step_size(_parareal_coarse_step);
+
+		if (Verbosity::level >= verbose)
+		{
+			std::printf("parareal: windows of %lld steps in %zu slices\n",
+				static_cast<long long>(_parareal_steps * count), count);
+			std::fflush(stdout);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Set up the patched-conic model from the current states of the
+	 * massive bodies, and place each test particle in the sphere of
+	 * influence containing it
+	 *
+	 * @param[in] t The current time, seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_init_patched(double t)
+	{
+		const size_t m = _nmassive;
+
+		const double* x  = _bodies.x();
+		const size_t  stride = _bodies.stride();
+
+		std::vector<std::string> names(m);
+		std::vector<double> gm(m), states(6 * m);
+
+		for (size_t i = 0; i < m; i++)
+		{
+			names[i] = _ids[i].name;
+			gm[i]    = _bodies.gm()[i];
+
+			for (size_t k = 0; k < 6; k++)
+				states[6 * i + k] = x[k * stride + i];
+		}
+
+		AbortIfNot_2(_patched.init(names, gm, states, t), false);
+
+		_coasts.resize(_bodies.size() - m);
+
+		for (size_t j = 0; j < _coasts.size(); j++)
+		{
+			const double r[3] = {
+				x[m + j], x[stride + m + j], x[2 * stride + m + j]
+			};
+
+			const double v[3] = {
+				x[3 * stride + m + j], x[4 * stride + m + j],
+				x[5 * stride + m + j]
+			};
+
+			AbortIfNot_2(_patched.start(t, r, v, _coasts[j]), false);
+		}
+
+		_patched_init = true;
+
+		if (Verbosity::level >= verbose)
+		{
+			for (size_t i = 0; i < m; i++)
+			{
+				if (_patched.primary(i) == i) continue;
+
+				std::printf("kepler: %s orbits %s\n",
+					_ids[i].name.c_str(),
+					_ids[_patched.primary(i)].name.c_str());
+			}
+
+			std::fflush(stdout);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Register the bodies read from the radiation pressure config file
+	 * with \ref _radiation. The Sun and occulters must be massive, so
+	 * their positions are known wherever accelerations are computed.
+	 * Perturbed copies of a spacecraft (see \ref set_ensemble()) feel
+	 * radiation pressure as it does
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_init_radiation()
+	{
+		if (_radiation_config.empty())
+			return true;
+
+		AbortIf(_integrator == Integrator::kepler, false,
+			"the kepler integrator does not support radiation pressure");
+
+		int sun = -1;
+
+		for (const auto& entry : _radiation_config)
+		{
+			const int i = find(entry.name);
+			AbortIf(i < 0, false, "unknown body '%s' in radiation "
+				"pressure config", entry.name.c_str());
+
+			if (entry.radius == 0.0)
+				continue;
+
+			AbortIf(size_t(i) >= _nmassive, false,
+				"'%s' is not a massive body", entry.name.c_str());
+
+			if (entry.sun)
+			{
+				AbortIf(sun >= 0, false,
+					"duplicate Sun in radiation pressure config");
+
+				AbortIfNot_2(_radiation.set_sun(i, entry.radius), false);
+				sun = i;
+			}
+			else
+			{
+				AbortIfNot_2(_radiation.add_occulter(i, entry.radius),
+					false);
+			}
+		}
+
+		AbortIf(sun < 0, false, "no Sun in radiation pressure config");
+
+		for (const auto& entry : _radiation_config)
+		{
+			if (entry.radius > 0.0)
+				continue;
+
+			const int i = find(entry.name);
+
+			AbortIf(i == sun, false,
+				"the Sun cannot feel radiation pressure");
+
+			for (size_t j = 0; j < _ids.size(); j++)
+			{
+				const std::string& name = _ids[j].name;
+
+				const bool copy = _ensemble.count > 0 &&
+					entry.name == _ensemble.body &&
+					name.compare(0, entry.name.size() + 1,
+						entry.name + ".") == 0;
+
+				if (j == size_t(i) || copy)
+				{
+					AbortIfNot_2(_radiation.add_spacecraft(j,
+						entry.area_to_mass, entry.reflectivity), false);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Initialize telemetry outputs
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_init_telemetry()
+	{
+		for (auto iter = _ids.begin(), end = _ids.end();
+			iter != end; ++iter)
+		{
+			iter->telemetry = _subdir->subdir(iter->name)->subdir("telemetry");
+			AbortIfNot_2(iter->telemetry, false);
+
+			int id = iter->telemetry->create_element<double>("a_eci.0");
+			iter->a_eci_id[0] = id;
+
+			id = iter->telemetry->create_element<double>("a_eci.1");
+			iter->a_eci_id[1] = id;
+
+			id = iter->telemetry->create_element<double>("a_eci.2");
+			iter->a_eci_id[2] = id;
+
+			id = iter->telemetry->create_element<double>("r_eci.0");
+			iter->r_eci_id[0] = id;
+
+			id = iter->telemetry->create_element<double>("r_eci.1");
+			iter->r_eci_id[1] = id;
+
+			id = iter->telemetry->create_element<double>("r_eci.2");
+			iter->r_eci_id[2] = id;
+
+			id = iter->telemetry->create_element<double>("v_eci.0");
+			iter->v_eci_id[0] = id;
+
+			id = iter->telemetry->create_element<double>("v_eci.1");
+			iter->v_eci_id[1] = id;
+
+			id = iter->telemetry->create_element<double>("v_eci.2");
+			iter->v_eci_id[2] = id;
+
+			for (int i = 0; i <= 2; i++)
+			{
+				AbortIf_2(iter->a_eci_id[i] < 0, false);
+				AbortIf_2(iter->r_eci_id[i] < 0, false);
+				AbortIf_2(iter->v_eci_id[i] < 0, false);
+			}
+
+			if (_solver == Solver::culled)
+			{
+				id = iter->telemetry->create_element<double>(
+					"a_cull_error");
+				iter->a_cull_error_id = id;
+
+				id = iter->telemetry->create_element<double>(
+					"v_cull_error");
+				iter->v_cull_error_id = id;
+
+				AbortIf_2(iter->a_cull_error_id < 0, false);
+				AbortIf_2(iter->v_cull_error_id < 0, false);
+			}
+		}
+
+		AbortIfNot_2(_update_telemetry(0.0), false);
+
+		return true;
+	}
+
+	/**
+	 * Gather the positions, velocities and masses of all objects into
+	 * the structure-of-arrays block. Invalidates the cached
+	 * accelerations if any of them changed since the last step
+	 */
+	void EphemerisManager::_load_bodies()
+	{
+		double* x  = _bodies.x();
+		double* y  = _bodies.y();
+		double* z  = _bodies.z();
+		double* vx = _bodies.vx();
+		double* vy = _bodies.vy();
+		double* vz = _bodies.vz();
+		double* gm = _bodies.gm();
+
+		for (size_t i = 0; i < _ids.size(); i++)
+		{
+			const auto& object =
+				_subdir->load<EphemerisObject>(_ids[i].object_id);
+
+			/*
+			 * The block still holds what we stored last step, so any
+			 * difference means the state was changed elsewhere (e.g.
+			 * by a burn) and cached accelerations are stale
+			 */
+			if (x[i]  != object.rv_eci(0) || y[i]  != object.rv_eci(1) ||
+				z[i]  != object.rv_eci(2) || vx[i] != object.rv_eci(3) ||
+				vy[i] != object.rv_eci(4) || vz[i] != object.rv_eci(5) ||
+				gm[i] != G * object.mass)
+			{
+				_accel_valid = false;
+				_perturbers.invalidate();
+			}
+
+			x[i]  = object.rv_eci(0);
+			y[i]  = object.rv_eci(1);
+			z[i]  = object.rv_eci(2);
+			vx[i] = object.rv_eci(3);
+			vy[i] = object.rv_eci(4);
+			vz[i] = object.rv_eci(5);
+
+			gm[i] = G * object.mass;
+		}
+	}
+
+	/**
+	 * Propagate the reference conic of every test particle to the
+	 * given time, storing the results in \ref _conic. The conics are
+	 * solved together in one batch
+	 *
+	 * @param[in] t The time, seconds
+	 *
+	 * @return True if the Kepler solve converged for every conic
+	 */
+	bool EphemerisManager::_conic_at(double t)
+	{
+		const size_t m      = _nmassive;
+		const size_t stride = _bodies.stride();
+
+		const double* gm = _bodies.gm();
+
+		for (size_t j = 0; j < _references.size(); j++)
+		{
+			const ReferenceConic& conic = _references[j];
+
+			/*
+			 * Conics not yet set up get a trivial orbit so they
+			 * converge at once; their results are never read
+			 */
+			if (!conic.valid)
+			{
+				for (size_t k = 0; k < 6; k++)
+					_conic[k * stride + m + j] = k == 0 || k == 4;
+
+				_kepler_dt[m + j] = 0.0;
+				_kepler_mu[m + j] = 1.0;
+				continue;
+			}
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				_conic[k * stride + m + j]       = conic.r0[k];
+				_conic[(k + 3) * stride + m + j] = conic.v0[k];
+			}
+
+			_kepler_dt[m + j] = t - conic.t0;
+			_kepler_mu[m + j] = gm[conic.primary];
+		}
+
+		const size_t failed = _kepler.propagate(_references.size(),
+			stride, _kepler_mu.data() + m, _kepler_dt.data() + m,
+			_conic.data() + m);
+
+		AbortIf(failed > 0, false, "Kepler's equation did not converge "
+			"for %zu reference conics at t = %g", failed, t);
+
+		return true;
+	}
+
+	/**
+	 * The coarse Parareal propagator: RK4 with even steps no longer
+	 * than the coarse step size
+	 *
+	 * @param[in]     t0 The start time, seconds
+	 * @param[in]     t1 The end time, seconds
+	 * @param[in,out] x  The x|y|z|vx|vy|vz state block
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_parareal_coarse(double t0, double t1,
+		double* x)
+	{
+		const double steps =
+			std::max(1.0, std::ceil((t1 - t0) / _parareal_coarse_step));
+
+		auto deriv = [this](double, const double* x, double* dxdt) {
+			_parareal_derivative(x, dxdt);
+		};
+
+		_rk4.set_step_size((t1 - t0) / steps);
+		_rk4.propagate(deriv, t0, size_t(steps), x);
+
+		return true;
+	}
+
+	/**
+	 * Compute the time derivative of the state block under Parareal,
+	 * which may be done on any number of threads at once
+	 *
+	 * @param[in]  x    The state
+	 * @param[out] dxdt The derivative of the state
+	 */
+	void EphemerisManager::_parareal_derivative(const double* x,
+		double* dxdt)
+	{
+		const size_t stride = _bodies.stride();
+
+		std::copy(x + 3 * stride, x + 6 * stride, dxdt);
+
+		_compute_accel_direct(x, dxdt + 3 * stride);
+
+		for (size_t k = 3 * stride; k < 6 * stride; k += stride)
+		{
+			for (size_t i = _bodies.size(); i < stride; i++)
+				dxdt[k + i] = 0.0;
+		}
+	}
+
+	/**
+	 * The fine Parareal propagator: the selected integrator over the
+	 * steps of one slice, recording the state after each
+	 *
+	 * @param[in]     slice The index of the slice
+	 * @param[in]     t0    The start time, seconds
+	 * @param[in,out] x     The x|y|z|vx|vy|vz state block
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_parareal_fine(size_t slice, double t0,
+		double* x)
+	{
+		const size_t n      = _bodies.size();
+		const size_t stride = _bodies.stride();
+
+		const double dt = _period / 100.0;
+
+		PararealSlice& work = _parareal_slices[slice];
+
+		auto deriv = [this](double, const double* x, double* dxdt) {
+			_parareal_derivative(x, dxdt);
+		};
+
+		/*
+		 * Stores the accelerations ending step s
+		 */
+		auto record_accel = [&](int64 s, const double* a) {
+			double* state = &work.states[9 * n * s];
+
+			for (size_t c = 0; c < 3; c++)
+			{
+				for (size_t i = 0; i < n; i++)
+					state[(c + 6) * n + i] = a[c * stride + i];
+			}
+		};
+
+		work.embedded.invalidate();
+		work.extrapolation.invalidate();
+		work.rk4.set_step_size(dt);
+
+		for (int64 s = 0; s < _parareal_steps; s++)
+		{
+			const double t = t0 + s * dt;
+
+			switch (_integrator)
+			{
+			case Integrator::rk4:
+				work.rk4.step(deriv, t, x);
+
+				/*
+				 * RK4 returns the derivative at the start of the
+				 * step, i.e. at the end of the previous one
+				 */
+				if (s > 0)
+					record_accel(s - 1, work.rk4.derivative() + 3 * stride);
+				break;
+			case Integrator::gbs:
+				AbortIfNot(work.extrapolation.propagate(deriv, t, dt, x),
+					false, "step size underflow at t = %g", t);
+
+				record_accel(s, work.extrapolation.derivative() +
+					3 * stride);
+				break;
+			default:
+				AbortIfNot(work.embedded.propagate(deriv, t, dt, x),
+					false, "step size underflow at t = %g", t);
+
+				record_accel(s, work.embedded.derivative() + 3 * stride);
+			}
+
+			double* state = &work.states[9 * n * s];
+
+			for (size_t c = 0; c < 6; c++)
+			{
+				for (size_t i = 0; i < n; i++)
+					state[c * n + i] = x[c * stride + i];
+			}
+		}
+
+		if (_integrator == Integrator::rk4)
+		{
+			_parareal_derivative(x, work.derivative.data());
+
+			record_accel(_parareal_steps - 1,
+				work.derivative.data() + 3 * stride);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Evaluate the bodies played back from the Chebyshev ephemeris and
+	 * overwrite their entries in the given columns. Entries are left
+	 * alone at times the ephemeris does not cover, which only happens
+	 * when a substep overshoots the end of the last record
+	 *
+	 * @param[in]  t The time, seconds
+	 * @param[out] r The x|y|z position columns, or null
+	 * @param[out] v The x|y|z velocity columns, or null
+	 * @param[out] a The x|y|z acceleration columns, or null
+	 */
+	void EphemerisManager::_play_back(double t, double* r, double* v,
+		double* a)
+	{
+		const size_t stride = _bodies.stride();
+
+		for (size_t i : _tabulated)
+		{
+			double rt[3], vt[3], at[3];
+
+			if (!_table->evaluate(_ids[i].table_id, t, rt, vt, at))
+				continue;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				if (r) r[k * stride + i] = rt[k];
+				if (v) v[k * stride + i] = vt[k];
+				if (a) a[k * stride + i] = at[k];
+			}
+		}
+	}
+
+	/**
+	 * Get the state the integrators advance: the six state columns of
+	 * \ref _bodies, or \ref _variational if it carries the state
+	 * transition matrices too
+	 *
+	 * @return The state
+	 */
+	double* EphemerisManager::_state()
+	{
+		return _stm ? _variational.data() : _bodies.state();
+	}
+
+	/**
+	 * Scatter the propagated states, accelerations and state
+	 * transition matrices back to the objects
+	 */
+	void EphemerisManager::_store_bodies()
+	{
+		const size_t stride = _bodies.stride();
+
+		const double* x  = _bodies.x();
+		const double* y  = _bodies.y();
+		const double* z  = _bodies.z();
+		const double* vx = _bodies.vx();
+		const double* vy = _bodies.vy();
+		const double* vz = _bodies.vz();
+		const double* ax = _bodies.ax();
+		const double* ay = _bodies.ay();
+		const double* az = _bodies.az();
+
+		for (size_t i = 0; i < _ids.size(); i++)
+		{
+			auto& object =
+				_subdir->load<EphemerisObject>(_ids[i].object_id);
+
+			object.rv_eci(0) = x[i];
+			object.rv_eci(1) = y[i];
+			object.rv_eci(2) = z[i];
+			object.rv_eci(3) = vx[i];
+			object.rv_eci(4) = vy[i];
+			object.rv_eci(5) = vz[i];
+
+			object.accel(0) = ax[i];
+			object.accel(1) = ay[i];
+			object.accel(2) = az[i];
+
+			if (_stm && i >= _nmassive)
+			{
+				for (size_t r = 0; r < 6; r++)
+				{
+					for (size_t c = 0; c < 6; c++)
+					{
+						object.stm(r, c) =
+							_variational[(6 + 6 * r + c) * stride + i];
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * Compute the acceleration of a test particle relative to its
+	 * primary under the Sundman formulation, with the massive bodies
+	 * sampled from the dense output
+	 *
+	 * @param[in]  i   The index of the test particle
+	 * @param[in]  p   The index of its primary
+	 * @param[in]  t   The time, seconds, within the last step
+	 * @param[in]  rho The position of the particle relative to the
+	 *                 primary, meters
+	 * @param[out] a   The acceleration relative to the primary, m/s^2
+	 */
+	void EphemerisManager::_sundman_accel(size_t i, size_t p, double t,
+		const double* rho, double* a)
+	{
+		const size_t m      = _nmassive;
+		const size_t stride = _bodies.stride();
+
+		double* r     = _sundman_work.data();
+		double* accel = r + 3 * stride;
+
+		/*
+		 * Stages of a step in s that overshoots the end of the step
+		 * sample just past it. The step is discarded
+		 */
+		const double time =
+			std::min(std::max(t, _dense.t_begin()), _dense.t_end());
+
+		double a_p[3];
+
+		for (size_t j = 0; j < m; j++)
+		{
+			double rj[3], vj[3], aj[3];
+			_dense.evaluate(j, time, rj, vj, aj);
+
+			for (size_t k = 0; k < 3; k++)
+				r[k * stride + j] = rj[k];
+
+			if (j == p)
+				std::copy(aj, aj + 3, a_p);
+		}
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			r[k * stride + i]     = r[k * stride + p] + rho[k];
+			accel[k * stride + i] = 0.0;
+		}
+
+		Gravity::accumulate(r, r + stride, r + 2 * stride, _bodies.gm(),
+			0, m, i, i + 1, accel, accel + stride, accel + 2 * stride);
+
+		if (!_harmonics.empty())
+		{
+			_accel_time = time;
+			_add_harmonics(r, i, i + 1, accel);
+		}
+
+		if (!_radiation.empty())
+			_radiation.accumulate(r, stride, i, i + 1, accel);
+
+		for (size_t k = 0; k < 3; k++)
+			a[k] = accel[k * stride + i] - a_p[k];
+	}
+
+	/**
+	 * Replace the absolute states of test particles with their
+	 * deviations from their reference conics, for integration under the
+	 * Encke formulation. A conic is rectified, i.e. replaced with the
+	 * osculating orbit about whichever massive body now pulls hardest,
+	 * when the deviation from it grows too large. This also happens
+	 * the first time through and after a burn large enough to matter
+	 *
+	 * @param[in] t The time at the start of the step, seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_to_deviations(double t)
+	{
+		const size_t n      = _bodies.size();
+		const size_t m      = _nmassive;
+		const size_t stride = _bodies.stride();
+
+		double* r = _bodies.x();
+		double* v = _bodies.vx();
+
+		const double* gm = _bodies.gm();
+
+		AbortIfNot_2(_conic_at(t), false);
+
+		_conic_failed = false;
+
+		for (size_t i = m; i < n; i++)
+		{
+			ReferenceConic& conic = _references[i - m];
+
+			double dr = 0.0, dv = 0.0, rho = 0.0, rho_dot = 0.0;
+
+			if (conic.valid)
+			{
+				const size_t p = conic.primary;
+
+				for (size_t k = 0; k < 3 * stride; k += stride)
+				{
+					r[k + i] -= r[k + p] + _conic[k + i];
+					v[k + i] -= v[k + p] + _conic[3 * stride + k + i];
+
+					dr      += r[k + i] * r[k + i];
+					dv      += v[k + i] * v[k + i];
+					rho     += _conic[k + i] * _conic[k + i];
+					rho_dot += _conic[3 * stride + k + i] *
+						_conic[3 * stride + k + i];
+				}
+
+				const double limit = _rectify * _rectify;
+
+				if (dr <= limit * rho && dv <= limit * rho_dot)
+					continue;
+
+				/*
+				 * Restore the absolute state before rectifying
+				 */
+				for (size_t k = 0; k < 3 * stride; k += stride)
+				{
+					r[k + i] += r[k + p] + _conic[k + i];
+					v[k + i] += v[k + p] + _conic[3 * stride + k + i];
+				}
+			}
+
+			size_t primary = 0;
+			double pull    = -1.0;
+
+			for (size_t j = 0; j < m; j++)
+			{
+				double d2 = 0.0;
+
+				for (size_t k = 0; k < 3 * stride; k += stride)
+					d2 += (r[k + i] - r[k + j]) * (r[k + i] - r[k + j]);
+
+				if (gm[j] / d2 > pull)
+				{
+					pull    = gm[j] / d2;
+					primary = j;
+				}
+			}
+
+			conic.primary = primary;
+			conic.t0      = t;
+			conic.valid   = true;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				conic.r0[k] = r[k * stride + i] - r[k * stride + primary];
+				conic.v0[k] = v[k * stride + i] - v[k * stride + primary];
+
+				r[k * stride + i] = 0.0;
+				v[k * stride + i] = 0.0;
+			}
+
+			/*
+			 * The integrators' cached derivatives no longer match
+			 * the state
+			 */
+			_accel_valid = false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Update telemetry outputs with freshly computed values. With
+	 * dense output, the states are interpolated to the given time once
+	 * the first step has been taken; otherwise they are the latest
+	 * ones stored
+	 *
+	 * @param[in] t The current time, seconds
+	 *
+	 * @return True on success
+	 */
+	bool EphemerisManager::_update_telemetry(double t)
+	{
+		for (auto iter = _ids.begin(), end = _ids.end();
+			iter != end; ++iter)
+		{
+			auto& object = _subdir->load<EphemerisObject>(iter->object_id);
+
+			double r[3], v[3], a[3];
+
+			if (!_dense_output || !_dense.evaluate(
+				iter - _ids.begin(), t, r, v, a))
+			{
+				for (int i = 0; i <= 2; i++)
+				{
+					r[i] = object.rv_eci(i);
+					v[i] = object.rv_eci(i + 3);
+					a[i] = object.accel(i);
+				}
+			}
+
+			for (int i = 0; i <= 2; i++)
+			{
+				iter->telemetry->load<double>(iter->a_eci_id[i])
+					= a[i];
+
+				iter->telemetry->load<double>(iter->r_eci_id[i])
+					= r[i];
+
+				iter->telemetry->load<double>(iter->v_eci_id[i])
+					= v[i];
+			}
+
+			if (_solver == Solver::culled)
+			{
+				const size_t i = iter - _ids.begin();
+
+				iter->telemetry->load<double>(iter->a_cull_error_id)
+					= _perturbers.acceleration_error(i);
+
+				iter->telemetry->load<double>(iter->v_cull_error_id)
+					= _perturbers.velocity_error(i);
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Compute the derivatives of the state transition matrices in the
+	 * variational part of the state (see \ref set_stm()). Massive
+	 * bodies keep the identity
+	 *
+	 * @param[in]  x    The state, laid out as \ref _variational
+	 * @param[out] dxdt The derivative of the state
+	 */
+	void EphemerisManager::_variational_derivative(const double* x,
+		double* dxdt)
+	{
+		const size_t stride = _bodies.stride();
+
+		const double* phi  = x    + 6 * stride;
+		double*       dphi = dxdt + 6 * stride;
+
+		std::fill(dphi, dphi + 36 * stride, 0.0);
+
+		const double* gm = _bodies.gm();
+
+		for (size_t i = _nmassive; i < _bodies.size(); i++)
+		{
+			double g[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+			Gravity::gradient(x, x + stride, x + 2 * stride, gm,
+				0, _nmassive, i, g);
+
+			Matrix<6,6> a;
+
+			for (size_t k = 0; k < 3; k++)
+				a(k, k + 3) = 1.0;
+
+			a(3, 0) = g[0]; a(3, 1) = g[1]; a(3, 2) = g[2];
+			a(4, 0) = g[1]; a(4, 1) = g[3]; a(4, 2) = g[4];
+			a(5, 0) = g[2]; a(5, 1) = g[4]; a(5, 2) = g[5];
+
+			Matrix<6,6> m;
+
+			for (size_t r = 0; r < 6; r++)
+			{
+				for (size_t c = 0; c < 6; c++)
+					m(r, c) = phi[(6 * r + c) * stride + i];
+			}
+
+			const Matrix<6,6> d = a * m;
+
+			for (size_t r = 0; r < 6; r++)
+			{
+				for (size_t c = 0; c < 6; c++)
+					dphi[(6 * r + c) * stride + i] = d(r, c);
+			}
+		}
+	}
 }
@@ -1,15 +1,33 @@
 #pragma once
 
+#include "BodyArray.h"
+#include "BulirschStoer.h"
+#include "Chebyshev.h"
+#include "ClusterField.h"
+#include "DenseOutput.h"
+#include "EmbeddedRK.h"
 #include "EphemerisObject.h"
 #include "Event.h"
+#include "EventLocator.h"
+#include "GravityGrid.h"
+#include "Kepler.h"
+#include "PatchedConics.h"
+#include "Multistep.h"
+#include "Octree.h"
+#include "Orientation.h"
+#include "Parareal.h"
+#include "PerturberLists.h"
 #include "SharedData.h"
 #include "RK4.h"
+#include "SolarPressure.h"
+#include "SphericalHarmonics.h"
+#include "ThreadPool.h"
 
 namespace Crescent
 {
 	/**
 	 * Manages the ephemerides of all bodies within the system, which
-	 * are propagated at 50Hz
+	 * are propagated at 50Hz by default
 	 */
 	class EphemerisManager : public Event
 	{
@@ -33,11 +51,15 @@ namespace Crescent
 			*/
 			SharedIDs(const std::string& _name)
 				: object_id(-1),
+				a_cull_error_id(-1),
 				a_eci_id(3, -1),
 				r_eci_id(3, -1),
 				v_eci_id(3, -1),
 				mass_id(-1),
-				name(_name)
+				name(_name),
+				rate(1),
+				table_id(-1),
+				v_cull_error_id(-1)
 			{
 			}
 
@@ -47,6 +69,12 @@ namespace Crescent
 			 */
 			int object_id;
 
+			/**
+			 * Shared ID of the telemetry variable holding the
+			 * estimated acceleration error due to perturber culling
+			 */
+			int a_cull_error_id;
+
 			/**
 			 * Shared IDs of the three telemetry variables holding
 			 * the object's acceleration coordinates
@@ -77,6 +105,24 @@ namespace Crescent
 			 */
 			std::string name;
 
+			/**
+			 * Under the multirate integrator, the number of base
+			 * steps per step of this body
+			 */
+			int rate;
+
+			/**
+			 * Index of this body in the Chebyshev ephemeris it is
+			 * played back from, or -1 if it is integrated
+			 */
+			int table_id;
+
+			/**
+			 * Shared ID of the telemetry variable holding the velocity
+			 * error accumulated due to perturber culling
+			 */
+			int v_cull_error_id;
+
 			/**
 			 * The directory in which to store telemetry
 			 */
@@ -84,41 +130,674 @@ namespace Crescent
 				telemetry;
 		};
 
+		/**
+		 * Perturbed copies of a test particle propagated alongside it
+		 * (see \ref set_ensemble())
+		 */
+		struct EnsembleConfig
+		{
+			/**
+			 * The name of the body to copy
+			 */
+			std::string body;
+
+			/**
+			 * The number of copies
+			 */
+			int count;
+
+			/**
+			 * The seed of the random dispersions
+			 */
+			unsigned int seed;
+
+			/**
+			 * The standard deviation of each position component,
+			 * meters
+			 */
+			double sigma_r;
+
+			/**
+			 * The standard deviation of each velocity component,
+			 * meters/second
+			 */
+			double sigma_v;
+		};
+
+		/**
+		 * An event read from the events config file, whose crossings
+		 * are logged
+		 */
+		struct EventConfig
+		{
+			/**
+			 * The name of the body whose state is tested
+			 */
+			std::string body;
+
+			/**
+			 * The crossings to report
+			 */
+			EventLocator::Direction direction;
+
+			/**
+			 * The event function
+			 */
+			EventLocator::Function function;
+
+			/**
+			 * How far the function must stray from zero between
+			 * crossings
+			 */
+			double hysteresis;
+
+			/**
+			 * The name of the event
+			 */
+			std::string name;
+
+			/**
+			 * The name of the reference body, or empty for the
+			 * inertial origin
+			 */
+			std::string reference;
+		};
+
+		/**
+		 * A body whose gravity is expanded in spherical harmonics
+		 */
+		struct HarmonicField
+		{
+			/**
+			 * Index of the body, a massive one
+			 */
+			size_t body;
+
+			/**
+			 * The field, in the body-fixed frame
+			 */
+			Handle<SphericalHarmonics> field;
+
+			/**
+			 * Cache of the field over a shell, or null to always
+			 * evaluate the field directly
+			 */
+			Handle<GravityGrid> grid;
+
+			/**
+			 * The file holding \ref grid
+			 */
+			std::string grid_path;
+
+			/**
+			 * The name of the body
+			 */
+			std::string name;
+
+			/**
+			 * Gives the body-fixed frame over time
+			 */
+			Handle<Orientation> orientation;
+		};
+
+		/**
+		 * The integrators and recorded states of one slice of the
+		 * Parareal window
+		 */
+		struct PararealSlice
+		{
+			/**
+			 * Constructor
+			 *
+			 * @param[in] embedded      Copied as \ref embedded
+			 * @param[in] extrapolation Copied as \ref extrapolation
+			 * @param[in] rk4           Copied as \ref rk4
+			 */
+			PararealSlice(const EmbeddedRK& embedded,
+				const BulirschStoer& extrapolation, const RK4<>& rk4)
+				: derivative(),
+				embedded(embedded),
+				extrapolation(extrapolation),
+				rk4(rk4),
+				states()
+			{
+			}
+
+			/**
+			 * The derivative at the end of the slice, which the RK4
+			 * integrator does not return, 6 x stride
+			 */
+			std::vector<double>
+				derivative;
+
+			/**
+			 * The adaptive integrator, used when the integrator is
+			 * dopri5 or rkf78
+			 */
+			EmbeddedRK embedded;
+
+			/**
+			 * The extrapolation integrator, used when the integrator
+			 * is gbs
+			 */
+			BulirschStoer extrapolation;
+
+			/**
+			 * The RK4 integrator, used when the integrator is rk4
+			 */
+			RK4<> rk4;
+
+			/**
+			 * The x|y|z|vx|vy|vz|ax|ay|az columns of all bodies at
+			 * the end of each step of the slice, one block of
+			 * 9 x (number of bodies) per step
+			 */
+			std::vector<double>
+				states;
+		};
+
+		/**
+		 * A body read from the radiation pressure config file
+		 */
+		struct RadiationConfig
+		{
+			/**
+			 * The area-to-mass ratio of a spacecraft, m^2/kg
+			 */
+			double area_to_mass;
+
+			/**
+			 * The name of the body
+			 */
+			std::string name;
+
+			/**
+			 * The radius of the Sun or an occulter, meters, or zero
+			 * for a spacecraft
+			 */
+			double radius;
+
+			/**
+			 * The reflectivity coefficient of a spacecraft
+			 */
+			double reflectivity;
+
+			/**
+			 * True for the Sun
+			 */
+			bool sun;
+		};
+
+		/**
+		 * Bodies sharing a step size under the multirate integrator.
+		 * Each group owns one contiguous run of massive bodies and
+		 * one of test particles
+		 */
+		struct RateGroup
+		{
+			/**
+			 * The number of base steps per step of this group
+			 */
+			int rate;
+
+			/**
+			 * Range of massive bodies in this group
+			 */
+			size_t massive_begin, massive_end;
+
+			/**
+			 * Range of test particles in this group
+			 */
+			size_t test_begin, test_end;
+		};
+
+		/**
+		 * The osculating two-body orbit about a primary that a test
+		 * particle follows under the Encke formulation
+		 */
+		struct ReferenceConic
+		{
+			/**
+			 * The index of the primary, a massive body
+			 */
+			size_t primary;
+
+			/**
+			 * Time at which the conic osculates, seconds
+			 */
+			double t0;
+
+			/**
+			 * Position and velocity relative to the primary at
+			 * \ref t0
+			 */
+			double r0[3], v0[3];
+
+			/**
+			 * False until the conic has been set up
+			 */
+			bool valid;
+		};
+
 	public:
 
+		/**
+		 * Methods available for propagating the ephemerides
+		 */
+		enum class Integrator
+		{
+			/** Explicit Euler, 1st order             */
+			euler,
+
+			/** Classic Runge-Kutta, 4th order       */
+			rk4,
+
+			/** Kick-drift-kick leapfrog, 2nd order  */
+			leapfrog,
+
+			/** Yoshida composition, 4th order       */
+			yoshida4,
+
+			/** Dormand-Prince 5(4), adaptive        */
+			dopri5,
+
+			/** Runge-Kutta-Fehlberg 7(8), adaptive  */
+			rkf78,
+
+			/** Adams-Bashforth-Moulton, multistep   */
+			abm,
+
+			/** Gragg-Bulirsch-Stoer extrapolation   */
+			gbs,
+
+			/** Leapfrog with per-body step sizes    */
+			multirate,
+
+			/** Patched conics, no perturbations     */
+			kepler
+		};
+
+		/**
+		 * Equations of motion integrated for the test particles
+		 */
+		enum class Formulation
+		{
+			/** Total acceleration in inertial coordinates     */
+			cowell,
+
+			/** Deviation from an osculating reference conic   */
+			encke,
+
+			/** Relative motion in a Sundman-transformed time  */
+			sundman
+		};
+
+		/**
+		 * Methods available for computing gravity
+		 */
+		enum class Solver
+		{
+			/** Exact pairwise sum, O(N^2)       */
+			direct,
+
+			/** Barnes-Hut tree code, O(N log N) */
+			tree,
+
+			/** Direct sum, far field in single precision */
+			cluster,
+
+			/** Direct sum over per-body perturber lists */
+			culled
+		};
+
 		/**
 		 * Gravitational constant, m^3/kg/s^2
 		 */
 		const double G = 6.67408e-11;
 
 		/**
-		 * The dispatch rate of this Event
+		 * The default dispatch rate of this Event, which is also the
+		 * default step size
 		 */
 		const static int64 period = 2; // 50Hz
 
+		/**
+		 * Edge length (in bodies) of the square tiles into which the
+		 * pair matrix is cut when computing gravity in parallel
+		 */
+		const static size_t tile_size = 256;
+
 		EphemerisManager();
 
 		~EphemerisManager();
 
+		int add_event(const std::string& body,
+			const std::string& reference,
+			const EventLocator::Function& g,
+			EventLocator::Direction direction, double hysteresis,
+			const EventLocator::Handler& handler);
+
 		void compute_accel();
 
+		void compute_accel(const double* r, double* a);
+
 		int64 dispatch(int64 t_now);
 
+		int find(const std::string& name) const;
+
+		bool finish();
+
 		bool init(Handle<DataDirectory> shared,
 			const std::string& config);
 
-		void propagate();
+		bool propagate(int64 t_now);
+
+		bool reset_stm();
+
+		bool set_chebyshev_input(const std::string& path);
+
+		bool set_chebyshev_output(const std::string& path,
+			double interval, int ncoeff);
+
+		bool set_cluster_size(double size);
+
+		bool set_dense_output(bool enable);
+
+		bool set_ensemble(const std::string& body, int count,
+			double sigma_r, double sigma_v, unsigned int seed);
+
+		bool set_event_tolerance(double seconds);
+
+		bool set_events(const std::string& config);
+
+		bool set_formulation(const std::string& name);
+
+		bool set_harmonics(const std::string& config);
+
+		bool set_integrator(const std::string& name);
+
+		bool set_multistep_order(int order);
+
+		bool set_opening_angle(double theta);
+
+		bool set_orientation(const std::string& body,
+			Handle<Orientation> orientation);
+
+		bool set_parareal(int slices, double span, double coarse_step);
+
+		bool set_perturber_culling(double drop, double hold,
+			int refresh);
+
+		bool set_radiation_pressure(const std::string& config);
+
+		bool set_rectify_threshold(double ratio);
+
+		bool set_solver(const std::string& name);
+
+		bool set_step(double seconds);
+
+		bool set_stm(bool enable);
+
+		bool set_sundman_steps(int steps);
+
+		bool set_tolerance(double rtol, double atol);
+
+		bool set_threads(int nthreads);
+
+		bool state_at(size_t body, double t, double* r, double* v,
+			double* a) const;
 
 	private:
 
+		void _add_harmonics(const double* r, size_t begin, size_t end,
+			double* a);
+
+		void _compute_accel_clustered(const double* r, double* a);
+
+		void _compute_accel_culled(const double* r, double* a);
+
+		void _compute_accel_direct(const double* r, double* a);
+
+		void _compute_accel_parallel(const double* r, double* a);
+
+		void _compute_accel_range(const double* r, size_t begin,
+			size_t end, double* a);
+
+		void _compute_accel_tree(const double* r, double* a);
+
+		bool _conic_at(double t);
+
+		void _derivative(double t, const double* x, double* dxdt);
+
+		bool _from_deviations(double t);
+
+		bool _init_chebyshev();
+
+		bool _init_ensemble();
+
+		bool _init_events();
+
+		bool _init_groups();
+
+		bool _init_harmonics();
+
+		bool _init_parareal();
+
+		bool _init_patched(double t);
+
+		bool _init_radiation();
+
 		bool _init_telemetry();
 
-		bool _update_telemetry();
+		bool _propagate_embedded(double t, double dt);
+
+		void _propagate_euler(double dt);
+
+		bool _propagate_extrapolation(double t, double dt);
+
+		bool _propagate_kepler(double t, double dt);
+
+		void _propagate_multirate(double t, double dt);
+
+		bool _propagate_multistep(double t, double dt);
+
+		bool _propagate_parareal(int64 t_now);
+
+		void _propagate_rk4(double t);
+
+		bool _propagate_sundman(double t);
+
+		void _propagate_symplectic(double t, double dt);
+
+		void _load_bodies();
+
+		bool _parareal_coarse(double t0, double t1, double* x);
+
+		void _parareal_derivative(const double* x, double* dxdt);
+
+		bool _parareal_fine(size_t slice, double t0, double* x);
+
+		void _play_back(double t, double* r, double* v, double* a);
+
+		double* _state();
+
+		void _store_bodies();
+
+		void _sundman_accel(size_t i, size_t p, double t,
+			const double* rho, double* a);
+
+		bool _to_deviations(double t);
+
+		bool _update_telemetry(double t);
+
+		void _variational_derivative(const double* x, double* dxdt);
+
+		/**
+		 * Absolute positions of all bodies while integrating under
+		 * the Encke formulation, x|y|z columns of
+		 * \ref BodyArray::stride() entries
+		 */
+		std::vector<double>
+			_absolute;
+
+		/**
+		 * The time of the positions passed to \ref compute_accel(),
+		 * seconds. Set by the integrators before each evaluation
+		 */
+		double _accel_time;
+
+		/**
+		 * True if the acceleration columns of \ref _bodies hold the
+		 * accelerations at the current positions
+		 */
+		bool _accel_valid;
+
+		/**
+		 * Hot fields of all bodies, in structure-of-arrays form.
+		 * Index i corresponds to _ids[i]
+		 */
+		BodyArray _bodies;
+
+		/**
+		 * Clusters used by the cluster solver, rebuilt every step
+		 */
+		ClusterField _clusters;
+
+		/**
+		 * Under the kepler integrator, the state of each test particle
+		 * relative to its current primary, indexed from the first test
+		 * particle
+		 */
+		std::vector<PatchedConics::Coast>
+			_coasts;
 
 		/**
-		 * dx/dt of the current EphemerisObject (unused)
+		 * Positions and velocities relative to a primary, propagated
+		 * along two-body conics, x|y|z|vx|vy|vz columns of
+		 * \ref BodyArray::stride() entries. Under the Encke
+		 * formulation, entry i holds test particle i's reference
+		 * conic at the time last passed to \ref _conic_at()
 		 */
-		size_t _dxdt_i;
+		std::vector<double>
+			_conic;
+
+		/**
+		 * Set if the Kepler solve of a reference conic failed to
+		 * converge while integrating under the Encke formulation
+		 */
+		bool _conic_failed;
+
+		/**
+		 * States of all bodies over the last step, kept if
+		 * \ref _dense_output is set or any events are registered
+		 */
+		DenseOutput _dense;
+
+		/**
+		 * If true, states are available between steps through
+		 * \ref state_at(), and telemetry is published at every
+		 * cycle
+		 */
+		bool _dense_output;
+
+		/**
+		 * The adaptive Runge-Kutta integrator, used when the
+		 * integrator is dopri5 or rkf78
+		 */
+		EmbeddedRK _embedded;
+
+		/**
+		 * The perturbed copies of a test particle to create when
+		 * initialized
+		 */
+		EnsembleConfig _ensemble;
+
+		/**
+		 * Events read from the events config file, registered with
+		 * \ref _locator when initialized
+		 */
+		std::vector< EventConfig >
+			_events;
+
+		/**
+		 * The Gragg-Bulirsch-Stoer integrator, used when the
+		 * integrator is gbs
+		 */
+		BulirschStoer
+			_extrapolation;
+
+		/**
+		 * Time span of each Chebyshev record when recording,
+		 * seconds
+		 */
+		double _fit_interval;
+
+		/**
+		 * Coefficients per series when recording
+		 */
+		size_t _fit_ncoeff;
+
+		/**
+		 * The file to which the Chebyshev ephemeris of the massive
+		 * bodies is written by \ref finish(), or empty if not
+		 * recording
+		 */
+		std::string _fit_path;
+
+		/**
+		 * Cycles between samples when recording
+		 */
+		int64 _fit_period;
+
+		/**
+		 * Fits Chebyshev series to the recorded positions
+		 */
+		ChebyshevFitter
+			_fitter;
+
+		/**
+		 * The equations of motion integrated for the test particles
+		 */
+		Formulation _formulation;
+
+		/**
+		 * Solves Kepler's equation for every entry of \ref _conic
+		 * at once
+		 */
+		KeplerBatch
+			_kepler;
+
+		/**
+		 * Times of flight of the entries of \ref _conic
+		 */
+		std::vector<double>
+			_kepler_dt;
+
+		/**
+		 * Gravitational parameters of the primaries of the entries
+		 * of \ref _conic
+		 */
+		std::vector<double>
+			_kepler_mu;
+
+		/**
+		 * The multirate groups, from the slowest to the fastest
+		 */
+		std::vector< RateGroup >
+			_groups;
+
+		/**
+		 * Acceleration of each body due to one spherical-harmonic
+		 * field, x|y|z columns of \ref BodyArray::stride() entries
+		 */
+		std::vector<double>
+			_harmonic_accel;
+
+		/**
+		 * Bodies with spherical-harmonic gravity
+		 */
+		std::vector<HarmonicField>
+			_harmonics;
 
 		/**
 		 * The SharedIDs of each body
@@ -126,15 +805,172 @@ namespace Crescent
 		std::vector< SharedIDs >
 			_ids;
 
+		/**
+		 * The method used to propagate the ephemerides
+		 */
+		Integrator _integrator;
+
 		/**
 		 * True if initialized
 		 */
 		bool _is_init;
 
 		/**
-		 * The RK4 propagator (unused)
+		 * Locates the crossings of all registered events on
+		 * \ref _dense after each step
+		 */
+		EventLocator
+			_locator;
+
+		/**
+		 * The Adams-Bashforth-Moulton integrator, used when the
+		 * integrator is abm
+		 */
+		AdamsBashforthMoulton
+			_multistep;
+
+		/**
+		 * The number of massive bodies. These occupy indices
+		 * [0, _nmassive) of \ref _ids and \ref _bodies, followed
+		 * by the massless test particles
+		 */
+		size_t _nmassive;
+
+		/**
+		 * Tree used by the Barnes-Hut solver, rebuilt every step
+		 */
+		Octree _octree;
+
+		/**
+		 * Solves each window of steps in parallel under Parareal
+		 */
+		Parareal _parareal;
+
+		/**
+		 * The cycle at which the current Parareal window begins
+		 */
+		int64 _parareal_begin;
+
+		/**
+		 * The step size of the coarse Parareal propagator, seconds
+		 */
+		double _parareal_coarse_step;
+
+		/**
+		 * The number of slices each Parareal window is cut into, or
+		 * zero to propagate serially
+		 */
+		int _parareal_count;
+
+		/**
+		 * Each slice of the Parareal window
+		 */
+		std::vector< PararealSlice >
+			_parareal_slices;
+
+		/**
+		 * The requested length of each Parareal window, seconds
+		 */
+		double _parareal_span;
+
+		/**
+		 * The number of steps in each Parareal slice
+		 */
+		int64 _parareal_steps;
+
+		/**
+		 * The dispatch period in cycles, i.e. the step size in
+		 * hundredths of a second
+		 */
+		int64 _period;
+
+		/**
+		 * Interaction lists used by the culled solver
+		 */
+		PerturberLists _perturbers;
+
+		/**
+		 * Base steps taken since all multirate groups last began a
+		 * step together
+		 */
+		int64 _phase;
+
+		/**
+		 * Positions of all bodies at the end of a multirate group's
+		 * step, x|y|z columns of \ref BodyArray::stride() entries
+		 */
+		std::vector<double>
+			_predicted;
+
+		/**
+		 * Under the kepler integrator, the two-body model the massive
+		 * bodies follow, set up at the first step
+		 */
+		PatchedConics
+			_patched;
+
+		/**
+		 * True once \ref _patched has been set up
+		 */
+		bool _patched_init;
+
+		/**
+		 * Worker threads used to compute gravity, or null if running
+		 * single-threaded
+		 */
+		Handle<ThreadPool>
+			_pool;
+
+		/**
+		 * Solar radiation pressure on spacecraft, with the shadows of
+		 * occulting bodies
+		 */
+		SolarPressure _radiation;
+
+		/**
+		 * The bodies read from the radiation pressure config file,
+		 * registered with \ref _radiation when initialized
+		 */
+		std::vector< RadiationConfig >
+			_radiation_config;
+
+		/**
+		 * A test particle's reference conic is rectified once its
+		 * deviation exceeds this fraction of its position or
+		 * velocity relative to the primary
 		 */
-		RK4<6> _rk4;
+		double _rectify;
+
+		/**
+		 * The reference conic of each test particle under the Encke
+		 * formulation, indexed from the first test particle
+		 */
+		std::vector< ReferenceConic >
+			_references;
+
+		/**
+		 * The RK4 integrator, sized for the whole state block, used
+		 * when the integrator is rk4, and as the coarse propagator
+		 * under Parareal
+		 */
+		RK4<> _rk4;
+
+		/**
+		 * The method used to compute gravity
+		 */
+		Solver _solver;
+
+		/**
+		 * Under the multirate integrator, the state of every body at
+		 * the start and end of its current step
+		 */
+		BodyArray _step_begin, _step_end;
+
+		/**
+		 * If true, integrate the variational equations of the test
+		 * particles along with their states (see \ref set_stm())
+		 */
+		bool _stm;
 
 		/**
 		 * The directory in which to store our
@@ -142,5 +978,63 @@ namespace Crescent
 		 */
 		Handle<DataDirectory>
 			_subdir;
+
+		/**
+		 * Integrates one test particle at a time under the Sundman
+		 * formulation, over its position and velocity relative to its
+		 * primary and the time
+		 */
+		RK4<7> _sundman;
+
+		/**
+		 * Under the Sundman formulation, the number of steps a test
+		 * particle takes per revolution of a circular orbit
+		 */
+		int _sundman_steps;
+
+		/**
+		 * Under the Sundman formulation, the positions of the massive
+		 * bodies and a test particle followed by the acceleration of
+		 * the test particle, x|y|z columns of
+		 * \ref BodyArray::stride() entries each
+		 */
+		std::vector<double>
+			_sundman_work;
+
+		/**
+		 * The Chebyshev ephemeris from which bodies are played back,
+		 * or null if all bodies are integrated
+		 */
+		Handle<ChebyshevEphemeris>
+			_table;
+
+		/**
+		 * Indices of the bodies played back from \ref _table
+		 */
+		std::vector<size_t>
+			_tabulated;
+
+		/**
+		 * Per-thread acceleration buffers, each holding x|y|z columns
+		 * of \ref BodyArray::stride() entries
+		 */
+		std::vector<double>
+			_thread_accel;
+
+		/**
+		 * The massive targets of the Barnes-Hut solver, in Morton
+		 * order, less any played back from \ref _table
+		 */
+		std::vector<size_t>
+			_tree_targets;
+
+		/**
+		 * With \ref _stm set, the state integrated in place of
+		 * \ref BodyArray::state(): its six columns followed by the 36
+		 * elements of each body's state transition matrix in row
+		 * major order, columns of \ref BodyArray::stride() entries
+		 */
+		std::vector<double>
+			_variational;
 	};
 }
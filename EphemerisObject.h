@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 
+#include "Matrix.h"
 #include "Vector.h"
 
 namespace Crescent
@@ -20,8 +21,10 @@ namespace Crescent
 		 */
 		EphemerisObject(const std::string& _name = "", double _mass = 0.0)
 			: name(_name),
-			mass(_mass)
+			mass(_mass),
+			massive(true)
 		{
+			stm.identify();
 		}
 
 		/**
@@ -35,6 +38,13 @@ namespace Crescent
 		 */
 		double      mass;
 
+		/**
+		 * True if this object is a source of gravity. Massless
+		 * objects (test particles) feel the pull of massive ones
+		 * but exert none themselves
+		 */
+		bool        massive;
+
 		/**
 		 * The name of this object
 		 */
@@ -45,5 +55,13 @@ namespace Crescent
 		 * J2000
 		 */
 		Vector<6>   rv_eci;
+
+		/**
+		 * The state transition matrix, i.e. the partial derivatives
+		 * of \ref rv_eci with respect to its value at the epoch set
+		 * by \ref EphemerisManager::reset_stm(). Only propagated for
+		 * test particles, and only if enabled
+		 */
+		Matrix<6,6> stm;
 	};
 }
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cmath>
+
+#include "abort.h"
+#include "EventLocator.h"
+#include "RootFinding.h"
+
+namespace Crescent
+{
+	/**
+	 * Constructor
+	 */
+	EventLocator::EventLocator()
+		: _crossings(),
+		_entries(),
+		_subintervals(4),
+		_tolerance(1.0e-6)
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	EventLocator::~EventLocator()
+	{
+	}
+
+	/**
+	 * Register an event function
+	 *
+	 * @param[in] body       The body whose state is passed to \a g
+	 * @param[in] reference  States are taken relative to this body, or
+	 *                       to the origin if \ref inertial
+	 * @param[in] g          The event function
+	 * @param[in] direction  The crossings to report
+	 * @param[in] hysteresis How far \a g must stray from zero between
+	 *                       crossings, in the units of \a g
+	 * @param[in] handler    Called at each crossing
+	 *
+	 * @return The index of the event
+	 */
+	size_t EventLocator::add(size_t body, size_t reference,
+		const Function& g, Direction direction, double hysteresis,
+		const Handler& handler)
+	{
+		Entry entry;
+		entry.above      = false;
+		entry.below      = false;
+		entry.body       = body;
+		entry.direction  = direction;
+		entry.function   = g;
+		entry.handler    = handler;
+		entry.hysteresis = std::abs(hysteresis);
+		entry.reference  = reference;
+
+		_entries.push_back(entry);
+		return _entries.size() - 1;
+	}
+
+	/**
+	 * Make an event function that crosses zero when the body is at a
+	 * given distance from the reference body, rising on the way out.
+	 * With the radius of the reference body this detects surface
+	 * impact (falling), and with that of its sphere of influence the
+	 * sphere crossings
+	 *
+	 * @param[in] d The distance, meters
+	 *
+	 * @return The event function
+	 */
+	EventLocator::Function EventLocator::distance(double d)
+	{
+		return [d](double, const double* r, const double*) {
+			return std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]) -
+				d;
+		};
+	}
+
+	/**
+	 * Check whether any event functions are registered
+	 *
+	 * @return True if there are none
+	 */
+	bool EventLocator::empty() const
+	{
+		return _entries.empty();
+	}
+
+	/**
+	 * Look for crossings within the last step, and call the handlers
+	 * of those found in order of time
+	 *
+	 * @param[in] dense The states over the step
+	 *
+	 * @return True on success
+	 */
+	bool EventLocator::locate(const DenseOutput& dense)
+	{
+		const double t0 = dense.t_begin();
+		const double h  = (dense.t_end() - t0) / _subintervals;
+
+		_crossings.clear();
+
+		for (size_t e = 0; e < _entries.size(); e++)
+		{
+			Entry& entry = _entries[e];
+
+			Crossing crossing;
+			crossing.event = e;
+
+			double a = t0, fa;
+
+			AbortIfNot_2(_evaluate(dense, entry, a, crossing.r,
+				crossing.v, fa), false);
+
+			auto g = [&](double t) {
+				double g_t = 0.0;
+				_evaluate(dense, entry, t, crossing.r, crossing.v, g_t);
+				return g_t;
+			};
+
+			for (int k = 1; k <= _subintervals; k++)
+			{
+				const double next =
+					k == _subintervals ? dense.t_end() : t0 + k * h;
+
+				double f_next;
+
+				AbortIfNot_2(_evaluate(dense, entry, next, crossing.r,
+					crossing.v, f_next), false);
+
+				if (fa >=  entry.hysteresis) entry.above = true;
+				if (fa <  -entry.hysteresis) entry.below = true;
+
+				const bool rising  =
+					entry.below && fa <  0.0 && f_next >= 0.0;
+				const bool falling =
+					entry.above && fa >= 0.0 && f_next <  0.0;
+
+				if (rising)  entry.below = false;
+				if (falling) entry.above = false;
+
+				if ((rising && entry.direction != Direction::falling) ||
+					(falling && entry.direction != Direction::rising))
+				{
+					double b = next, fb = f_next;
+
+					AbortIfNot(illinois(g, a, fa, b, fb, _tolerance),
+						false, "unable to locate event %zu between "
+						"t = %g and %g", e, a, b);
+
+					/*
+					 * Report the first time past the crossing
+					 */
+					crossing.t = b;
+					g(b);
+
+					_crossings.push_back(crossing);
+				}
+
+				a  = next;
+				fa = f_next;
+			}
+		}
+
+		std::stable_sort(_crossings.begin(), _crossings.end(),
+			[](const Crossing& x, const Crossing& y) {
+				return x.t < y.t;
+			});
+
+		for (const auto& crossing : _crossings)
+		{
+			const Entry& entry = _entries[crossing.event];
+
+			if (entry.handler)
+			{
+				entry.handler(crossing.event, crossing.t, crossing.r,
+					crossing.v);
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Make an event function giving the rate of change of the
+	 * distance from the reference body, which rises through zero at
+	 * periapsis and falls through zero at apoapsis
+	 *
+	 * @return The event function
+	 */
+	EventLocator::Function EventLocator::range_rate()
+	{
+		return [](double, const double* r, const double* v) {
+			const double range =
+				std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+
+			return range > 0.0 ?
+				(r[0] * v[0] + r[1] * v[1] + r[2] * v[2]) / range : 0.0;
+		};
+	}
+
+	/**
+	 * Set the number of intervals each step is cut into when looking
+	 * for sign changes. A function crossing zero twice within one
+	 * interval is missed
+	 *
+	 * @param[in] count The number of intervals
+	 *
+	 * @return True on success
+	 */
+	bool EventLocator::set_subintervals(int count)
+	{
+		AbortIf(count < 1, false, "invalid event subinterval count: %d",
+			count);
+
+		_subintervals = count;
+		return true;
+	}
+
+	/**
+	 * Set how closely crossing times are located
+	 *
+	 * @param[in] seconds The tolerance
+	 *
+	 * @return True on success
+	 */
+	bool EventLocator::set_tolerance(double seconds)
+	{
+		AbortIf(!(seconds > 0.0), false, "invalid event tolerance: %g",
+			seconds);
+
+		_tolerance = seconds;
+		return true;
+	}
+
+	/**
+	 * Evaluate an event function on the dense output
+	 *
+	 * @param[in]  dense The states over the last step
+	 * @param[in]  entry The event
+	 * @param[in]  t     The time, seconds
+	 * @param[out] r     The relative position
+	 * @param[out] v     The relative velocity
+	 * @param[out] g     The value of the event function
+	 *
+	 * @return True on success
+	 */
+	bool EventLocator::_evaluate(const DenseOutput& dense,
+		const Entry& entry, double t, double* r, double* v,
+		double& g) const
+	{
+		double a[3];
+
+		if (entry.reference == inertial)
+		{
+			AbortIfNot(dense.evaluate(entry.body, t, r, v, a), false,
+				"no state of body %zu at t = %g", entry.body, t);
+		}
+		else
+		{
+			AbortIfNot(dense.relative(entry.body, entry.reference, t,
+				r, v, a), false, "no state of body %zu relative to %zu "
+				"at t = %g", entry.body, entry.reference, t);
+		}
+
+		g = entry.function(t, r, v);
+		return true;
+	}
+}
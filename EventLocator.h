@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "DenseOutput.h"
+
+namespace Crescent
+{
+	/**
+	 * @class EventLocator
+	 *
+	 * Locates the times at which scalar functions of the state of a
+	 * body relative to another cross zero, e.g. its range rate at
+	 * periapsis or its distance from a surface or sphere of influence.
+	 * After each step, every function is sampled at a few evenly spaced
+	 * times across the step on the \ref DenseOutput, and each sign
+	 * change is refined by root finding on the interpolated states, so
+	 * crossings are found to within the tolerance no matter how long
+	 * the step is. Only a function that crosses zero twice between
+	 * samples goes unnoticed.
+	 *
+	 * A function that lingers near zero, such as the range rate about
+	 * the apsides of a nearly circular orbit, may flicker in sign with
+	 * the rounding of the states. Each event therefore carries a
+	 * hysteresis: a rising crossing is only reported once the function
+	 * has been below minus the hysteresis since the last one, and a
+	 * falling crossing once it has been above it
+	 */
+	class EventLocator
+	{
+
+	public:
+
+		/**
+		 * Directions of the crossings to report
+		 */
+		enum class Direction
+		{
+			/** From negative to zero or positive */
+			rising,
+
+			/** From zero or positive to negative */
+			falling,
+
+			/** Either way                        */
+			both
+		};
+
+		/**
+		 * An event function, called with the time (seconds) and the
+		 * position (m) and velocity (m/s) of the body relative to the
+		 * reference body
+		 */
+		using Function =
+			std::function<double(double, const double*, const double*)>;
+
+		/**
+		 * Called at each crossing with the index of the event, the
+		 * time of the crossing, and the relative position and
+		 * velocity at that time
+		 */
+		using Handler = std::function<void(size_t, double,
+			const double*, const double*)>;
+
+		/**
+		 * Passed as the reference body to take states relative to the
+		 * inertial origin instead
+		 */
+		static const size_t inertial = size_t(-1);
+
+		EventLocator();
+
+		~EventLocator();
+
+		size_t add(size_t body, size_t reference, const Function& g,
+			Direction direction, double hysteresis,
+			const Handler& handler);
+
+		bool empty() const;
+
+		bool locate(const DenseOutput& dense);
+
+		bool set_subintervals(int count);
+
+		bool set_tolerance(double seconds);
+
+		static Function distance(double d);
+
+		static Function range_rate();
+
+	private:
+
+		/**
+		 * A registered event function
+		 */
+		struct Entry
+		{
+			/**
+			 * True if the function has been at or above the hysteresis
+			 * since the last falling crossing
+			 */
+			bool above;
+
+			/**
+			 * True if the function has been below minus the
+			 * hysteresis since the last rising crossing
+			 */
+			bool below;
+
+			/**
+			 * The body whose state is passed to \ref function
+			 */
+			size_t body;
+
+			/**
+			 * The crossings to report
+			 */
+			Direction direction;
+
+			/**
+			 * The event function
+			 */
+			Function function;
+
+			/**
+			 * Called at each crossing
+			 */
+			Handler handler;
+
+			/**
+			 * How far the function must stray from zero between
+			 * crossings
+			 */
+			double hysteresis;
+
+			/**
+			 * States are taken relative to this body, or to the
+			 * origin if \ref inertial
+			 */
+			size_t reference;
+		};
+
+		/**
+		 * A crossing found during the last step
+		 */
+		struct Crossing
+		{
+			/**
+			 * The index of the event
+			 */
+			size_t event;
+
+			/**
+			 * The relative position and velocity at the crossing
+			 */
+			double r[3], v[3];
+
+			/**
+			 * The time of the crossing, seconds
+			 */
+			double t;
+		};
+
+		bool _evaluate(const DenseOutput& dense, const Entry& entry,
+			double t, double* r, double* v, double& g) const;
+
+		/**
+		 * Crossings found during the last step, in the order found
+		 */
+		std::vector<Crossing>
+			_crossings;
+
+		/**
+		 * The registered event functions
+		 */
+		std::vector<Entry>
+			_entries;
+
+		/**
+		 * The number of intervals each step is cut into when looking
+		 * for sign changes
+		 */
+		int _subintervals;
+
+		/**
+		 * Crossing times are located to within this, seconds
+		 */
+		double _tolerance;
+	};
+}
@@ -0,0 +1,596 @@
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "Gravity.h"
+
+namespace Crescent
+{
+	namespace Gravity
+	{
+		/**
+		 * Accumulate the point-mass accelerations that a range of source
+		 * bodies j induce on a range of target bodies i. The governing
+		 * equation is 1.2-10 in reference (1):
+		 *
+		 *   a_i += sum_j GM_j * (r_j - r_i) / |r_j - r_i|^3
+		 *
+		 * Pairs with zero separation (i.e. a body acting on itself, or
+		 * coincident padding) are skipped. Targets are vectorized across
+		 * SIMD lanes; each source is broadcast to all lanes, so the
+		 * summation order over j matches the scalar path
+		 *
+		 * @param[in]     x       Position x column
+		 * @param[in]     y       Position y column
+		 * @param[in]     z       Position z column
+		 * @param[in]     gm      Gravitational parameter column
+		 * @param[in]     j_begin First source index
+		 * @param[in]     j_end   One past the last source index
+		 * @param[in]     i_begin First target index
+		 * @param[in]     i_end   One past the last target index
+		 * @param[in,out] ax      Acceleration x column
+		 * @param[in,out] ay      Acceleration y column
+		 * @param[in,out] az      Acceleration z column
+		 */
+		void accumulate(const double* x, const double* y,
+			const double* z,
+			const double* gm,
+			size_t j_begin, size_t j_end,
+			size_t i_begin, size_t i_end,
+			double* ax, double* ay, double* az)
+		{
+			size_t i = i_begin;
+
+#if defined(__AVX512F__)
+			const __m512d zero = _mm512_setzero_pd();
+
+			for (; i + 8 <= i_end; i += 8)
+			{
+				const __m512d xi = _mm512_loadu_pd(x + i);
+				const __m512d yi = _mm512_loadu_pd(y + i);
+				const __m512d zi = _mm512_loadu_pd(z + i);
+
+				__m512d axi = _mm512_loadu_pd(ax + i);
+				__m512d ayi = _mm512_loadu_pd(ay + i);
+				__m512d azi = _mm512_loadu_pd(az + i);
+
+				for (size_t j = j_begin; j < j_end; j++)
+				{
+					const __m512d dx =
+						_mm512_sub_pd(_mm512_set1_pd(x[j]), xi);
+					const __m512d dy =
+						_mm512_sub_pd(_mm512_set1_pd(y[j]), yi);
+					const __m512d dz =
+						_mm512_sub_pd(_mm512_set1_pd(z[j]), zi);
+
+					__m512d r2 = _mm512_mul_pd(dx, dx);
+					r2 = _mm512_fmadd_pd(dy, dy, r2);
+					r2 = _mm512_fmadd_pd(dz, dz, r2);
+
+					const __mmask8 valid =
+						_mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+
+					const __m512d r3 =
+						_mm512_mul_pd(r2, _mm512_sqrt_pd(r2));
+
+					const __m512d s = _mm512_maskz_div_pd(valid,
+						_mm512_set1_pd(gm[j]), r3);
+
+					axi = _mm512_fmadd_pd(s, dx, axi);
+					ayi = _mm512_fmadd_pd(s, dy, ayi);
+					azi = _mm512_fmadd_pd(s, dz, azi);
+				}
+
+				_mm512_storeu_pd(ax + i, axi);
+				_mm512_storeu_pd(ay + i, ayi);
+				_mm512_storeu_pd(az + i, azi);
+			}
+#elif defined(__AVX2__)
+			const __m256d zero = _mm256_setzero_pd();
+
+			for (; i + 4 <= i_end; i += 4)
+			{
+				const __m256d xi = _mm256_loadu_pd(x + i);
+				const __m256d yi = _mm256_loadu_pd(y + i);
+				const __m256d zi = _mm256_loadu_pd(z + i);
+
+				__m256d axi = _mm256_loadu_pd(ax + i);
+				__m256d ayi = _mm256_loadu_pd(ay + i);
+				__m256d azi = _mm256_loadu_pd(az + i);
+
+				for (size_t j = j_begin; j < j_end; j++)
+				{
+					const __m256d dx =
+						_mm256_sub_pd(_mm256_set1_pd(x[j]), xi);
+					const __m256d dy =
+						_mm256_sub_pd(_mm256_set1_pd(y[j]), yi);
+					const __m256d dz =
+						_mm256_sub_pd(_mm256_set1_pd(z[j]), zi);
+
+					__m256d r2 = _mm256_mul_pd(dx, dx);
+					r2 = _mm256_add_pd(r2, _mm256_mul_pd(dy, dy));
+					r2 = _mm256_add_pd(r2, _mm256_mul_pd(dz, dz));
+
+					const __m256d valid =
+						_mm256_cmp_pd(r2, zero, _CMP_GT_OQ);
+
+					const __m256d r3 =
+						_mm256_mul_pd(r2, _mm256_sqrt_pd(r2));
+
+					const __m256d s = _mm256_and_pd(valid,
+						_mm256_div_pd(_mm256_set1_pd(gm[j]), r3));
+
+					axi = _mm256_add_pd(axi, _mm256_mul_pd(s, dx));
+					ayi = _mm256_add_pd(ayi, _mm256_mul_pd(s, dy));
+					azi = _mm256_add_pd(azi, _mm256_mul_pd(s, dz));
+				}
+
+				_mm256_storeu_pd(ax + i, axi);
+				_mm256_storeu_pd(ay + i, ayi);
+				_mm256_storeu_pd(az + i, azi);
+			}
+#endif
+
+			/*
+			 * Scalar fallback, which also picks up any targets left
+			 * over from the vector loop
+			 */
+			for (; i < i_end; i++)
+			{
+				double axi = ax[i], ayi = ay[i], azi = az[i];
+
+				for (size_t j = j_begin; j < j_end; j++)
+				{
+					const double dx = x[j] - x[i];
+					const double dy = y[j] - y[i];
+					const double dz = z[j] - z[i];
+
+					const double r2 = dx * dx + dy * dy + dz * dz;
+
+					if (r2 == 0.0) continue;
+
+					const double s = gm[j] / (r2 * std::sqrt(r2));
+
+					axi += s * dx;
+					ayi += s * dy;
+					azi += s * dz;
+				}
+
+				ax[i] = axi; ay[i] = ayi; az[i] = azi;
+			}
+		}
+
+		/**
+		 * Accumulate the point-mass accelerations for every unordered
+		 * pair (i, j) with i in [i_begin, i_end), j in [j_begin, j_end)
+		 * and j > i. Each pair is evaluated once and applied to both
+		 * bodies per Newton's third law:
+		 *
+		 *   a_i += GM_j * (r_j - r_i) / |r_j - r_i|^3
+		 *   a_j -= GM_i * (r_j - r_i) / |r_j - r_i|^3
+		 *
+		 * Sources are vectorized across SIMD lanes and the per-row sum
+		 * for body i is reduced lane by lane in a fixed order, so the
+		 * result depends only on the tile bounds
+		 *
+		 * @param[in]     x       Position x column
+		 * @param[in]     y       Position y column
+		 * @param[in]     z       Position z column
+		 * @param[in]     gm      Gravitational parameter column
+		 * @param[in]     i_begin First row index
+		 * @param[in]     i_end   One past the last row index
+		 * @param[in]     j_begin First column index
+		 * @param[in]     j_end   One past the last column index
+		 * @param[in,out] ax      Acceleration x column
+		 * @param[in,out] ay      Acceleration y column
+		 * @param[in,out] az      Acceleration z column
+		 */
+		void accumulate_pairs(const double* x, const double* y,
+			const double* z,
+			const double* gm,
+			size_t i_begin, size_t i_end,
+			size_t j_begin, size_t j_end,
+			double* ax, double* ay, double* az)
+		{
+			for (size_t i = i_begin; i < i_end; i++)
+			{
+				size_t j = j_begin > i + 1 ? j_begin : i + 1;
+
+				double axi = 0.0, ayi = 0.0, azi = 0.0;
+
+#if defined(__AVX512F__)
+				{
+					const __m512d zero = _mm512_setzero_pd();
+
+					const __m512d xi  = _mm512_set1_pd(x[i]);
+					const __m512d yi  = _mm512_set1_pd(y[i]);
+					const __m512d zi  = _mm512_set1_pd(z[i]);
+					const __m512d gmi = _mm512_set1_pd(gm[i]);
+
+					__m512d sx = zero, sy = zero, sz = zero;
+
+					for (; j + 8 <= j_end; j += 8)
+					{
+						const __m512d dx =
+							_mm512_sub_pd(_mm512_loadu_pd(x + j), xi);
+						const __m512d dy =
+							_mm512_sub_pd(_mm512_loadu_pd(y + j), yi);
+						const __m512d dz =
+							_mm512_sub_pd(_mm512_loadu_pd(z + j), zi);
+
+						__m512d r2 = _mm512_mul_pd(dx, dx);
+						r2 = _mm512_fmadd_pd(dy, dy, r2);
+						r2 = _mm512_fmadd_pd(dz, dz, r2);
+
+						const __mmask8 valid =
+							_mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+
+						const __m512d inv_r3 = _mm512_maskz_div_pd(valid,
+							_mm512_set1_pd(1.0),
+							_mm512_mul_pd(r2, _mm512_sqrt_pd(r2)));
+
+						const __m512d sj =
+							_mm512_mul_pd(_mm512_loadu_pd(gm + j), inv_r3);
+						const __m512d si = _mm512_mul_pd(gmi, inv_r3);
+
+						sx = _mm512_fmadd_pd(sj, dx, sx);
+						sy = _mm512_fmadd_pd(sj, dy, sy);
+						sz = _mm512_fmadd_pd(sj, dz, sz);
+
+						_mm512_storeu_pd(ax + j, _mm512_fnmadd_pd(si, dx,
+							_mm512_loadu_pd(ax + j)));
+						_mm512_storeu_pd(ay + j, _mm512_fnmadd_pd(si, dy,
+							_mm512_loadu_pd(ay + j)));
+						_mm512_storeu_pd(az + j, _mm512_fnmadd_pd(si, dz,
+							_mm512_loadu_pd(az + j)));
+					}
+
+					double lx[8], ly[8], lz[8];
+					_mm512_storeu_pd(lx, sx);
+					_mm512_storeu_pd(ly, sy);
+					_mm512_storeu_pd(lz, sz);
+
+					for (int k = 0; k < 8; k++)
+					{
+						axi += lx[k]; ayi += ly[k]; azi += lz[k];
+					}
+				}
+#elif defined(__AVX2__)
+				{
+					const __m256d zero = _mm256_setzero_pd();
+
+					const __m256d xi  = _mm256_set1_pd(x[i]);
+					const __m256d yi  = _mm256_set1_pd(y[i]);
+					const __m256d zi  = _mm256_set1_pd(z[i]);
+					const __m256d gmi = _mm256_set1_pd(gm[i]);
+
+					__m256d sx = zero, sy = zero, sz = zero;
+
+					for (; j + 4 <= j_end; j += 4)
+					{
+						const __m256d dx =
+							_mm256_sub_pd(_mm256_loadu_pd(x + j), xi);
+						const __m256d dy =
+							_mm256_sub_pd(_mm256_loadu_pd(y + j), yi);
+						const __m256d dz =
+							_mm256_sub_pd(_mm256_loadu_pd(z + j), zi);
+
+						__m256d r2 = _mm256_mul_pd(dx, dx);
+						r2 = _mm256_add_pd(r2, _mm256_mul_pd(dy, dy));
+						r2 = _mm256_add_pd(r2, _mm256_mul_pd(dz, dz));
+
+						const __m256d valid =
+							_mm256_cmp_pd(r2, zero, _CMP_GT_OQ);
+
+						const __m256d inv_r3 = _mm256_and_pd(valid,
+							_mm256_div_pd(_mm256_set1_pd(1.0),
+								_mm256_mul_pd(r2, _mm256_sqrt_pd(r2))));
+
+						const __m256d sj =
+							_mm256_mul_pd(_mm256_loadu_pd(gm + j), inv_r3);
+						const __m256d si = _mm256_mul_pd(gmi, inv_r3);
+
+						sx = _mm256_add_pd(sx, _mm256_mul_pd(sj, dx));
+						sy = _mm256_add_pd(sy, _mm256_mul_pd(sj, dy));
+						sz = _mm256_add_pd(sz, _mm256_mul_pd(sj, dz));
+
+						_mm256_storeu_pd(ax + j, _mm256_sub_pd(
+							_mm256_loadu_pd(ax + j), _mm256_mul_pd(si, dx)));
+						_mm256_storeu_pd(ay + j, _mm256_sub_pd(
+							_mm256_loadu_pd(ay + j), _mm256_mul_pd(si, dy)));
+						_mm256_storeu_pd(az + j, _mm256_sub_pd(
+							_mm256_loadu_pd(az + j), _mm256_mul_pd(si, dz)));
+					}
+
+					double lx[4], ly[4], lz[4];
+					_mm256_storeu_pd(lx, sx);
+					_mm256_storeu_pd(ly, sy);
+					_mm256_storeu_pd(lz, sz);
+
+					for (int k = 0; k < 4; k++)
+					{
+						axi += lx[k]; ayi += ly[k]; azi += lz[k];
+					}
+				}
+#endif
+
+				for (; j < j_end; j++)
+				{
+					const double dx = x[j] - x[i];
+					const double dy = y[j] - y[i];
+					const double dz = z[j] - z[i];
+
+					const double r2 = dx * dx + dy * dy + dz * dz;
+
+					if (r2 == 0.0) continue;
+
+					const double inv_r3 = 1.0 / (r2 * std::sqrt(r2));
+
+					const double sj = gm[j] * inv_r3;
+					const double si = gm[i] * inv_r3;
+
+					axi += sj * dx;
+					ayi += sj * dy;
+					azi += sj * dz;
+
+					ax[j] -= si * dx;
+					ay[j] -= si * dy;
+					az[j] -= si * dz;
+				}
+
+				ax[i] += axi; ay[i] += ayi; az[i] += azi;
+			}
+		}
+
+		/**
+		 * Accumulate in single precision the point-mass accelerations
+		 * that a range of source bodies induce on one target. Positions
+		 * must be given relative to a nearby origin, so that float
+		 * resolution is relative to the separations rather than to the
+		 * distance from the ECI origin. Sources are vectorized across
+		 * SIMD lanes, and the partial sums are flushed into double
+		 * precision every \a block sources to keep float rounding
+		 * from building up over long source lists.
+		 *
+		 * Unlike the double-precision kernels, coincident pairs are not
+		 * checked for; callers only pass sources known to be far from
+		 * the target. The cube of the separation is never formed, as
+		 * it overflows a float beyond about 7e12 m; gm is divided by
+		 * the separation three times instead
+		 *
+		 * @param[in]     x       Source x column, relative to the origin
+		 * @param[in]     y       Source y column, relative to the origin
+		 * @param[in]     z       Source z column, relative to the origin
+		 * @param[in]     gm      Gravitational parameter column
+		 * @param[in]     j_begin First source index
+		 * @param[in]     j_end   One past the last source index
+		 * @param[in]     xi      Target x, relative to the origin
+		 * @param[in]     yi      Target y, relative to the origin
+		 * @param[in]     zi      Target z, relative to the origin
+		 * @param[in,out] ax      Target acceleration x
+		 * @param[in,out] ay      Target acceleration y
+		 * @param[in,out] az      Target acceleration z
+		 */
+		void accumulate_float(const float* x, const float* y,
+			const float* z,
+			const float* gm,
+			size_t j_begin, size_t j_end,
+			float xi, float yi, float zi,
+			double& ax, double& ay, double& az)
+		{
+			const size_t block = 256;
+
+			size_t j = j_begin;
+
+#if defined(__AVX512F__)
+			const __m512 txi = _mm512_set1_ps(xi);
+			const __m512 tyi = _mm512_set1_ps(yi);
+			const __m512 tzi = _mm512_set1_ps(zi);
+
+			while (j + 16 <= j_end)
+			{
+				const size_t end = j + std::min(block,
+					(j_end - j) / 16 * 16);
+
+				__m512 sx = _mm512_setzero_ps();
+				__m512 sy = _mm512_setzero_ps();
+				__m512 sz = _mm512_setzero_ps();
+
+				for (; j < end; j += 16)
+				{
+					const __m512 dx =
+						_mm512_sub_ps(_mm512_loadu_ps(x + j), txi);
+					const __m512 dy =
+						_mm512_sub_ps(_mm512_loadu_ps(y + j), tyi);
+					const __m512 dz =
+						_mm512_sub_ps(_mm512_loadu_ps(z + j), tzi);
+
+					__m512 r2 = _mm512_mul_ps(dx, dx);
+					r2 = _mm512_fmadd_ps(dy, dy, r2);
+					r2 = _mm512_fmadd_ps(dz, dz, r2);
+
+					const __m512 inv_r = _mm512_div_ps(_mm512_set1_ps(1.0f),
+						_mm512_sqrt_ps(r2));
+
+					const __m512 s = _mm512_mul_ps(_mm512_mul_ps(
+						_mm512_mul_ps(_mm512_loadu_ps(gm + j), inv_r),
+						inv_r), inv_r);
+
+					sx = _mm512_fmadd_ps(s, dx, sx);
+					sy = _mm512_fmadd_ps(s, dy, sy);
+					sz = _mm512_fmadd_ps(s, dz, sz);
+				}
+
+				ax += _mm512_reduce_add_pd(_mm512_add_pd(
+					_mm512_cvtps_pd(_mm512_castps512_ps256(sx)),
+					_mm512_cvtps_pd(_mm256_castpd_ps(
+						_mm512_extractf64x4_pd(_mm512_castps_pd(sx), 1)))));
+				ay += _mm512_reduce_add_pd(_mm512_add_pd(
+					_mm512_cvtps_pd(_mm512_castps512_ps256(sy)),
+					_mm512_cvtps_pd(_mm256_castpd_ps(
+						_mm512_extractf64x4_pd(_mm512_castps_pd(sy), 1)))));
+				az += _mm512_reduce_add_pd(_mm512_add_pd(
+					_mm512_cvtps_pd(_mm512_castps512_ps256(sz)),
+					_mm512_cvtps_pd(_mm256_castpd_ps(
+						_mm512_extractf64x4_pd(_mm512_castps_pd(sz), 1)))));
+			}
+#elif defined(__AVX2__)
+			const __m256 txi = _mm256_set1_ps(xi);
+			const __m256 tyi = _mm256_set1_ps(yi);
+			const __m256 tzi = _mm256_set1_ps(zi);
+
+			while (j + 8 <= j_end)
+			{
+				const size_t end = j + std::min(block,
+					(j_end - j) / 8 * 8);
+
+				__m256 sx = _mm256_setzero_ps();
+				__m256 sy = _mm256_setzero_ps();
+				__m256 sz = _mm256_setzero_ps();
+
+				for (; j < end; j += 8)
+				{
+					const __m256 dx =
+						_mm256_sub_ps(_mm256_loadu_ps(x + j), txi);
+					const __m256 dy =
+						_mm256_sub_ps(_mm256_loadu_ps(y + j), tyi);
+					const __m256 dz =
+						_mm256_sub_ps(_mm256_loadu_ps(z + j), tzi);
+
+					__m256 r2 = _mm256_mul_ps(dx, dx);
+					r2 = _mm256_add_ps(r2, _mm256_mul_ps(dy, dy));
+					r2 = _mm256_add_ps(r2, _mm256_mul_ps(dz, dz));
+
+					const __m256 inv_r = _mm256_div_ps(_mm256_set1_ps(1.0f),
+						_mm256_sqrt_ps(r2));
+
+					const __m256 s = _mm256_mul_ps(_mm256_mul_ps(
+						_mm256_mul_ps(_mm256_loadu_ps(gm + j), inv_r),
+						inv_r), inv_r);
+
+					sx = _mm256_add_ps(sx, _mm256_mul_ps(s, dx));
+					sy = _mm256_add_ps(sy, _mm256_mul_ps(s, dy));
+					sz = _mm256_add_ps(sz, _mm256_mul_ps(s, dz));
+				}
+
+				double lx[8], ly[8], lz[8];
+
+				_mm256_storeu_pd(lx, _mm256_cvtps_pd(
+					_mm256_castps256_ps128(sx)));
+				_mm256_storeu_pd(lx + 4, _mm256_cvtps_pd(
+					_mm256_extractf128_ps(sx, 1)));
+				_mm256_storeu_pd(ly, _mm256_cvtps_pd(
+					_mm256_castps256_ps128(sy)));
+				_mm256_storeu_pd(ly + 4, _mm256_cvtps_pd(
+					_mm256_extractf128_ps(sy, 1)));
+				_mm256_storeu_pd(lz, _mm256_cvtps_pd(
+					_mm256_castps256_ps128(sz)));
+				_mm256_storeu_pd(lz + 4, _mm256_cvtps_pd(
+					_mm256_extractf128_ps(sz, 1)));
+
+				for (int k = 0; k < 8; k++)
+				{
+					ax += lx[k]; ay += ly[k]; az += lz[k];
+				}
+			}
+#endif
+
+			float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+
+			for (; j < j_end; j++)
+			{
+				const float dx = x[j] - xi;
+				const float dy = y[j] - yi;
+				const float dz = z[j] - zi;
+
+				const float r2 = dx * dx + dy * dy + dz * dz;
+
+				const float inv_r = 1.0f / std::sqrt(r2);
+
+				const float s = gm[j] * inv_r * inv_r * inv_r;
+
+				sx += s * dx;
+				sy += s * dy;
+				sz += s * dz;
+
+				if ((j - j_begin) % block == block - 1)
+				{
+					ax += sx; ay += sy; az += sz;
+					sx = sy = sz = 0.0f;
+				}
+			}
+
+			ax += sx; ay += sy; az += sz;
+		}
+
+		/**
+		 * Accumulate the gravity gradient of one target, i.e. the
+		 * partial derivatives of the point-mass acceleration that a
+		 * range of sources induce on it with respect to its position:
+		 *
+		 *   G += sum_j GM_j * (3 d d^T / |d|^5 - I / |d|^3)
+		 *
+		 * where d = r_i - r_j. This is the lower left block of the
+		 * Jacobian of the equations of motion, which drives the
+		 * variational equations. Coincident pairs are skipped
+		 *
+		 * @param[in]     x       Position x column
+		 * @param[in]     y       Position y column
+		 * @param[in]     z       Position z column
+		 * @param[in]     gm      Gravitational parameter column
+		 * @param[in]     j_begin First source index
+		 * @param[in]     j_end   One past the last source index
+		 * @param[in]     i       The target index
+		 * @param[in,out] g       The symmetric gradient, 1/s^2, as its
+		 *                        upper triangle xx, xy, xz, yy, yz, zz
+		 */
+		void gradient(const double* x, const double* y,
+			const double* z,
+			const double* gm,
+			size_t j_begin, size_t j_end,
+			size_t i,
+			double* g)
+		{
+			for (size_t j = j_begin; j < j_end; j++)
+			{
+				const double dx = x[i] - x[j];
+				const double dy = y[i] - y[j];
+				const double dz = z[i] - z[j];
+
+				const double r2 = dx * dx + dy * dy + dz * dz;
+
+				if (r2 == 0.0) continue;
+
+				const double inv_r2 = 1.0 / r2;
+				const double s      = gm[j] * inv_r2 / std::sqrt(r2);
+				const double s3     = 3.0 * s * inv_r2;
+
+				g[0] += s3 * dx * dx - s;
+				g[1] += s3 * dx * dy;
+				g[2] += s3 * dx * dz;
+				g[3] += s3 * dy * dy - s;
+				g[4] += s3 * dy * dz;
+				g[5] += s3 * dz * dz - s;
+			}
+		}
+
+		/**
+		 * Get the instruction set the kernels were compiled for
+		 *
+		 * @return "avx512", "avx2" or "scalar"
+		 */
+		const char* isa()
+		{
+#if defined(__AVX512F__)
+			return "avx512";
+#elif defined(__AVX2__)
+			return "avx2";
+#else
+			return "scalar";
+#endif
+		}
+	}
+}
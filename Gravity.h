@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Crescent
+{
+	/**
+	 * Point-mass gravity kernels operating on structure-of-arrays data
+	 * (see \ref BodyArray). The vectorized path is selected at compile
+	 * time: AVX-512 if __AVX512F__ is defined, AVX2 if __AVX2__ is
+	 * defined, and a portable scalar loop otherwise. Single-precision
+	 * kernels fit twice as many lanes per vector
+	 */
+	namespace Gravity
+	{
+		void accumulate(const double* x, const double* y,
+			const double* z,
+			const double* gm,
+			size_t j_begin, size_t j_end,
+			size_t i_begin, size_t i_end,
+			double* ax, double* ay, double* az);
+
+		void accumulate_pairs(const double* x, const double* y,
+			const double* z,
+			const double* gm,
+			size_t i_begin, size_t i_end,
+			size_t j_begin, size_t j_end,
+			double* ax, double* ay, double* az);
+
+		void accumulate_float(const float* x, const float* y,
+			const float* z,
+			const float* gm,
+			size_t j_begin, size_t j_end,
+			float xi, float yi, float zi,
+			double& ax, double& ay, double& az);
+
+		void gradient(const double* x, const double* y,
+			const double* z,
+			const double* gm,
+			size_t j_begin, size_t j_end,
+			size_t i,
+			double* g);
+
+		const char* isa();
+	}
+}
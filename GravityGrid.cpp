@@ -0,0 +1,501 @@
+#if defined(_WIN32) || defined(_WIN64)
+	#include <windows.h>
+#else
+	#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "abort.h"
+#include "GravityGrid.h"
+
+namespace Crescent
+{
+	const char GravityGrid::magic[8] =
+		{ 'C', 'R', 'E', 'S', 'G', 'R', 'I', 'D' };
+
+	/**
+	 * Catmull-Rom weights of the four nodes around a point
+	 *
+	 * @param[in]  t The position of the point between the second and
+	 *               third nodes, from 0 to 1
+	 * @param[out] w The weights of the four nodes
+	 */
+	static void catmull_rom(double t, double* w)
+	{
+		const double t2 = t * t;
+		const double t3 = t2 * t;
+
+		w[0] = 0.5 * (-t3 + 2.0 * t2 - t);
+		w[1] = 0.5 * (3.0 * t3 - 5.0 * t2 + 2.0);
+		w[2] = 0.5 * (-3.0 * t3 + 4.0 * t2 + t);
+		w[3] = 0.5 * (t3 - t2);
+	}
+
+	/**
+	 * Constructor
+	 */
+	GravityGrid::GravityGrid()
+		: _data(nullptr),
+		_field(),
+		_file(),
+		_header(),
+		_samples()
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	GravityGrid::~GravityGrid()
+	{
+	}
+
+	/**
+	 * Interpolate the acceleration due to the terms of degree 2 and up
+	 *
+	 * @param[in]  r The position relative to the body's center of
+	 *               mass, in the body-fixed frame, meters
+	 * @param[out] a The acceleration in the body-fixed frame, m/s^2
+	 *
+	 * @return True on success, or false if \a r lies outside the
+	 *         shell (or no samples are loaded), in which case the
+	 *         field must be evaluated directly
+	 */
+	bool GravityGrid::acceleration(const double* r, double* a) const
+	{
+		if (!_data) return false;
+
+		const double pi = 3.14159265358979323846;
+
+		const size_t nradial = _header.nradial;
+		const size_t nlat    = _header.nlat;
+		const size_t nlon    = _header.nlon;
+
+		const double rho    = std::sqrt(r[0] * r[0] + r[1] * r[1]);
+		const double radius = std::sqrt(rho * rho + r[2] * r[2]);
+
+		const double u = (radius - _header.r0) / _header.dr;
+
+		if (!(u >= 1.0) || u > double(nradial - 2))
+			return false;
+
+		const size_t i = std::min(size_t(u), nradial - 3);
+
+		const double v = std::atan2(rho, r[2]) * (nlat - 1) / pi;
+
+		const size_t j = std::min(size_t(v), nlat - 2);
+
+		double longitude = std::atan2(r[1], r[0]);
+		if (longitude < 0.0) longitude += 2.0 * pi;
+
+		const double w = longitude * nlon / (2.0 * pi);
+
+		const size_t k = std::min(size_t(w), nlon - 1);
+
+		double w_radial[4], w_lat[4], w_lon[4];
+
+		catmull_rom(u - i, w_radial);
+		catmull_rom(v - j, w_lat);
+		catmull_rom(w - k, w_lon);
+
+		/*
+		 * Longitudes of the stencil, and the same across the pole
+		 */
+		size_t lon[4], opposite[4];
+
+		for (size_t c = 0; c < 4; c++)
+		{
+			lon[c]      = (k + nlon - 1 + c) % nlon;
+			opposite[c] = (lon[c] + nlon / 2) % nlon;
+		}
+
+		double sum[3] = { 0.0, 0.0, 0.0 };
+
+		for (size_t p = 0; p < 4; p++)
+		{
+			const size_t shell = i - 1 + p;
+
+			for (size_t q = 0; q < 4; q++)
+			{
+				long lat = long(j) - 1 + long(q);
+
+				const size_t* cols = lon;
+
+				if (lat < 0)
+				{
+					lat  = -lat;
+					cols = opposite;
+				}
+				else if (lat > long(nlat - 1))
+				{
+					lat  = 2 * long(nlat - 1) - lat;
+					cols = opposite;
+				}
+
+				const float* row =
+					_data + 3 * (shell * nlat + size_t(lat)) * nlon;
+
+				const double weight = w_radial[p] * w_lat[q];
+
+				for (size_t c = 0; c < 4; c++)
+				{
+					const float* node = row + 3 * cols[c];
+					const double s = weight * w_lon[c];
+
+					sum[0] += s * node[0];
+					sum[1] += s * node[1];
+					sum[2] += s * node[2];
+				}
+			}
+		}
+
+		a[0] = sum[0];
+		a[1] = sum[1];
+		a[2] = sum[2];
+
+		return true;
+	}
+
+	/**
+	 * Sample the field at every node. This costs one evaluation of the
+	 * full field per node
+	 *
+	 * @param[in] pool Workers to share the nodes among, or null to
+	 *                 sample on the calling thread
+	 *
+	 * @return True on success
+	 */
+	bool GravityGrid::build(ThreadPool* pool)
+	{
+		AbortIfNot(_field, false, "the gravity grid is not initialized");
+
+		_file.close();
+
+		const size_t n = nodes();
+
+		_samples.assign(3 * n, 0.0f);
+
+		auto work = [&](size_t thread)
+		{
+			const size_t nthread = pool ? pool->size() : 1;
+			const size_t chunk   = (n + nthread - 1) / nthread;
+
+			const size_t begin = std::min(n, chunk * thread);
+			const size_t end   = std::min(n, begin + chunk);
+
+			for (size_t node = begin; node < end; node++)
+			{
+				double r[3], a[3];
+
+				_node(node, r);
+				_field->acceleration(r, a, thread);
+
+				for (size_t c = 0; c < 3; c++)
+					_samples[3 * node + c] = float(a[c]);
+			}
+		};
+
+		if (pool)
+			pool->run(work);
+		else
+			work(0);
+
+		_data = _samples.data();
+
+		return true;
+	}
+
+	/**
+	 * Lay out the grid over a shell. The angular resolution applies
+	 * at the reference radius of the field, and the same number of
+	 * nodes per parallel is kept all the way to the poles
+	 *
+	 * @param[in] field   The field to sample
+	 * @param[in] inner   Inner radius of the shell, meters
+	 * @param[in] outer   Outer radius of the shell, meters
+	 * @param[in] spacing The largest distance between neighboring
+	 *                    nodes, meters
+	 *
+	 * @return True on success
+	 */
+	bool GravityGrid::init(Handle<SphericalHarmonics> field,
+		double inner, double outer, double spacing)
+	{
+		AbortIfNot(field, false, "no field to sample");
+
+		AbortIf(!(inner > 0.0) || !(outer > inner) || !(spacing > 0.0),
+			false, "invalid gravity grid: inner = %g, outer = %g, "
+			"spacing = %g", inner, outer, spacing);
+
+		const double pi = 3.14159265358979323846;
+
+		const double shells   = std::ceil((outer - inner) / spacing);
+		const double parallel = std::ceil(pi * field->radius() / spacing);
+
+		AbortIf(shells > 1.0e6 || parallel > 1.0e6, false,
+			"gravity grid spacing %g is too fine", spacing);
+
+		const double dr = (outer - inner) / shells;
+
+		AbortIf(inner - dr <= 0.0, false,
+			"gravity grid shell spacing %g reaches the center", dr);
+
+		_data = nullptr;
+		_field = field;
+		_file.close();
+		_samples.clear();
+
+		std::memset(&_header, 0, sizeof(_header));
+		std::memcpy(_header.magic, magic, sizeof(magic));
+
+		_header.version = version;
+		_header.degree  = uint32_t(field->degree());
+		_header.nradial = uint32_t(shells) + 3;
+		_header.nlat    = std::max(uint32_t(parallel) + 1, uint32_t(3));
+		_header.nlon    = std::max(2 * uint32_t(parallel), uint32_t(4));
+		_header.gm      = field->gm();
+		_header.radius  = field->radius();
+		_header.r0      = inner - dr;
+		_header.dr      = dr;
+
+		return true;
+	}
+
+	/**
+	 * Check, without complaint, whether a file holds a grid of the
+	 * layout given to \ref init(). A grid which does not is simply
+	 * rebuilt, so this is checked before \ref open(), which treats a
+	 * mismatch as an error
+	 *
+	 * @param[in] path The file to check
+	 *
+	 * @return True if the header and length of the file match
+	 */
+	bool GravityGrid::matches(const std::string& path) const
+	{
+		std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+
+		GravityGridHeader header;
+
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+			return false;
+
+		file.seekg(0, std::ios::end);
+
+		const std::streamoff size = file.tellg();
+
+		return _same_layout(header) && size ==
+			std::streamoff(sizeof(header) + 3 * nodes() * sizeof(float));
+	}
+
+	/**
+	 * Get the size of the grid
+	 *
+	 * @return The number of nodes
+	 */
+	size_t GravityGrid::nodes() const
+	{
+		return size_t(_header.nradial) * _header.nlat * _header.nlon;
+	}
+
+	/**
+	 * Map a grid written by \ref write(). The file must have the
+	 * layout given to \ref init(), and the samples it holds at a few
+	 * nodes must match the field
+	 *
+	 * @param[in] path The file to read
+	 *
+	 * @return True on success
+	 */
+	bool GravityGrid::open(const std::string& path)
+	{
+		AbortIfNot(_field, false, "the gravity grid is not initialized");
+
+		_data = _samples.empty() ? nullptr : _samples.data();
+
+		AbortIfNot_2(_file.open(path), false);
+
+		GravityGridHeader header;
+
+		if (_file.size() < sizeof(header))
+		{
+			_file.close();
+			Abort(false, "'%s' is truncated", path.c_str());
+		}
+
+		std::memcpy(&header, _file.data(), sizeof(header));
+
+		if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+			header.version != version)
+		{
+			_file.close();
+			Abort(false, "'%s' is not a gravity grid of version %u",
+				path.c_str(), version);
+		}
+
+		if (!_same_layout(header))
+		{
+			_file.close();
+			Abort(false, "'%s' was built for a different field or grid",
+				path.c_str());
+		}
+
+		const size_t n = nodes();
+
+		if (_file.size() != sizeof(header) + 3 * n * sizeof(float))
+		{
+			_file.close();
+			Abort(false, "'%s' is %zu bytes, expected %zu", path.c_str(),
+				_file.size(), sizeof(header) + 3 * n * sizeof(float));
+		}
+
+		const float* data =
+			reinterpret_cast<const float*>(_file.data() + sizeof(header));
+
+		/*
+		 * Fields of the same degree, GM and radius may still differ in
+		 * their coefficients, so spot check the samples
+		 */
+		for (size_t m = 0; m < 16; m++)
+		{
+			const size_t node = (m * 2654435761u + 12345u) % n;
+
+			double r[3], a[3];
+
+			_node(node, r);
+			_field->acceleration(r, a, 0);
+
+			const double scale = std::sqrt(a[0] * a[0] + a[1] * a[1] +
+				a[2] * a[2]);
+
+			for (size_t c = 0; c < 3; c++)
+			{
+				if (std::abs(data[3 * node + c] - a[c]) > 1.0e-5 * scale)
+				{
+					_file.close();
+					Abort(false, "'%s' does not match the gravity field",
+						path.c_str());
+				}
+			}
+		}
+
+		_data = data;
+		_samples.clear();
+		_samples.shrink_to_fit();
+
+		return true;
+	}
+
+	/**
+	 * Write the grid to file. Other runs may have an older copy of the
+	 * file mapped, so it is never truncated in place: the grid goes to
+	 * a temporary file in the same directory, which is then renamed
+	 * over it
+	 *
+	 * @param[in] path The file to write
+	 *
+	 * @return True on success
+	 */
+	bool GravityGrid::write(const std::string& path) const
+	{
+		AbortIfNot(_data, false, "no gravity grid samples to write");
+
+#if defined(_WIN32) || defined(_WIN64)
+		const std::string temp =
+			path + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+#else
+		const std::string temp =
+			path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+
+		std::ofstream file(temp.c_str(),
+			std::ios::out | std::ios::binary | std::ios::trunc);
+
+		AbortIfNot(file, false, "unable to open '%s'", temp.c_str());
+
+		file.write(reinterpret_cast<const char*>(&_header),
+			sizeof(_header));
+
+		file.write(reinterpret_cast<const char*>(_data),
+			3 * nodes() * sizeof(float));
+
+		file.close();
+
+		if (!file)
+		{
+			std::remove(temp.c_str());
+			Abort(false, "unable to write '%s'", temp.c_str());
+		}
+
+#if defined(_WIN32) || defined(_WIN64)
+		const bool renamed = MoveFileExA(temp.c_str(), path.c_str(),
+			MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		const bool renamed =
+			std::rename(temp.c_str(), path.c_str()) == 0;
+#endif
+
+		if (!renamed)
+		{
+			std::remove(temp.c_str());
+			Abort(false, "unable to replace '%s'", path.c_str());
+		}
+
+		return true;
+	}
+
+	/**
+	 * Get the body-fixed position of a node
+	 *
+	 * @param[in]  node The index of the node
+	 * @param[out] r    The position, meters
+	 */
+	void GravityGrid::_node(size_t node, double* r) const
+	{
+		const double pi = 3.14159265358979323846;
+
+		const size_t nlat = _header.nlat;
+		const size_t nlon = _header.nlon;
+
+		const size_t shell = node / (nlat * nlon);
+		const size_t lat   = (node / nlon) % nlat;
+		const size_t lon   = node % nlon;
+
+		const double radius    = _header.r0 + shell * _header.dr;
+		const double colat     = lat * pi / (nlat - 1);
+		const double longitude = lon * 2.0 * pi / nlon;
+
+		r[0] = radius * std::sin(colat) * std::cos(longitude);
+		r[1] = radius * std::sin(colat) * std::sin(longitude);
+		r[2] = radius * std::cos(colat);
+	}
+
+	/**
+	 * Check whether a header describes a grid of the layout given to
+	 * \ref init()
+	 *
+	 * @param[in] header The header
+	 *
+	 * @return True if it does
+	 */
+	bool GravityGrid::_same_layout(const GravityGridHeader& header) const
+	{
+		return std::memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+			header.version == version           &&
+			header.degree  == _header.degree    &&
+			header.nradial == _header.nradial   &&
+			header.nlat    == _header.nlat      &&
+			header.nlon    == _header.nlon      &&
+			header.gm      == _header.gm        &&
+			header.radius  == _header.radius    &&
+			header.r0      == _header.r0        &&
+			header.dr      == _header.dr;
+	}
+
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "crescent.h"
+#include "MappedFile.h"
+#include "SphericalHarmonics.h"
+#include "ThreadPool.h"
+
+namespace Crescent
+{
+	/**
+	 * Layout of a gravity grid file. All values are stored in native
+	 * byte order:
+	 *
+	 *   header                  see \ref GravityGridHeader
+	 *   samples                 the x, y and z acceleration at every
+	 *                           node, as floats, with longitude varying
+	 *                           fastest, then colatitude, then radius
+	 *
+	 * The header is a multiple of 8 bytes, so the samples are aligned
+	 * when the file is memory mapped
+	 */
+	struct GravityGridHeader
+	{
+		/**
+		 * Identifies the file format; see \ref GravityGrid::magic
+		 */
+		char magic[8];
+
+		/**
+		 * Format version
+		 */
+		uint32_t version;
+
+		/**
+		 * Degree and order of the field that was sampled
+		 */
+		uint32_t degree;
+
+		/**
+		 * The number of shells, including one guard shell at either
+		 * end
+		 */
+		uint32_t nradial;
+
+		/**
+		 * The number of nodes from pole to pole, both included
+		 */
+		uint32_t nlat;
+
+		/**
+		 * The number of nodes around each parallel. Always even
+		 */
+		uint32_t nlon;
+
+		/**
+		 * Unused, keeps the header 8-byte aligned
+		 */
+		uint32_t reserved;
+
+		/**
+		 * Gravitational parameter of the field, m^3/s^2
+		 */
+		double gm;
+
+		/**
+		 * Reference radius of the field, meters
+		 */
+		double radius;
+
+		/**
+		 * Radius of the innermost (guard) shell, meters
+		 */
+		double r0;
+
+		/**
+		 * Distance between shells, meters
+		 */
+		double dr;
+	};
+
+	/**
+	 * @class GravityGrid
+	 *
+	 * Cache of a \ref SphericalHarmonics field sampled once over a
+	 * spherical shell in the body-fixed frame, so that each later
+	 * evaluation is a tricubic interpolation over 4x4x4 nodes rather
+	 * than a sum over every term. Nodes are evenly spaced in radius,
+	 * colatitude and longitude; the stencil wraps around in longitude
+	 * and continues over the poles onto the opposite meridian, so the
+	 * only edges are the inner and outer shells. Each axis is
+	 * interpolated with Catmull-Rom weights, which keep the
+	 * acceleration continuous, with a continuous gradient, from one
+	 * cell to the next.
+	 *
+	 * The grid is meant for a thin shell such as the altitudes of a
+	 * descent: its cost is independent of the degree of the field, but
+	 * its size grows as the square of the angular resolution, which
+	 * must resolve the shortest wavelength 2 pi R / N of the field to
+	 * be accurate. Samples are stored as floats, whose rounding is
+	 * well below the interpolation error, to halve the memory traffic
+	 *
+	 * Grids are written to file once and memory mapped afterwards, so
+	 * repeated runs, and concurrent ones, share a single copy. A file
+	 * is only reused if its layout matches the one requested and a
+	 * handful of its nodes agree with the field
+	 */
+	class GravityGrid
+	{
+
+	public:
+
+		/**
+		 * The eight bytes that begin every file
+		 */
+		static const char magic[8];
+
+		/**
+		 * The current format version
+		 */
+		static const uint32_t version = 1;
+
+		GravityGrid();
+
+		GravityGrid(const GravityGrid& other) = delete;
+
+		GravityGrid& operator=(const GravityGrid& other) = delete;
+
+		~GravityGrid();
+
+		bool acceleration(const double* r, double* a) const;
+
+		bool build(ThreadPool* pool);
+
+		bool init(Handle<SphericalHarmonics> field, double inner,
+			double outer, double spacing);
+
+		bool matches(const std::string& path) const;
+
+		size_t nodes() const;
+
+		bool open(const std::string& path);
+
+		bool write(const std::string& path) const;
+
+	private:
+
+		void _node(size_t node, double* r) const;
+
+		bool _same_layout(const GravityGridHeader& header) const;
+
+		/**
+		 * The samples, either \ref _samples or the contents of
+		 * \ref _file
+		 */
+		const float* _data;
+
+		/**
+		 * The sampled field
+		 */
+		Handle<SphericalHarmonics>
+			_field;
+
+		/**
+		 * The mapped file, if any
+		 */
+		MappedFile _file;
+
+		/**
+		 * The layout of the grid
+		 */
+		GravityGridHeader _header;
+
+		/**
+		 * Samples computed by \ref build(), released once the grid is
+		 * mapped from file
+		 */
+		std::vector<float>
+			_samples;
+	};
+}
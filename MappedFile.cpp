@@ -0,0 +1,152 @@
+#if defined(_WIN32) || defined(_WIN64)
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "abort.h"
+#include "MappedFile.h"
+
+namespace Crescent
+{
+	/**
+	 * Constructor
+	 */
+	MappedFile::MappedFile()
+		: _data(nullptr),
+#if defined(_WIN32) || defined(_WIN64)
+		_file(INVALID_HANDLE_VALUE),
+		_mapping(nullptr),
+#endif
+		_size(0)
+	{
+	}
+
+	/**
+	 * Destructor. Unmaps the file
+	 */
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+	/**
+	 * Unmap the file, if one is mapped
+	 */
+	void MappedFile::close()
+	{
+#if defined(_WIN32) || defined(_WIN64)
+		if (_data)
+			::UnmapViewOfFile(_data);
+
+		if (_mapping)
+			::CloseHandle(_mapping);
+
+		if (_file != INVALID_HANDLE_VALUE)
+			::CloseHandle(_file);
+
+		_file    = INVALID_HANDLE_VALUE;
+		_mapping = nullptr;
+#else
+		if (_data)
+			::munmap(const_cast<char*>(_data), _size);
+#endif
+		_data = nullptr;
+		_size = 0;
+	}
+
+	/**
+	 * Get the contents of the file
+	 *
+	 * @return A pointer to the first byte, or null if nothing is
+	 *         mapped
+	 */
+	const char* MappedFile::data() const
+	{
+		return _data;
+	}
+
+	/**
+	 * Map a file into memory, replacing any file mapped before
+	 *
+	 * @param[in] path The file to map, which must not be empty
+	 *
+	 * @return True on success
+	 */
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+#if defined(_WIN32) || defined(_WIN64)
+		_file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		AbortIf(_file == INVALID_HANDLE_VALUE, false,
+			"unable to open '%s'", path.c_str());
+
+		LARGE_INTEGER size;
+		if (!::GetFileSizeEx(_file, &size) || size.QuadPart == 0)
+		{
+			close();
+			Abort(false, "'%s' is empty", path.c_str());
+		}
+
+		_mapping = ::CreateFileMappingA(_file, nullptr, PAGE_READONLY,
+			0, 0, nullptr);
+
+		if (_mapping)
+		{
+			_data = static_cast<const char*>(::MapViewOfFile(_mapping,
+				FILE_MAP_READ, 0, 0, 0));
+		}
+
+		if (!_data)
+		{
+			close();
+			Abort(false, "unable to map '%s'", path.c_str());
+		}
+
+		_size = size_t(size.QuadPart);
+#else
+		const int fd = ::open(path.c_str(), O_RDONLY);
+
+		AbortIf(fd < 0, false, "unable to open '%s'", path.c_str());
+
+		struct stat info;
+		if (::fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			::close(fd);
+			Abort(false, "'%s' is empty", path.c_str());
+		}
+
+		void* data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED,
+			fd, 0);
+
+		/*
+		 * The mapping stays valid after the descriptor is closed
+		 */
+		::close(fd);
+
+		AbortIf(data == MAP_FAILED, false, "unable to map '%s'",
+			path.c_str());
+
+		_data = static_cast<const char*>(data);
+		_size = size_t(info.st_size);
+#endif
+
+		return true;
+	}
+
+	/**
+	 * Get the length of the file
+	 *
+	 * @return The number of bytes mapped
+	 */
+	size_t MappedFile::size() const
+	{
+		return _size;
+	}
+}
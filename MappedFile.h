@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Crescent
+{
+	/**
+	 * A read-only view of a file mapped into memory. Pages are loaded
+	 * by the operating system on first touch and are shared between
+	 * every process that maps the same file
+	 */
+	class MappedFile
+	{
+
+	public:
+
+		MappedFile();
+
+		MappedFile(const MappedFile& other) = delete;
+
+		MappedFile& operator=(const MappedFile& other) = delete;
+
+		~MappedFile();
+
+		void close();
+
+		const char* data() const;
+
+		bool open(const std::string& path);
+
+		size_t size() const;
+
+	private:
+
+		/**
+		 * Start of the mapping, or null if nothing is mapped
+		 */
+		const char* _data;
+
+#if defined(_WIN32) || defined(_WIN64)
+		/**
+		 * Handle of the open file
+		 */
+		void* _file;
+
+		/**
+		 * Handle of the file mapping object
+		 */
+		void* _mapping;
+#endif
+
+		/**
+		 * The length of the file, in bytes
+		 */
+		size_t _size;
+	};
+}
@@ -0,0 +1,452 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "Octree.h"
+
+namespace Crescent
+{
+	/**
+	 * Spread the low 21 bits of a value so that there are two zero
+	 * bits between each of them
+	 *
+	 * @param[in] v The value to spread
+	 *
+	 * @return The spread value
+	 */
+	static std::uint64_t spread_bits(std::uint64_t v)
+	{
+		v &= 0x1fffff;
+		v = (v | v << 32) & 0x1f00000000ffffULL;
+		v = (v | v << 16) & 0x1f0000ff0000ffULL;
+		v = (v | v <<  8) & 0x100f00f00f00f00fULL;
+		v = (v | v <<  4) & 0x10c30c30c30c30c3ULL;
+		v = (v | v <<  2) & 0x1249249249249249ULL;
+		return v;
+	}
+
+	/**
+	 * Add the quadrupole moment of a point mass to a running sum
+	 *
+	 * @param[in]     gm The point's gravitational parameter
+	 * @param[in]     dx Offset of the point from the expansion center, x
+	 * @param[in]     dy Offset, y
+	 * @param[in]     dz Offset, z
+	 * @param[in,out] q  The sum (xx, yy, zz, xy, xz, yz)
+	 */
+	static void add_quadrupole(double gm, double dx, double dy, double dz,
+		double* q)
+	{
+		const double d2 = dx * dx + dy * dy + dz * dz;
+
+		q[0] += gm * (3 * dx * dx - d2);
+		q[1] += gm * (3 * dy * dy - d2);
+		q[2] += gm * (3 * dz * dz - d2);
+		q[3] += gm * 3 * dx * dy;
+		q[4] += gm * 3 * dx * dz;
+		q[5] += gm * 3 * dy * dz;
+	}
+
+	/**
+	 * Constructor
+	 */
+	Octree::Octree()
+		: _nodes(), _keys(), _order(), _scratch(),
+		_sx(), _sy(), _sz(), _sgm(),
+		_theta(0.5)
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	Octree::~Octree()
+	{
+	}
+
+	/**
+	 * (Re)build the tree over a set of bodies. Storage is reused from
+	 * the previous build
+	 *
+	 * @param[in] x  Position x column
+	 * @param[in] y  Position y column
+	 * @param[in] z  Position z column
+	 * @param[in] gm Gravitational parameter column
+	 * @param[in] n  The number of bodies
+	 */
+	void Octree::build(const double* x, const double* y, const double* z,
+		const double* gm,
+		size_t n)
+	{
+		_nodes.clear();
+
+		_keys.resize(n);
+		_order.resize(n);
+		_sx.resize(n);  _sy.resize(n);  _sz.resize(n);
+		_sgm.resize(n);
+
+		if (n == 0) return;
+
+		/*
+		 * 1. Find the bounding cube
+		 */
+		double lo[3] = { x[0], y[0], z[0] };
+		double hi[3] = { x[0], y[0], z[0] };
+
+		for (size_t i = 1; i < n; i++)
+		{
+			lo[0] = std::min(lo[0], x[i]); hi[0] = std::max(hi[0], x[i]);
+			lo[1] = std::min(lo[1], y[i]); hi[1] = std::max(hi[1], y[i]);
+			lo[2] = std::min(lo[2], z[i]); hi[2] = std::max(hi[2], z[i]);
+		}
+
+		double size = std::max(hi[0] - lo[0],
+			std::max(hi[1] - lo[1], hi[2] - lo[2]));
+
+		if (size <= 0.0) size = 1.0;
+
+		/*
+		 * Pad slightly so the far faces map strictly inside the
+		 * key range
+		 */
+		size *= 1.0 + 1e-9;
+
+		/*
+		 * 2. Sort the bodies along the Morton curve. Ties are broken
+		 *    by index so the order is deterministic
+		 */
+		const double scale = double(1 << key_bits) / size;
+		const std::uint64_t qmax = (1 << key_bits) - 1;
+
+		std::vector< std::pair<std::uint64_t, size_t> >& sorted =
+			_scratch;
+
+		sorted.resize(n);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			const std::uint64_t qx = std::min(qmax,
+				std::uint64_t((x[i] - lo[0]) * scale));
+			const std::uint64_t qy = std::min(qmax,
+				std::uint64_t((y[i] - lo[1]) * scale));
+			const std::uint64_t qz = std::min(qmax,
+				std::uint64_t((z[i] - lo[2]) * scale));
+
+			sorted[i].first = spread_bits(qx) << 2 |
+				spread_bits(qy) << 1 | spread_bits(qz);
+			sorted[i].second = i;
+		}
+
+		std::sort(sorted.begin(), sorted.end());
+
+		for (size_t k = 0; k < n; k++)
+		{
+			const size_t i = sorted[k].second;
+
+			_keys[k]  = sorted[k].first;
+			_order[k] = i;
+
+			_sx[k] = x[i]; _sy[k] = y[i]; _sz[k] = z[i];
+			_sgm[k] = gm[i];
+		}
+
+		/*
+		 * 3. Cut the tree top-down
+		 */
+		Node root;
+		root.begin = 0;
+		root.end   = std::uint32_t(n);
+
+		_nodes.push_back(root);
+
+		_build_node(0, 0, lo[0], lo[1], lo[2], size);
+	}
+
+	/**
+	 * Compute the gravitational acceleration that the bodies in the
+	 * tree induce at a set of target positions. Targets coinciding
+	 * exactly with a body in the tree do not feel that body, so the
+	 * tree's own bodies may be passed as targets
+	 *
+	 * @param[in]  x     Target position x column
+	 * @param[in]  y     Target position y column
+	 * @param[in]  z     Target position z column
+	 * @param[in]  index Indices of the targets to evaluate, or null
+	 *                   to evaluate targets [0, count)
+	 * @param[in]  count The number of targets to evaluate
+	 * @param[out] ax    Acceleration x column
+	 * @param[out] ay    Acceleration y column
+	 * @param[out] az    Acceleration z column
+	 */
+	void Octree::evaluate(const double* x, const double* y, const double* z,
+		const size_t* index,
+		size_t count,
+		double* ax, double* ay, double* az) const
+	{
+		std::uint32_t stack[8 * (key_bits + 1)];
+
+		for (size_t k = 0; k < count; k++)
+		{
+			const size_t i = index ? index[k] : k;
+
+			const double xi = x[i], yi = y[i], zi = z[i];
+
+			double axi = 0.0, ayi = 0.0, azi = 0.0;
+
+			int top = 0;
+			if (!_nodes.empty()) stack[top++] = 0;
+
+			while (top > 0)
+			{
+				const Node& node = _nodes[stack[--top]];
+
+				const double dx = node.cx - xi;
+				const double dy = node.cy - yi;
+				const double dz = node.cz - zi;
+
+				const double r2 = dx * dx + dy * dy + dz * dz;
+
+				if (r2 > node.open2)
+				{
+					const double* q = node.q;
+
+					const double inv_r3 = 1.0 / (r2 * std::sqrt(r2));
+					const double inv_r5 = inv_r3 / r2;
+
+					const double qx = q[0] * dx + q[3] * dy + q[4] * dz;
+					const double qy = q[3] * dx + q[1] * dy + q[5] * dz;
+					const double qz = q[4] * dx + q[5] * dy + q[2] * dz;
+
+					const double qdd = dx * qx + dy * qy + dz * qz;
+
+					const double s =
+						node.gm * inv_r3 + 2.5 * qdd * inv_r5 / r2;
+
+					axi += s * dx - inv_r5 * qx;
+					ayi += s * dy - inv_r5 * qy;
+					azi += s * dz - inv_r5 * qz;
+				}
+				else if (node.nchild == 0)
+				{
+					for (std::uint32_t b = node.begin; b < node.end; b++)
+					{
+						const double bx = _sx[b] - xi;
+						const double by = _sy[b] - yi;
+						const double bz = _sz[b] - zi;
+
+						const double b2 = bx * bx + by * by + bz * bz;
+
+						if (b2 == 0.0) continue;
+
+						const double s = _sgm[b] / (b2 * std::sqrt(b2));
+
+						axi += s * bx;
+						ayi += s * by;
+						azi += s * bz;
+					}
+				}
+				else
+				{
+					for (std::uint32_t c = 0; c < node.nchild; c++)
+						stack[top++] = node.child + c;
+				}
+			}
+
+			ax[i] = axi; ay[i] = ayi; az[i] = azi;
+		}
+	}
+
+	/**
+	 * Get the Morton order of the bodies from the last build. Walking
+	 * targets in this order keeps neighboring traversals coherent
+	 *
+	 * @return The original index of each body, in Morton order
+	 */
+	const std::vector<size_t>& Octree::order() const
+	{
+		return _order;
+	}
+
+	/**
+	 * Set the opening angle. Takes effect on the next \ref build()
+	 *
+	 * @param[in] theta The opening angle (radians). Zero forces the
+	 *                  exact direct sum. Must not exceed 1, which
+	 *                  guarantees that a target always opens the cell
+	 *                  containing it
+	 *
+	 * @return True on success
+	 */
+	bool Octree::set_theta(double theta)
+	{
+		if (theta < 0.0 || theta > 1.0) return false;
+
+		_theta = theta;
+		return true;
+	}
+
+	/**
+	 * Get the number of cells in the tree
+	 *
+	 * @return The node count
+	 */
+	size_t Octree::size() const
+	{
+		return _nodes.size();
+	}
+
+	/**
+	 * Split a cell into its occupied octants (recursively), then fill
+	 * in its center of mass and opening distance
+	 *
+	 * @param[in] node  Index of the cell in \ref _nodes
+	 * @param[in] depth Depth of the cell; the root is at depth 0
+	 * @param[in] ox    Lower x corner of the cell
+	 * @param[in] oy    Lower y corner of the cell
+	 * @param[in] oz    Lower z corner of the cell
+	 * @param[in] size  Edge length of the cell
+	 */
+	void Octree::_build_node(std::uint32_t node, int depth,
+		double ox, double oy, double oz,
+		double size)
+	{
+		const std::uint32_t begin = _nodes[node].begin;
+		const std::uint32_t end   = _nodes[node].end;
+
+		double gm = 0.0, cx = 0.0, cy = 0.0, cz = 0.0;
+
+		if (end - begin <= leaf_size || depth == key_bits)
+		{
+			_nodes[node].child  = 0;
+			_nodes[node].nchild = 0;
+
+			for (std::uint32_t b = begin; b < end; b++)
+			{
+				gm += _sgm[b];
+				cx += _sgm[b] * _sx[b];
+				cy += _sgm[b] * _sy[b];
+				cz += _sgm[b] * _sz[b];
+			}
+		}
+		else
+		{
+			const int shift = 3 * (key_bits - 1 - depth);
+
+			const std::uint32_t first =
+				std::uint32_t(_nodes.size());
+
+			/*
+			 * Keys are sorted, so each occupied octant is a
+			 * contiguous run
+			 */
+			std::uint32_t b = begin;
+
+			while (b < end)
+			{
+				const std::uint64_t octant = (_keys[b] >> shift) & 7;
+
+				const std::uint32_t e = std::uint32_t(
+					std::partition_point(
+						_keys.begin() + b, _keys.begin() + end,
+						[=](std::uint64_t key) {
+							return ((key >> shift) & 7) == octant;
+						}) - _keys.begin());
+
+				Node child;
+				child.begin = b;
+				child.end   = e;
+
+				_nodes.push_back(child);
+				b = e;
+			}
+
+			const std::uint32_t nchild =
+				std::uint32_t(_nodes.size()) - first;
+
+			_nodes[node].child  = first;
+			_nodes[node].nchild = nchild;
+
+			const double half = size / 2;
+
+			for (std::uint32_t c = first; c < first + nchild; c++)
+			{
+				const std::uint64_t octant =
+					(_keys[_nodes[c].begin] >> shift) & 7;
+
+				_build_node(c, depth + 1,
+					ox + ((octant >> 2) & 1) * half,
+					oy + ((octant >> 1) & 1) * half,
+					oz + ((octant >> 0) & 1) * half, half);
+
+				gm += _nodes[c].gm;
+				cx += _nodes[c].gm * _nodes[c].cx;
+				cy += _nodes[c].gm * _nodes[c].cy;
+				cz += _nodes[c].gm * _nodes[c].cz;
+			}
+		}
+
+		/*
+		 * Massless cells sit at their geometric center; they exert
+		 * no pull either way
+		 */
+		const double gx = ox + size / 2;
+		const double gy = oy + size / 2;
+		const double gz = oz + size / 2;
+
+		Node& cell = _nodes[node];
+
+		cell.gm = gm;
+
+		if (gm > 0.0)
+		{
+			cell.cx = cx / gm; cell.cy = cy / gm; cell.cz = cz / gm;
+		}
+		else
+		{
+			cell.cx = gx; cell.cy = gy; cell.cz = gz;
+		}
+
+		for (int k = 0; k < 6; k++)
+			cell.q[k] = 0.0;
+
+		if (cell.nchild == 0)
+		{
+			for (std::uint32_t b = begin; b < end; b++)
+			{
+				add_quadrupole(_sgm[b], _sx[b] - cell.cx,
+					_sy[b] - cell.cy, _sz[b] - cell.cz, cell.q);
+			}
+		}
+		else
+		{
+			for (std::uint32_t c = cell.child;
+				c < cell.child + cell.nchild; c++)
+			{
+				const Node& child = _nodes[c];
+
+				for (int k = 0; k < 6; k++)
+					cell.q[k] += child.q[k];
+
+				add_quadrupole(child.gm, child.cx - cell.cx,
+					child.cy - cell.cy, child.cz - cell.cz, cell.q);
+			}
+		}
+
+		if (_theta > 0.0)
+		{
+			const double delta = std::sqrt(
+				(cell.cx - gx) * (cell.cx - gx) +
+				(cell.cy - gy) * (cell.cy - gy) +
+				(cell.cz - gz) * (cell.cz - gz));
+
+			const double r_open = size / _theta + delta;
+
+			cell.open2 = r_open * r_open;
+		}
+		else
+		{
+			cell.open2 = std::numeric_limits<double>::infinity();
+		}
+	}
+}
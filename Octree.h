@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * @class Octree
+	 *
+	 * Barnes-Hut tree over a set of point masses. Bodies are sorted
+	 * along a Morton (Z-order) curve and the tree is cut top-down from
+	 * the sorted keys, so every node owns a contiguous range of bodies
+	 * and all children of a node are stored next to each other.
+	 *
+	 * A node is replaced by its monopole and quadrupole moments about
+	 * its center of mass when, seen from the target, it subtends an
+	 * angle smaller than the opening angle theta. The criterion is
+	 *
+	 *   d > s / theta + delta
+	 *
+	 * where d is the distance from the target to the center of mass,
+	 * s the edge length of the cell and delta the offset between the
+	 * center of mass and the cell's geometric center (this guards
+	 * against lopsided cells). theta = 0 reduces to the direct sum
+	 */
+	class Octree
+	{
+		/**
+		 * A cell of the tree
+		 */
+		struct Node
+		{
+			/**
+			 * Center of mass
+			 */
+			double cx, cy, cz;
+
+			/**
+			 * Total gravitational parameter of all bodies in
+			 * this cell
+			 */
+			double gm;
+
+			/**
+			 * Quadrupole moment about the center of mass,
+			 * sum of gm * (3 d d^T - |d|^2 I), stored as
+			 * xx, yy, zz, xy, xz, yz
+			 */
+			double q[6];
+
+			/**
+			 * Squared opening distance: the cell may be used as a
+			 * point mass by targets farther than this from its
+			 * center of mass
+			 */
+			double open2;
+
+			/**
+			 * Range of bodies in Morton order owned by this cell
+			 */
+			std::uint32_t begin, end;
+
+			/**
+			 * Index of the first child, and the number of children
+			 * (0 for a leaf)
+			 */
+			std::uint32_t child, nchild;
+		};
+
+	public:
+
+		/**
+		 * Cells with this many bodies or fewer are not split
+		 */
+		static const size_t leaf_size = 8;
+
+		/**
+		 * Number of bits per axis in a Morton key
+		 */
+		static const int key_bits = 21;
+
+		Octree();
+
+		~Octree();
+
+		void build(const double* x, const double* y, const double* z,
+			const double* gm,
+			size_t n);
+
+		void evaluate(const double* x, const double* y, const double* z,
+			const size_t* index,
+			size_t count,
+			double* ax, double* ay, double* az) const;
+
+		const std::vector<size_t>& order() const;
+
+		bool set_theta(double theta);
+
+		size_t size() const;
+
+	private:
+
+		void _build_node(std::uint32_t node, int depth,
+			double ox, double oy, double oz,
+			double size);
+
+		/**
+		 * The tree cells. The root is at index 0
+		 */
+		std::vector<Node> _nodes;
+
+		/**
+		 * Morton keys of the bodies, in sorted order
+		 */
+		std::vector<std::uint64_t>
+			_keys;
+
+		/**
+		 * Original index of each body, in Morton order
+		 */
+		std::vector<size_t>
+			_order;
+
+		/**
+		 * (key, index) pairs used for sorting
+		 */
+		std::vector< std::pair<std::uint64_t, size_t> >
+			_scratch;
+
+		/**
+		 * Body positions and gravitational parameters, in Morton
+		 * order
+		 */
+		std::vector<double> _sx, _sy, _sz, _sgm;
+
+		/**
+		 * The opening angle
+		 */
+		double _theta;
+	};
+}
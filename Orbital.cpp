@@ -7,7 +7,8 @@ namespace Crescent
 	 */
 	Orbital::Orbital()
 		: Event("Orbital"),
-		_data(), _ids(), _is_init(false), _name2mass()
+		_data(), _ids(), _is_init(false), _mass_threshold(0.0),
+		_massless(), _name2mass()
 	{
 	}
 
@@ -66,13 +67,25 @@ namespace Crescent
 	 */
 	bool Orbital::exists(const std::string& name) const
 	{
-		for (auto iter = _name2mass.begin(), end = _name2mass.end();
-			iter != end; ++iter)
-		{
-			if (Util::trim(name) == iter->first) return true;
-		}
+		return _name2mass.find(Util::trim(name)) != _name2mass.end();
+	}
 
-		return false;
+	/**
+	 * Set the mass below which objects are treated as massless test
+	 * particles. Must be called before \ref init()
+	 *
+	 * @param[in] mass The threshold, kilograms. Zero (the default)
+	 *                 leaves every object massive unless flagged
+	 *                 otherwise in the masses config file
+	 *
+	 * @return True on success
+	 */
+	bool Orbital::set_mass_threshold(double mass)
+	{
+		AbortIf_2(_is_init || mass < 0.0, false);
+
+		_mass_threshold = mass;
+		return true;
 	}
 
 	/**
@@ -102,6 +115,9 @@ namespace Crescent
 			object.mass = iter->second;
 			object.name = iter->first;
 
+			object.massive = _massless.count(iter->first) == 0 &&
+				iter->second >= _mass_threshold;
+
 			dir = dir->subdir("telemetry");
 			AbortIfNot_2(dir, false);
 
@@ -144,6 +160,18 @@ namespace Crescent
 					false);
 			}
 
+			if (tokens.size() > 2)
+			{
+				const std::string type =
+					Util::to_lower(Util::trim(tokens[2]));
+
+				AbortIf(type != "massive" && type != "massless", false,
+					"unknown body type '%s'", tokens[2].c_str());
+
+				if (type == "massless")
+					_massless.insert(Util::trim(tokens[0]));
+			}
+
 			if (tokens.size() > 0)
 			{
 				AbortIf_2(exists(tokens[0]),
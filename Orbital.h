@@ -1,6 +1,7 @@
 #pragma once
 
 #include <map>
+#include <set>
 #include <vector>
 
 #include "EphemerisObject.h"
@@ -55,6 +56,8 @@ namespace Crescent
 
 		bool exists(const std::string& name) const;
 
+		bool set_mass_threshold(double mass);
+
 	private:
 
 		bool _init_shared();
@@ -78,6 +81,19 @@ namespace Crescent
 		 */
 		bool _is_init;
 
+		/**
+		 * Objects lighter than this (kilograms) are treated as
+		 * massless test particles
+		 */
+		double _mass_threshold;
+
+		/**
+		 * Names of objects flagged as massless in the masses
+		 * config file
+		 */
+		std::set<std::string>
+			_massless;
+
 		/**
 		 * Maps an object's name to its mass per the
 		 * masses config file
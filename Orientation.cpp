@@ -0,0 +1,144 @@
+#include <cmath>
+
+#include "Orientation.h"
+#include "str_util.h"
+
+namespace Crescent
+{
+	/**
+	 * Frame rotation about the x axis
+	 *
+	 * @param[in] angle The rotation angle, radians
+	 *
+	 * @return The direction cosine matrix
+	 */
+	static Matrix<3, 3> rotate_x(double angle)
+	{
+		const double c = std::cos(angle), s = std::sin(angle);
+
+		const double data[9] = {
+			1.0, 0.0, 0.0,
+			0.0,   c,   s,
+			0.0,  -s,   c };
+
+		return Matrix<3, 3>(data);
+	}
+
+	/**
+	 * Frame rotation about the z axis
+	 *
+	 * @param[in] angle The rotation angle, radians
+	 *
+	 * @return The direction cosine matrix
+	 */
+	static Matrix<3, 3> rotate_z(double angle)
+	{
+		const double c = std::cos(angle), s = std::sin(angle);
+
+		const double data[9] = {
+			  c,   s, 0.0,
+			 -s,   c, 0.0,
+			0.0, 0.0, 1.0 };
+
+		return Matrix<3, 3>(data);
+	}
+
+	/**
+	 * Constructor
+	 */
+	Orientation::Orientation()
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	Orientation::~Orientation()
+	{
+	}
+
+	/**
+	 * Create an orientation model from its description in the
+	 * harmonics config file. The only model built in is
+	 *
+	 *   uniform <alpha> <delta> <W0> <Wdot>
+	 *
+	 * in degrees and degrees/day (see \ref UniformRotation)
+	 *
+	 * @param[in] tokens The model name followed by its parameters
+	 *
+	 * @return The model, or null on error
+	 */
+	Handle<Orientation> Orientation::create(
+		const std::vector<std::string>& tokens)
+	{
+		AbortIf(tokens.empty(), Handle<Orientation>(),
+			"missing orientation model");
+
+		const std::string model = Util::to_lower(tokens[0]);
+
+		if (model == "uniform")
+		{
+			AbortIf(tokens.size() != 5, Handle<Orientation>(),
+				"the uniform orientation model takes 4 parameters");
+
+			double values[4];
+
+			for (int i = 0; i < 4; i++)
+			{
+				AbortIfNot(Util::from_string<double>(tokens[i + 1],
+					values[i]), Handle<Orientation>(),
+					"invalid orientation parameter '%s'",
+					tokens[i + 1].c_str());
+			}
+
+			return Handle<Orientation>(new UniformRotation(
+				values[0], values[1], values[2], values[3]));
+		}
+
+		Abort(Handle<Orientation>(), "unknown orientation model '%s'",
+			tokens[0].c_str());
+	}
+
+	/**
+	 * Constructor
+	 *
+	 * @param[in] alpha Right ascension of the pole, degrees
+	 * @param[in] delta Declination of the pole, degrees
+	 * @param[in] w0    Prime meridian angle at the start of the
+	 *                  simulation, degrees
+	 * @param[in] w_dot Rotation rate, degrees/day
+	 */
+	UniformRotation::UniformRotation(double alpha, double delta,
+		double w0, double w_dot)
+		: Orientation(), _pole(), _w0(0.0), _w_dot(0.0)
+	{
+		const double deg = 0.0174532925199432958;
+
+		_pole = rotate_x((90.0 - delta) * deg) *
+			rotate_z((90.0 + alpha) * deg);
+
+		_w0    = w0 * deg;
+		_w_dot = w_dot * deg / 86400.0;
+	}
+
+	/**
+	 * Destructor
+	 */
+	UniformRotation::~UniformRotation()
+	{
+	}
+
+	/**
+	 * Get the rotation from the inertial frame to the body-fixed
+	 * frame
+	 *
+	 * @param[in] t The simulation time, seconds
+	 *
+	 * @return The direction cosine matrix
+	 */
+	Matrix<3, 3> UniformRotation::to_fixed(double t) const
+	{
+		return rotate_z(_w0 + _w_dot * t) * _pole;
+	}
+}
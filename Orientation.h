@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "crescent.h"
+#include "Matrix.h"
+
+namespace Crescent
+{
+	/**
+	 * @class Orientation
+	 *
+	 * Interface to a model of a body's orientation, giving the rotation
+	 * from the inertial (ECI J2000) frame to the body-fixed frame in
+	 * which its gravity field is defined. Models are selected by name
+	 * in the harmonics config file through \ref create(), or supplied
+	 * directly with EphemerisManager::set_orientation()
+	 */
+	class Orientation
+	{
+
+	public:
+
+		Orientation();
+
+		virtual ~Orientation();
+
+		static Handle<Orientation> create(
+			const std::vector<std::string>& tokens);
+
+		/**
+		 * Get the rotation from the inertial frame to the body-fixed
+		 * frame
+		 *
+		 * @param[in] t The simulation time, seconds
+		 *
+		 * @return The direction cosine matrix, such that
+		 *         r_fixed = R * r_inertial
+		 */
+		virtual Matrix<3, 3> to_fixed(double t) const = 0;
+	};
+
+	/**
+	 * @class UniformRotation
+	 *
+	 * Rotation at a constant rate about a fixed pole, in the form of
+	 * the IAU rotational elements without their periodic terms. The
+	 * pole has right ascension alpha and declination delta, and the
+	 * prime meridian is at
+	 *
+	 *   W = W0 + Wdot * d
+	 *
+	 * from the ascending node of the body's equator on the inertial
+	 * equator, with d the time in days since the start of the
+	 * simulation. Then
+	 *
+	 *   R = Rz(W) Rx(90 - delta) Rz(90 + alpha)
+	 *
+	 * For the Moon, the neglected physical librations reach a few
+	 * hundredths of a degree
+	 */
+	class UniformRotation : public Orientation
+	{
+
+	public:
+
+		UniformRotation(double alpha, double delta, double w0,
+			double w_dot);
+
+		~UniformRotation();
+
+		Matrix<3, 3> to_fixed(double t) const;
+
+	private:
+
+		/**
+		 * Rz(90 + alpha), then Rx(90 - delta), which do not change
+		 * over time
+		 */
+		Matrix<3, 3> _pole;
+
+		/**
+		 * Prime meridian angle at the start of the simulation,
+		 * radians
+		 */
+		double _w0;
+
+		/**
+		 * Rotation rate, radians/second
+		 */
+		double _w_dot;
+	};
+}
@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cmath>
+
+#include "abort.h"
+#include "Parareal.h"
+
+namespace Crescent
+{
+	/**
+	 * Constructor
+	 */
+	Parareal::Parareal()
+		: _atol(1e-6),
+		_coarse(),
+		_fine(),
+		_iterations(0),
+		_rtol(1e-12),
+		_size(0),
+		_start(),
+		_status(),
+		_work()
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	Parareal::~Parareal()
+	{
+	}
+
+	/**
+	 * Get the number of iterations taken by the last call to
+	 * \ref solve()
+	 *
+	 * @return The number of fine sweeps
+	 */
+	int Parareal::iterations() const
+	{
+		return _iterations;
+	}
+
+	/**
+	 * Set the length of the state and the number of slices
+	 *
+	 * @param[in] size   The number of elements in the state
+	 * @param[in] slices The number of slices each span is cut into
+	 *
+	 * @return True on success
+	 */
+	bool Parareal::resize(size_t size, size_t slices)
+	{
+		AbortIf(slices < 1, false, "invalid Parareal slice count: %zu",
+			slices);
+
+		_coarse.assign(slices * size, 0.0);
+		_fine.assign(slices * size, 0.0);
+		_start.assign((slices + 1) * size, 0.0);
+		_status.assign(slices, 0);
+		_work.assign(size, 0.0);
+
+		_size = size;
+		return true;
+	}
+
+	/**
+	 * Set when the iterations have converged: once no element of the
+	 * state at the start of any slice moves by more than
+	 * atol + rtol * |x| from one iteration to the next
+	 *
+	 * @param[in] rtol The relative tolerance
+	 * @param[in] atol The absolute tolerance
+	 *
+	 * @return True on success
+	 */
+	bool Parareal::set_tolerance(double rtol, double atol)
+	{
+		AbortIf(!(rtol >= 0.0) || !(atol >= 0.0) ||
+			!(rtol + atol > 0.0), false,
+			"invalid tolerance: rtol = %g, atol = %g", rtol, atol);
+
+		_atol = atol;
+		_rtol = rtol;
+
+		return true;
+	}
+
+	/**
+	 * Get the number of slices
+	 *
+	 * @return The number set by \ref resize()
+	 */
+	size_t Parareal::slices() const
+	{
+		return _status.size();
+	}
+
+	/**
+	 * Propagate a state across a span of time. Slice k runs from
+	 * t0 + k * (t1 - t0) / slices to the start of slice k + 1. On
+	 * return, the last call to the fine propagator for each slice was
+	 * made from a start within the tolerance of the converged one
+	 *
+	 * @param[in] coarse The coarse propagator, called serially
+	 * @param[in] fine   The fine propagator, called concurrently for
+	 *                   different slices
+	 * @param[in] t0     The start of the span
+	 * @param[in] t1     The end of the span
+	 * @param[in] x0     The state at \a t0
+	 * @param[in] pool   Workers to share the slices among, or null to
+	 *                   propagate them on the calling thread
+	 *
+	 * @return True on success
+	 */
+	bool Parareal::solve(const Propagator& coarse, const Propagator& fine,
+		double t0, double t1, const double* x0, ThreadPool* pool)
+	{
+		const size_t n      = _size;
+		const size_t slices = _status.size();
+
+		AbortIf(slices == 0, false, "Parareal is not sized");
+
+		auto time = [&](size_t k) {
+			return k == slices ? t1 : t0 + k * (t1 - t0) / slices;
+		};
+
+		double* start = _start.data();
+
+		std::copy(x0, x0 + n, start);
+
+		/*
+		 * The first guess comes from the coarse propagator alone
+		 */
+		for (size_t k = 0; k < slices; k++)
+		{
+			double* next = start + (k + 1) * n;
+
+			std::copy(start + k * n, start + (k + 1) * n, next);
+
+			AbortIfNot(coarse(k, time(k), time(k + 1), next), false,
+				"coarse propagation of slice %zu failed", k);
+
+			std::copy(next, next + n, &_coarse[k * n]);
+		}
+
+		for (_iterations = 1; ; _iterations++)
+		{
+			/*
+			 * Slices before this one start from exact states, and
+			 * have already been propagated from them
+			 */
+			const size_t first = _iterations - 1;
+
+			for (size_t k = first; k < slices; k++)
+			{
+				std::copy(start + k * n, start + (k + 1) * n,
+					&_fine[k * n]);
+			}
+
+			auto work = [&](size_t thread)
+			{
+				const size_t nthread = pool ? pool->size() : 1;
+
+				for (size_t k = first + thread; k < slices; k += nthread)
+				{
+					_status[k] =
+						fine(k, time(k), time(k + 1), &_fine[k * n]);
+				}
+			};
+
+			if (pool)
+				pool->run(work);
+			else
+				work(0);
+
+			for (size_t k = first; k < slices; k++)
+			{
+				AbortIfNot(_status[k], false,
+					"fine propagation of slice %zu failed", k);
+			}
+
+			/*
+			 * Sweep the corrections forward. The start of the first
+			 * slice has not moved, so its coarse solution is unchanged
+			 */
+			bool converged = true;
+
+			for (size_t k = first; k < slices; k++)
+			{
+				double* g = &_coarse[k * n];
+
+				if (k > first)
+				{
+					std::copy(start + k * n, start + (k + 1) * n,
+						_work.data());
+
+					AbortIfNot(coarse(k, time(k), time(k + 1),
+						_work.data()), false,
+						"coarse propagation of slice %zu failed", k);
+				}
+				else
+				{
+					std::copy(g, g + n, _work.data());
+				}
+
+				double* next = start + (k + 1) * n;
+
+				for (size_t i = 0; i < n; i++)
+				{
+					const double x = _work[i] + _fine[k * n + i] - g[i];
+
+					if (std::abs(x - next[i]) > _atol +
+						_rtol * std::abs(x))
+					{
+						converged = false;
+					}
+
+					next[i] = x;
+					g[i]    = _work[i];
+				}
+			}
+
+			if (converged || size_t(_iterations) == slices)
+				break;
+		}
+
+		return true;
+	}
+}
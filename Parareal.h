@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace Crescent
+{
+	/**
+	 * @class Parareal
+	 *
+	 * Solves an initial value problem over a span of time by cutting it
+	 * into slices which are propagated in parallel. A cheap coarse
+	 * propagator G first guesses the state at the start of every
+	 * slice, one after another. Each iteration then runs the accurate
+	 * fine propagator F over every slice at once, from the current
+	 * guesses, and sweeps the corrections forward with
+	 *
+	 *   U[k + 1] = G(U_new[k]) + F(U_old[k]) - G(U_old[k])
+	 *
+	 * so the cost of each iteration is that of one slice of F plus a
+	 * serial sweep of G. After j iterations the first j slices are
+	 * exactly those of a serial run of F, so the method never takes
+	 * more iterations than there are slices; with a good coarse
+	 * propagator it converges in two or three. See J.-L. Lions, Y.
+	 * Maday and G. Turinici, "A 'parareal' in time discretization of
+	 * PDE's", C. R. Acad. Sci. Paris 332 (2001).
+	 *
+	 * The fine propagator is called concurrently for different slices,
+	 * and must keep any state of its own per slice
+	 */
+	class Parareal
+	{
+
+	public:
+
+		/**
+		 * Propagates the state in place from one time to another. It
+		 * is passed the index of the slice, the start and end times
+		 * and the state, and returns true on success
+		 */
+		using Propagator =
+			std::function<bool(size_t, double, double, double*)>;
+
+		Parareal();
+
+		~Parareal();
+
+		int iterations() const;
+
+		bool resize(size_t size, size_t slices);
+
+		bool set_tolerance(double rtol, double atol);
+
+		size_t slices() const;
+
+		bool solve(const Propagator& coarse, const Propagator& fine,
+			double t0, double t1, const double* x0, ThreadPool* pool);
+
+	private:
+
+		/**
+		 * The absolute tolerance of convergence
+		 */
+		double _atol;
+
+		/**
+		 * The coarse solution over each slice from the latest
+		 * guess at its start, slices x size
+		 */
+		std::vector<double>
+			_coarse;
+
+		/**
+		 * The fine solution over each slice, slices x size
+		 */
+		std::vector<double>
+			_fine;
+
+		/**
+		 * The number of iterations taken by the last solve
+		 */
+		int _iterations;
+
+		/**
+		 * The relative tolerance of convergence
+		 */
+		double _rtol;
+
+		/**
+		 * The length of the state
+		 */
+		size_t _size;
+
+		/**
+		 * The guessed state at the start of each slice and at the
+		 * end of the last, (slices + 1) x size
+		 */
+		std::vector<double>
+			_start;
+
+		/**
+		 * Whether the fine propagator succeeded on each slice
+		 */
+		std::vector<char>
+			_status;
+
+		/**
+		 * Work space for one state
+		 */
+		std::vector<double>
+			_work;
+	};
+}
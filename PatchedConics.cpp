@@ -0,0 +1,566 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "crescent.h"
+#include "PatchedConics.h"
+#include "RootFinding.h"
+
+namespace Crescent
+{
+	/**
+	 * Don't check for sphere of influence crossings more often than
+	 * this, seconds. Crossings can only be missed if a spacecraft dips
+	 * in and out of a sphere within this time
+	 */
+	static const double min_step = 1.0;
+
+	/**
+	 * Sphere of influence crossing times are located to within this,
+	 * seconds
+	 */
+	static const double tolerance = 1e-3;
+
+	/**
+	 * Constructor
+	 */
+	PatchedConics::PatchedConics()
+		: _batch(),
+		_batch_mu(),
+		_children(),
+		_gm(),
+		_kepler(),
+		_mu(),
+		_names(),
+		_order(),
+		_primaries(),
+		_soi(),
+		_states(),
+		_t0(0.0)
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	PatchedConics::~PatchedConics()
+	{
+	}
+
+	/**
+	 * Get the absolute state of a body
+	 *
+	 * @param[in]  body The index of the body
+	 * @param[in]  t    The time, seconds
+	 * @param[out] r    Position, meters, 3 elements
+	 * @param[out] v    Velocity, meters/second, 3 elements
+	 *
+	 * @return True on success
+	 */
+	bool PatchedConics::body_state(size_t body, double t, double* r,
+		double* v) const
+	{
+		AbortIf_2(body >= _names.size(), false);
+
+		for (size_t k = 0; k < 3; k++)
+			r[k] = v[k] = 0.0;
+
+		/*
+		 * Walk up to the root, adding up the relative states along
+		 * the way
+		 */
+		for (size_t i = body; ; i = _primaries[i])
+		{
+			double ri[3], vi[3];
+			AbortIfNot_2(_relative_state(i, t, ri, vi), false);
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				r[k] += ri[k];
+				v[k] += vi[k];
+			}
+
+			if (_primaries[i] == i) break;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Get the absolute states of all bodies at once. The relative
+	 * conics are solved together in one batch
+	 *
+	 * @param[in]  t      The time, seconds
+	 * @param[out] x      The x|y|z|vx|vy|vz columns, whose first
+	 *                    entries receive the bodies in the order
+	 *                    passed to \ref init()
+	 * @param[in]  stride The length of each column, at least the
+	 *                    number of bodies
+	 *
+	 * @return True on success
+	 */
+	bool PatchedConics::body_states(double t, double* x, size_t stride)
+	{
+		const size_t n = _order.size();
+
+		AbortIf_2(stride < _names.size(), false);
+
+		for (size_t j = 0; j < n; j++)
+		{
+			for (size_t k = 0; k < 6; k++)
+				_batch[k * n + j] = _states[6 * _order[j] + k];
+		}
+
+		AbortIf(_kepler.propagate(n, n, _batch_mu.data(), t - _t0,
+			_batch.data()) > 0, false,
+			"Kepler's equation did not converge at t = %g", t);
+
+		for (size_t i = 0; i < _names.size(); i++)
+		{
+			if (_primaries[i] != i) continue;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				x[k * stride + i] = _states[6 * i + k] +
+					_states[6 * i + k + 3] * (t - _t0);
+				x[(k + 3) * stride + i] = _states[6 * i + k + 3];
+			}
+		}
+
+		for (size_t j = 0; j < n; j++)
+		{
+			const size_t i = _order[j];
+			const size_t p = _primaries[i];
+
+			for (size_t k = 0; k < 6; k++)
+			{
+				x[k * stride + i] = x[k * stride + p] +
+					_batch[k * n + j];
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Get the gravitational parameter of a body
+	 *
+	 * @param[in] body The index of the body
+	 *
+	 * @return Its gravitational parameter, m^3/s^2
+	 */
+	double PatchedConics::gm(size_t body) const
+	{
+		return _gm[body];
+	}
+
+	/**
+	 * Initialize from the states of the massive bodies. Each body's
+	 * primary is found by visiting the bodies from the heaviest to the
+	 * lightest, and picking the already visited body with the smallest
+	 * sphere of influence containing it. The radius of a body's sphere
+	 * of influence is d (gm / gm_p)^(2/5), where d is its distance from
+	 * its own primary p; bodies without a primary have an unbounded one
+	 *
+	 * @param[in] names  The body names
+	 * @param[in] gm     The gravitational parameters, m^3/s^2, which
+	 *                   must all be positive
+	 * @param[in] states Position and velocity of each body, 6 per body,
+	 *                   meters and meters/second
+	 * @param[in] t0     The time of \a states, seconds
+	 *
+	 * @return True on success
+	 */
+	bool PatchedConics::init(const std::vector<std::string>& names,
+		const std::vector<double>& gm,
+		const std::vector<double>& states, double t0)
+	{
+		const size_t n = names.size();
+
+		AbortIf_2(gm.size() != n || states.size() != 6 * n, false);
+		AbortIf(n == 0, false, "patched conics require a massive body");
+
+		for (size_t i = 0; i < n; i++)
+		{
+			AbortIf(!(gm[i] > 0.0), false, "'%s' is not massive",
+				names[i].c_str());
+		}
+
+		std::vector<size_t> order(n);
+		for (size_t i = 0; i < n; i++)
+			order[i] = i;
+
+		std::stable_sort(order.begin(), order.end(),
+			[&gm](size_t a, size_t b) {
+				return gm[a] > gm[b];
+			});
+
+		_names = names;
+		_gm    = gm;
+		_t0    = t0;
+
+		_children.assign(n, std::vector<size_t>());
+		_mu.assign(n, 0.0);
+		_primaries.resize(n);
+		_soi.assign(n, 0.0);
+		_states = states;
+
+		_order.clear();
+
+		for (size_t j = 0; j < n; j++)
+		{
+			const size_t i = order[j];
+
+			_primaries[i] = i;
+
+			for (size_t jj = 0; jj < j; jj++)
+			{
+				const size_t p = order[jj];
+
+				if (_primaries[i] != i && _soi[p] >= _soi[_primaries[i]])
+					continue;
+
+				double d2 = 0.0;
+				for (size_t k = 0; k < 3; k++)
+				{
+					const double dk = states[6 * i + k] - states[6 * p + k];
+					d2 += dk * dk;
+				}
+
+				if (std::isinf(_soi[p]) || d2 < _soi[p] * _soi[p])
+					_primaries[i] = p;
+			}
+
+			const size_t p = _primaries[i];
+
+			if (p == i)
+			{
+				_soi[i] = std::numeric_limits<double>::infinity();
+				continue;
+			}
+
+			double d2 = 0.0;
+			for (size_t k = 0; k < 3; k++)
+			{
+				const double dk = states[6 * i + k] - states[6 * p + k];
+				d2 += dk * dk;
+			}
+
+			_soi[i] = std::sqrt(d2) * std::pow(gm[i] / gm[p], 0.4);
+			_mu[i]  = gm[i] + gm[p];
+
+			_children[p].push_back(i);
+			_order.push_back(i);
+		}
+
+		/*
+		 * Store satellites relative to their primaries
+		 */
+		for (size_t i : _order)
+		{
+			const size_t p = _primaries[i];
+
+			for (size_t k = 0; k < 6; k++)
+				_states[6 * i + k] -= states[6 * p + k];
+		}
+
+		_batch.assign(6 * _order.size(), 0.0);
+		_batch_mu.resize(_order.size());
+
+		for (size_t j = 0; j < _order.size(); j++)
+			_batch_mu[j] = _mu[_order[j]];
+
+		return true;
+	}
+
+	/**
+	 * Get the primary of a body
+	 *
+	 * @param[in] body The index of the body
+	 *
+	 * @return The index of the body it orbits, or \a body itself if it
+	 *         has no primary
+	 */
+	size_t PatchedConics::primary(size_t body) const
+	{
+		return _primaries[body];
+	}
+
+	/**
+	 * Coast a spacecraft forward to the given time, switching primaries
+	 * at every sphere of influence crossing along the way.
+	 *
+	 * The spacecraft is checked for crossings at intervals of half the
+	 * time it would take to close the smallest gap to a sphere boundary
+	 * at its current relative speed, but no more often than the minimum
+	 * step. Once a check finds it on the other side of a boundary, the
+	 * crossing time is found by root finding on the squared distance,
+	 * and the spacecraft is handed over just past it
+	 *
+	 * @param[in,out] coast The spacecraft
+	 * @param[in]     t     The time to coast to, seconds, which must not
+	 *                      come before \a coast.t
+	 *
+	 * @return True on success
+	 */
+	bool PatchedConics::propagate(Coast& coast, double t) const
+	{
+		AbortIf_2(coast.primary >= _names.size() || t < coast.t, false);
+
+		while (coast.t < t)
+		{
+			const size_t p = coast.primary;
+			const std::vector<size_t>& children = _children[p];
+
+			const double t0 = coast.t;
+			double h = t - t0;
+
+			auto norm = [](const double* x) {
+				return std::sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+			};
+
+			if (!std::isinf(_soi[p]))
+			{
+				h = std::min(h, std::max(min_step, 0.5 *
+					(_soi[p] - norm(coast.r)) / norm(coast.v)));
+			}
+
+			for (size_t c : children)
+			{
+				double rc[3], vc[3];
+				AbortIfNot_2(_relative_state(c, t0, rc, vc), false);
+
+				for (size_t k = 0; k < 3; k++)
+				{
+					rc[k] -= coast.r[k];
+					vc[k] -= coast.v[k];
+				}
+
+				h = std::min(h, std::max(min_step, 0.5 *
+					(norm(rc) - _soi[c]) / norm(vc)));
+			}
+
+			/*
+			 * Event functions, negative while the spacecraft stays put:
+			 * event 0 is leaving the primary's sphere, and event c + 1
+			 * is entering that of child c
+			 */
+			const double mu = _gm[p];
+
+			/*
+			 * The root finder cannot be told of a failure, so it is
+			 * noted here and checked once the crossings are found
+			 */
+			bool converged = true;
+
+			auto g = [&](size_t event, double time) {
+				double r[3], v[3];
+
+				if (!kepler(mu, coast.r, coast.v, time - t0, r, v))
+					converged = false;
+
+				if (event == 0)
+					return r[0] * r[0] + r[1] * r[1] + r[2] * r[2] -
+						_soi[p] * _soi[p];
+
+				const size_t c = children[event - 1];
+
+				double rc[3], vc[3];
+
+				if (!_relative_state(c, time, rc, vc))
+					converged = false;
+
+				double d2 = 0.0;
+				for (size_t k = 0; k < 3; k++)
+					d2 += (r[k] - rc[k]) * (r[k] - rc[k]);
+
+				return _soi[c] * _soi[c] - d2;
+			};
+
+			double r[3], v[3];
+			AbortIfNot(kepler(mu, coast.r, coast.v, h, r, v), false,
+				"Kepler's equation did not converge at t = %g", t0 + h);
+
+			size_t event  = 0;
+			double t_next = t0 + h;
+
+			for (size_t e = std::isinf(_soi[p]) ? 1 : 0;
+				e <= children.size(); e++)
+			{
+				double b = t0 + h, fb = g(e, b);
+
+				if (fb < 0.0) continue;
+
+				double a = t0, fa = g(e, a);
+
+				auto ge = [&g, e](double time) { return g(e, time); };
+
+				AbortIfNot(illinois(ge, a, fa, b, fb, tolerance), false,
+					"failed to locate a sphere of influence crossing "
+					"between t = %g and %g", t0, t0 + h);
+
+				if (event == 0 || b < t_next)
+				{
+					event  = e + 1;
+					t_next = b;
+				}
+			}
+
+			AbortIfNot(converged, false, "Kepler's equation did not "
+				"converge between t = %g and %g", t0, t0 + h);
+
+			if (event == 0)
+			{
+				for (size_t k = 0; k < 3; k++)
+				{
+					coast.r[k] = r[k];
+					coast.v[k] = v[k];
+				}
+
+				coast.t = t_next;
+				continue;
+			}
+
+			AbortIfNot(kepler(mu, coast.r, coast.v, t_next - t0, r, v),
+				false, "Kepler's equation did not converge at t = %g",
+				t_next);
+
+			/*
+			 * Hand over to the parent when leaving, or to the child
+			 * when entering, re-expressing the state relative to it
+			 */
+			double rp[3], vp[3];
+			double sign;
+
+			if (event == 1)
+			{
+				AbortIfNot_2(_relative_state(p, t_next, rp, vp), false);
+				coast.primary = _primaries[p];
+				sign = 1.0;
+			}
+			else
+			{
+				coast.primary = children[event - 2];
+				AbortIfNot_2(_relative_state(coast.primary, t_next, rp, vp),
+					false);
+				sign = -1.0;
+			}
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				coast.r[k] = r[k] + sign * rp[k];
+				coast.v[k] = v[k] + sign * vp[k];
+			}
+
+			coast.t = t_next;
+			coast.transitions++;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Set up a spacecraft from its absolute state. Its primary is the
+	 * body with the smallest sphere of influence containing it
+	 *
+	 * @param[in]  t     The time, seconds
+	 * @param[in]  r     Position, meters, 3 elements
+	 * @param[in]  v     Velocity, meters/second, 3 elements
+	 * @param[out] coast The spacecraft
+	 *
+	 * @return True on success
+	 */
+	bool PatchedConics::start(double t, const double* r, const double* v,
+		Coast& coast) const
+	{
+		AbortIf(_names.empty(), false, "not initialized");
+
+		/*
+		 * Descend from a root through the spheres containing the
+		 * spacecraft
+		 */
+		size_t p = 0;
+		while (_primaries[p] != p)
+			p = _primaries[p];
+
+		double rp[3], vp[3];
+		AbortIfNot_2(body_state(p, t, rp, vp), false);
+
+		for (bool descended = true; descended; )
+		{
+			descended = false;
+
+			for (size_t c : _children[p])
+			{
+				double rc[3], vc[3];
+				AbortIfNot_2(_relative_state(c, t, rc, vc), false);
+
+				double d2 = 0.0;
+				for (size_t k = 0; k < 3; k++)
+				{
+					const double dk = r[k] - rp[k] - rc[k];
+					d2 += dk * dk;
+				}
+
+				if (d2 < _soi[c] * _soi[c])
+				{
+					for (size_t k = 0; k < 3; k++)
+					{
+						rp[k] += rc[k];
+						vp[k] += vc[k];
+					}
+
+					p = c;
+					descended = true;
+					break;
+				}
+			}
+		}
+
+		coast.primary     = p;
+		coast.t           = t;
+		coast.transitions = 0;
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			coast.r[k] = r[k] - rp[k];
+			coast.v[k] = v[k] - vp[k];
+		}
+
+		return true;
+	}
+
+	/**
+	 * Get the state of a body relative to its primary, or its absolute
+	 * state if it has none
+	 *
+	 * @param[in]  body The index of the body
+	 * @param[in]  t    The time, seconds
+	 * @param[out] r    Position, meters, 3 elements
+	 * @param[out] v    Velocity, meters/second, 3 elements
+	 *
+	 * @return True on success
+	 */
+	bool PatchedConics::_relative_state(size_t body, double t, double* r,
+		double* v) const
+	{
+		const double* state = &_states[6 * body];
+
+		if (_primaries[body] == body)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				r[k] = state[k] + state[k + 3] * (t - _t0);
+				v[k] = state[k + 3];
+			}
+		}
+		else
+		{
+			AbortIfNot(kepler(_mu[body], state, state + 3, t - _t0, r, v),
+				false, "Kepler's equation did not converge for body %zu "
+				"at t = %g", body, t);
+		}
+
+		return true;
+	}
+}
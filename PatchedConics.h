@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Kepler.h"
+
+namespace Crescent
+{
+	/**
+	 * Low-fidelity model of the solar system in which every body moves
+	 * on a two-body conic about a single primary. The primary of each
+	 * massive body is the smallest sphere of influence containing it at
+	 * the initial epoch, and does not change; bodies without one drift
+	 * in a straight line. A spacecraft coasts about the body whose
+	 * sphere it is in, and is handed over to the parent or child body
+	 * when it crosses a sphere boundary, with the crossing time located
+	 * by root finding.
+	 *
+	 * Every state is evaluated in closed form, so a spacecraft can be
+	 * taken to any time without force evaluations
+	 */
+	class PatchedConics
+	{
+
+	public:
+
+		/**
+		 * A spacecraft coasting through the model. Positions and
+		 * velocities are relative to the current primary
+		 */
+		struct Coast
+		{
+			/**
+			 * Index of the body the spacecraft currently orbits
+			 */
+			size_t primary;
+
+			/**
+			 * Position relative to the primary, meters
+			 */
+			double r[3];
+
+			/**
+			 * The time of this state, seconds
+			 */
+			double t;
+
+			/**
+			 * The number of sphere of influence crossings so far
+			 */
+			size_t transitions;
+
+			/**
+			 * Velocity relative to the primary, meters/second
+			 */
+			double v[3];
+		};
+
+		PatchedConics();
+
+		~PatchedConics();
+
+		bool body_state(size_t body, double t, double* r,
+			double* v) const;
+
+		bool body_states(double t, double* x, size_t stride);
+
+		double gm(size_t body) const;
+
+		bool init(const std::vector<std::string>& names,
+			const std::vector<double>& gm,
+			const std::vector<double>& states, double t0);
+
+		size_t primary(size_t body) const;
+
+		bool propagate(Coast& coast, double t) const;
+
+		bool start(double t, const double* r, const double* v,
+			Coast& coast) const;
+
+	private:
+
+		bool _relative_state(size_t body, double t, double* r,
+			double* v) const;
+
+		/**
+		 * Work columns for \ref body_states(), x|y|z|vx|vy|vz of each
+		 * body relative to its primary
+		 */
+		std::vector<double>
+			_batch;
+
+		/**
+		 * Gravitational parameters of the relative orbits in
+		 * \ref _batch
+		 */
+		std::vector<double>
+			_batch_mu;
+
+		/**
+		 * The bodies orbiting each body
+		 */
+		std::vector<std::vector<size_t>>
+			_children;
+
+		/**
+		 * Gravitational parameter of each body, m^3/s^2
+		 */
+		std::vector<double>
+			_gm;
+
+		/**
+		 * Solves the conics of all bodies in \ref body_states()
+		 */
+		KeplerBatch
+			_kepler;
+
+		/**
+		 * Gravitational parameter of each body's relative orbit about
+		 * its primary, i.e. the sum of both bodies' values
+		 */
+		std::vector<double>
+			_mu;
+
+		/**
+		 * The body names
+		 */
+		std::vector<std::string>
+			_names;
+
+		/**
+		 * Bodies with a primary, ordered so that every primary comes
+		 * before its satellites
+		 */
+		std::vector<size_t>
+			_order;
+
+		/**
+		 * The primary of each body, or the body's own index if it has
+		 * none
+		 */
+		std::vector<size_t>
+			_primaries;
+
+		/**
+		 * Radius of each body's sphere of influence, meters
+		 */
+		std::vector<double>
+			_soi;
+
+		/**
+		 * State of each body at \ref _t0, relative to its primary if it
+		 * has one, 6 per body
+		 */
+		std::vector<double>
+			_states;
+
+		/**
+		 * The epoch of \ref _states, seconds
+		 */
+		double _t0;
+	};
+}
@@ -0,0 +1,269 @@
+#include <cmath>
+#include <limits>
+
+#include "abort.h"
+#include "PerturberLists.h"
+
+namespace Crescent
+{
+	/**
+	 * Constructor
+	 */
+	PerturberLists::PerturberLists()
+		: _count(0),
+		_drop(1.0e-14),
+		_error(),
+		_held(),
+		_hold(1.0e-10),
+		_interval(100),
+		_lists(),
+		_stale(true),
+		_velocity_error()
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	PerturberLists::~PerturberLists()
+	{
+	}
+
+	/**
+	 * Integrate the acceleration error of every body over a step
+	 *
+	 * @param[in] dt The step size, seconds
+	 */
+	void PerturberLists::accumulate(double dt)
+	{
+		for (size_t i = 0; i < _error.size(); i++)
+			_velocity_error[i] += _error[i] * dt;
+	}
+
+	/**
+	 * Get the estimated error in the acceleration of a body
+	 *
+	 * @param[in] i The body
+	 *
+	 * @return The error, m/s^2, or 0 before the first evaluation
+	 */
+	double PerturberLists::acceleration_error(size_t i) const
+	{
+		return i < _error.size() ? _error[i] : 0.0;
+	}
+
+	/**
+	 * Compute the accelerations of a range of bodies. Concurrent calls
+	 * on disjoint ranges are safe, provided all of them agree on
+	 * \a refresh
+	 *
+	 * @param[in]  x        Position x column
+	 * @param[in]  y        Position y column
+	 * @param[in]  z        Position z column
+	 * @param[in]  gm       Gravitational parameter column
+	 * @param[in]  nmassive The number of sources, which come first
+	 * @param[in]  i_begin  First target index
+	 * @param[in]  i_end    One past the last target index
+	 * @param[in]  refresh  If true, rebuild the lists of the targets,
+	 *                      as returned by \ref start_evaluation()
+	 * @param[out] ax       Acceleration x column
+	 * @param[out] ay       Acceleration y column
+	 * @param[out] az       Acceleration z column
+	 */
+	void PerturberLists::evaluate(const double* x, const double* y,
+		const double* z,
+		const double* gm,
+		size_t nmassive,
+		size_t i_begin, size_t i_end,
+		bool refresh,
+		double* ax, double* ay, double* az)
+	{
+		for (size_t i = i_begin; i < i_end; i++)
+		{
+			double* held = &_held[3 * i];
+
+			double a[3] = { 0.0, 0.0, 0.0 };
+
+			std::vector<std::uint32_t>& list = _lists[i];
+
+			if (refresh)
+			{
+				double moderate[3] = { 0.0, 0.0, 0.0 };
+				double weak[3]     = { 0.0, 0.0, 0.0 };
+
+				list.clear();
+
+				for (size_t j = 0; j < nmassive; j++)
+				{
+					const double dx = x[j] - x[i];
+					const double dy = y[j] - y[i];
+					const double dz = z[j] - z[i];
+
+					const double r2 = dx * dx + dy * dy + dz * dz;
+
+					if (r2 == 0.0) continue;
+
+					const double magnitude = gm[j] / r2;
+					const double s = magnitude / std::sqrt(r2);
+
+					double* sum = a;
+
+					if (magnitude >= _hold)
+						list.push_back(std::uint32_t(j));
+					else
+						sum = magnitude >= _drop ? moderate : weak;
+
+					sum[0] += s * dx;
+					sum[1] += s * dy;
+					sum[2] += s * dz;
+				}
+
+				double drift = 0.0;
+
+				if (!std::isnan(held[0]))
+				{
+					drift = std::sqrt(
+						(moderate[0] - held[0]) * (moderate[0] - held[0]) +
+						(moderate[1] - held[1]) * (moderate[1] - held[1]) +
+						(moderate[2] - held[2]) * (moderate[2] - held[2]));
+				}
+
+				_error[i] = drift + std::sqrt(weak[0] * weak[0] +
+					weak[1] * weak[1] + weak[2] * weak[2]);
+
+				for (int k = 0; k < 3; k++)
+					held[k] = moderate[k];
+			}
+			else
+			{
+				for (const std::uint32_t j : list)
+				{
+					const double dx = x[j] - x[i];
+					const double dy = y[j] - y[i];
+					const double dz = z[j] - z[i];
+
+					const double r2 = dx * dx + dy * dy + dz * dz;
+
+					const double s = gm[j] / (r2 * std::sqrt(r2));
+
+					a[0] += s * dx;
+					a[1] += s * dy;
+					a[2] += s * dz;
+				}
+			}
+
+			ax[i] = a[0] + held[0];
+			ay[i] = a[1] + held[1];
+			az[i] = a[2] + held[2];
+		}
+	}
+
+	/**
+	 * Get the number of strong pairs currently on the lists
+	 *
+	 * @return The number of pairs evaluated between refreshes
+	 */
+	size_t PerturberLists::interactions() const
+	{
+		size_t total = 0;
+
+		for (const auto& list : _lists)
+			total += list.size();
+
+		return total;
+	}
+
+	/**
+	 * Force the lists to be refreshed on the next evaluation, e.g.
+	 * after a change of mass
+	 */
+	void PerturberLists::invalidate()
+	{
+		_stale = true;
+	}
+
+	/**
+	 * Set how often the lists are refreshed
+	 *
+	 * @param[in] evaluations The number of force evaluations between
+	 *                        refreshes. 1 refreshes every time, which
+	 *                        drops the weak perturbers but holds nothing
+	 *
+	 * @return True on success
+	 */
+	bool PerturberLists::set_refresh_interval(int evaluations)
+	{
+		AbortIf(evaluations < 1, false,
+			"invalid perturber refresh interval: %d", evaluations);
+
+		_interval = evaluations;
+		return true;
+	}
+
+	/**
+	 * Set the accelerations separating weak, moderate and strong
+	 * perturbers
+	 *
+	 * @param[in] drop Weaker perturbers are dropped, m/s^2
+	 * @param[in] hold Weaker perturbers are held between refreshes,
+	 *                 m/s^2. Must be at least \a drop
+	 *
+	 * @return True on success
+	 */
+	bool PerturberLists::set_thresholds(double drop, double hold)
+	{
+		AbortIf(!(drop >= 0.0) || !(hold >= drop), false,
+			"invalid perturber thresholds: drop = %g, hold = %g",
+			drop, hold);
+
+		_drop = drop;
+		_hold = hold;
+		_stale = true;
+
+		return true;
+	}
+
+	/**
+	 * Count a force evaluation and decide whether it refreshes the
+	 * lists. Must be called once before the calls to \ref evaluate()
+	 * making up each evaluation
+	 *
+	 * @param[in] n The number of bodies
+	 *
+	 * @return True if the lists must be refreshed
+	 */
+	bool PerturberLists::start_evaluation(size_t n)
+	{
+		if (_lists.size() != n)
+		{
+			_error.assign(n, 0.0);
+			_held.assign(3 * n,
+				std::numeric_limits<double>::quiet_NaN());
+			_lists.resize(n);
+			_velocity_error.assign(n, 0.0);
+
+			_stale = true;
+		}
+
+		if (_stale || ++_count >= _interval)
+		{
+			_count = 0;
+			_stale = false;
+			return true;
+		}
+
+		return false;
+	}
+
+	/**
+	 * Get the velocity error accumulated by a body so far
+	 *
+	 * @param[in] i The body
+	 *
+	 * @return The error, m/s, or 0 before the first evaluation
+	 */
+	double PerturberLists::velocity_error(size_t i) const
+	{
+		return i < _velocity_error.size() ? _velocity_error[i] : 0.0;
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * @class PerturberLists
+	 *
+	 * Direct-sum gravity over per-body interaction lists. Every so many
+	 * force evaluations the lists are refreshed by a full direct sum,
+	 * during which each source is sorted by the magnitude GM/r^2 of the
+	 * acceleration it exerts on the target:
+	 *
+	 *   strong    At or above the hold threshold. Kept on the target's
+	 *             list and evaluated every time
+	 *
+	 *   moderate  Between the two thresholds. Summed once per refresh
+	 *             and held constant until the next one
+	 *
+	 *   weak      Below the drop threshold. Ignored until the next
+	 *             refresh
+	 *
+	 * Error budget: at each refresh the sum of the weak terms is the
+	 * exact error of dropping them, and the change in the held sum
+	 * since the previous refresh bounds the error of holding it over an
+	 * interval. Their sum is kept per body as the acceleration error,
+	 * and integrated over time into a velocity error by
+	 * \ref accumulate(). Both are estimates for the current refresh
+	 * interval; a body whose perturbers move much faster than the
+	 * interval will be underestimated until its next refresh
+	 */
+	class PerturberLists
+	{
+
+	public:
+
+		PerturberLists();
+
+		~PerturberLists();
+
+		void accumulate(double dt);
+
+		double acceleration_error(size_t i) const;
+
+		void evaluate(const double* x, const double* y, const double* z,
+			const double* gm,
+			size_t nmassive,
+			size_t i_begin, size_t i_end,
+			bool refresh,
+			double* ax, double* ay, double* az);
+
+		size_t interactions() const;
+
+		void invalidate();
+
+		bool set_refresh_interval(int evaluations);
+
+		bool set_thresholds(double drop, double hold);
+
+		bool start_evaluation(size_t n);
+
+		double velocity_error(size_t i) const;
+
+	private:
+
+		/**
+		 * Force evaluations since the last refresh
+		 */
+		int _count;
+
+		/**
+		 * Sources whose acceleration on a target is below this are
+		 * dropped, m/s^2
+		 */
+		double _drop;
+
+		/**
+		 * Estimated acceleration error of each body, m/s^2
+		 */
+		std::vector<double>
+			_error;
+
+		/**
+		 * Sum of the moderate perturbations on each body at the last
+		 * refresh, 3 per body. NaN before the first refresh
+		 */
+		std::vector<double>
+			_held;
+
+		/**
+		 * Sources whose acceleration on a target is at least this
+		 * are evaluated every time, m/s^2
+		 */
+		double _hold;
+
+		/**
+		 * The number of force evaluations between refreshes
+		 */
+		int _interval;
+
+		/**
+		 * The strong perturbers of each body
+		 */
+		std::vector<std::vector<std::uint32_t>>
+			_lists;
+
+		/**
+		 * If true, the next evaluation refreshes the lists regardless
+		 * of \ref _count
+		 */
+		bool _stale;
+
+		/**
+		 * Accumulated velocity error of each body, m/s
+		 */
+		std::vector<double>
+			_velocity_error;
+	};
+}
@@ -43,6 +43,7 @@ namespace Crescent
 	 * Constructor
 	 */
 	DataAccountant::DataAccountant()
+		: _elements(), _index()
 	{
 	}
 
@@ -79,14 +80,12 @@ namespace Crescent
 	 */
 	int DataAccountant::lookup(const std::string& path)
 	{
-		std::string _path = trim_path(path);
+		auto iter = _index.find(trim_path(path));
 
-		for (size_t i = 0; i < _elements.size(); i++)
-		{
-			if (_elements[i].first == _path) return i;
-		}
+		if (iter == _index.end())
+			return -1;
 
-		return -1;
+		return iter->second;
 	}
 
 	/**
@@ -115,6 +114,8 @@ namespace Crescent
 		_elements.push_back(
 			std::make_pair(prefix, element));
 
+		_index[prefix] = id;
+
 		return id;
 	}
 
@@ -131,6 +132,7 @@ namespace Crescent
 		Handle<DataAccountant> accountant)
 		: _accountant(accountant),
 		_directories(),
+		_dir_index(),
 		_elements(),
 		_path(trim_path(path))
 	{
@@ -259,6 +261,8 @@ namespace Crescent
 				_accountant));
 			AbortIfNot_2(dir, dir);
 			_directories.push_back(dir);
+
+			_dir_index[dir->_path] = id;
 		}
 
 		return _directories[id];
@@ -276,12 +280,12 @@ namespace Crescent
 		std::string path =
 			_path + "/" + Util::trim(_name);
 
-		for (size_t i = 0; i < _directories.size(); i++)
-		{
-			if (_directories[i]->_path == path) return i;
-		}
+		auto iter = _dir_index.find(path);
+
+		if (iter == _dir_index.end())
+			return -1;
 
-		return -1;
+		return iter->second;
 	}
 
 	/**
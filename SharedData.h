@@ -1,5 +1,6 @@
 #pragma once
 
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -195,6 +196,13 @@ namespace Crescent
 		 */
 		std::vector<str_elem_p>
 			_elements;
+
+		/**
+		 * Maps from element path -> element ID, so that lookups do
+		 * not scale with the number of elements
+		 */
+		std::map<std::string, int>
+			_index;
 	};
 
 	/**
@@ -350,6 +358,12 @@ namespace Crescent
 		std::vector< Handle<DataDirectory> >
 			_directories;
 
+		/**
+		 * Maps from subdirectory path -> index in \ref _directories
+		 */
+		std::map<std::string, int>
+			_dir_index;
+
 		/**
 		 * All data elements created here
 		 */
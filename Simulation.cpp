@@ -11,7 +11,7 @@ namespace Crescent
 	/**
 	 * Constructor
 	 */
-	Simulation::Simulation() : _cycle(), _is_init(false)
+	Simulation::Simulation() : _cycle(), _ephemeris(), _is_init(false)
 	{
 	}
 
@@ -25,36 +25,226 @@ namespace Crescent
 	/**
 	 * Create the ephemeris manager component
 	 *
-	 * @param[in] ephem_config The ephemeris config file
+	 * @param[in] cmd The command line
 	 *
 	 * @return True on success
 	 */
-	bool Simulation::create_ephemeris(const std::string& ephem_config)
+	bool Simulation::create_ephemeris(const CommandLine& cmd)
 	{
 		Handle<EphemerisManager> manager(new EphemerisManager());
 		AbortIfNot_2(manager, false);
 
+		std::string ephem_config;
+		AbortIfNot_2(cmd.get<std::string>("ephem_config", ephem_config),
+			false);
+
+		int threads;
+		AbortIfNot_2(cmd.get<int>("threads", threads), false);
+
+		AbortIfNot_2(manager->set_threads(threads), false);
+
+		std::string solver;
+		AbortIfNot_2(cmd.get<std::string>("gravity", solver), false);
+
+		AbortIfNot_2(manager->set_solver(solver), false);
+
+		double theta;
+		AbortIfNot_2(cmd.get<double>("opening_angle", theta), false);
+
+		AbortIfNot_2(manager->set_opening_angle(theta), false);
+
+		double cluster_size;
+		AbortIfNot_2(cmd.get<double>("cluster_size", cluster_size),
+			false);
+
+		AbortIfNot_2(manager->set_cluster_size(cluster_size), false);
+
+		double drop, hold;
+		AbortIfNot_2(cmd.get<double>("perturber_drop", drop), false);
+		AbortIfNot_2(cmd.get<double>("perturber_hold", hold), false);
+
+		int refresh;
+		AbortIfNot_2(cmd.get<int>("perturber_refresh", refresh), false);
+
+		AbortIfNot_2(manager->set_perturber_culling(drop, hold, refresh),
+			false);
+
+		std::string integrator;
+		AbortIfNot_2(cmd.get<std::string>("integrator", integrator),
+			false);
+
+		AbortIfNot_2(manager->set_integrator(integrator), false);
+
+		double step;
+		AbortIfNot_2(cmd.get<double>("ephemeris_step", step), false);
+
+		AbortIfNot_2(manager->set_step(step), false);
+
+		bool dense_output;
+		AbortIfNot_2(cmd.get<bool>("dense_output", dense_output),
+			false);
+
+		AbortIfNot_2(manager->set_dense_output(dense_output), false);
+
+		std::string events;
+		AbortIfNot_2(cmd.get<std::string>("events_config", events),
+			false);
+
+		if (!events.empty())
+		{
+			AbortIfNot_2(manager->set_events(events), false);
+		}
+
+		double event_tolerance;
+		AbortIfNot_2(cmd.get<double>("event_tolerance", event_tolerance),
+			false);
+
+		AbortIfNot_2(manager->set_event_tolerance(event_tolerance),
+			false);
+
+		double rtol, atol;
+		AbortIfNot_2(cmd.get<double>("ephemeris_rtol", rtol), false);
+		AbortIfNot_2(cmd.get<double>("ephemeris_atol", atol), false);
+
+		AbortIfNot_2(manager->set_tolerance(rtol, atol), false);
+
+		int order;
+		AbortIfNot_2(cmd.get<int>("multistep_order", order), false);
+
+		AbortIfNot_2(manager->set_multistep_order(order), false);
+
+		std::string formulation;
+		AbortIfNot_2(cmd.get<std::string>("formulation", formulation),
+			false);
+
+		AbortIfNot_2(manager->set_formulation(formulation), false);
+
+		double rectify;
+		AbortIfNot_2(cmd.get<double>("encke_rectify", rectify), false);
+
+		AbortIfNot_2(manager->set_rectify_threshold(rectify), false);
+
+		int sundman_steps;
+		AbortIfNot_2(cmd.get<int>("sundman_steps", sundman_steps),
+			false);
+
+		AbortIfNot_2(manager->set_sundman_steps(sundman_steps), false);
+
+		bool stm;
+		AbortIfNot_2(cmd.get<bool>("stm", stm), false);
+
+		AbortIfNot_2(manager->set_stm(stm), false);
+
+		std::string ensemble_body;
+		AbortIfNot_2(cmd.get<std::string>("ensemble_body",
+			ensemble_body), false);
+
+		int ensemble_size, ensemble_seed;
+		AbortIfNot_2(cmd.get<int>("ensemble_size", ensemble_size),
+			false);
+		AbortIfNot_2(cmd.get<int>("ensemble_seed", ensemble_seed),
+			false);
+
+		double ensemble_sigma_r, ensemble_sigma_v;
+		AbortIfNot_2(cmd.get<double>("ensemble_sigma_r",
+			ensemble_sigma_r), false);
+		AbortIfNot_2(cmd.get<double>("ensemble_sigma_v",
+			ensemble_sigma_v), false);
+
+		AbortIfNot_2(manager->set_ensemble(ensemble_body, ensemble_size,
+			ensemble_sigma_r, ensemble_sigma_v, ensemble_seed), false);
+
+		int parareal_slices;
+		AbortIfNot_2(cmd.get<int>("parareal_slices", parareal_slices),
+			false);
+
+		double parareal_span, parareal_coarse_step;
+		AbortIfNot_2(cmd.get<double>("parareal_span", parareal_span),
+			false);
+		AbortIfNot_2(cmd.get<double>("parareal_coarse_step",
+			parareal_coarse_step), false);
+
+		AbortIfNot_2(manager->set_parareal(parareal_slices,
+			parareal_span, parareal_coarse_step), false);
+
+		std::string chebyshev_input, chebyshev_output;
+		AbortIfNot_2(cmd.get<std::string>("chebyshev_input",
+			chebyshev_input), false);
+		AbortIfNot_2(cmd.get<std::string>("chebyshev_output",
+			chebyshev_output), false);
+
+		std::string harmonics;
+		AbortIfNot_2(cmd.get<std::string>("harmonics_config", harmonics),
+			false);
+
+		if (!harmonics.empty())
+		{
+			AbortIfNot_2(manager->set_harmonics(harmonics), false);
+		}
+
+		std::string radiation;
+		AbortIfNot_2(cmd.get<std::string>("radiation_config", radiation),
+			false);
+
+		if (!radiation.empty())
+		{
+			AbortIfNot_2(manager->set_radiation_pressure(radiation),
+				false);
+		}
+
+		if (!chebyshev_input.empty())
+		{
+			AbortIfNot_2(manager->set_chebyshev_input(chebyshev_input),
+				false);
+		}
+
+		if (!chebyshev_output.empty())
+		{
+			double interval;
+			AbortIfNot_2(cmd.get<double>("chebyshev_interval", interval),
+				false);
+
+			int ncoeff;
+			AbortIfNot_2(cmd.get<int>("chebyshev_coefficients", ncoeff),
+				false);
+
+			AbortIfNot_2(manager->set_chebyshev_output(chebyshev_output,
+				interval, ncoeff), false);
+		}
+
 		AbortIfNot_2(manager->init(shared->root(), ephem_config),
 			false);
 
 		AbortIfNot_2(_cycle->register_event(manager),
 			false);
 
+		_ephemeris = manager;
+
 		return true;
 	}
 
 	/**
 	 * Create the multi-body system
 	 *
-	 * @param[in] masses_config The masses config file
+	 * @param[in] cmd The command line
 	 *
 	 * @return True on success
 	 */
-	bool Simulation::create_orbital(const std::string& masses_config)
+	bool Simulation::create_orbital(const CommandLine& cmd)
 	{
 		Handle<Orbital> orbital(new Orbital());
 		AbortIfNot_2(orbital, false);
 
+		std::string masses_config;
+		AbortIfNot_2(cmd.get<std::string>("masses_config", masses_config),
+			false);
+
+		double threshold;
+		AbortIfNot_2(cmd.get<double>("test_particle_mass", threshold),
+			false);
+
+		AbortIfNot_2(orbital->set_mass_threshold(threshold), false);
+
 		AbortIfNot_2(orbital->init(shared->root(), masses_config), false);
 
 		AbortIfNot_2(_cycle->register_event(orbital),
@@ -88,6 +278,8 @@ namespace Crescent
 	bool Simulation::go(int64 t_stop)
 	{
 		AbortIfNot_2(_cycle->run(t_stop), false);
+
+		AbortIfNot_2(_ephemeris->finish(), false);
 		return true;
 	}
 
@@ -110,19 +302,13 @@ namespace Crescent
 
 		AbortIfNot_2(create_shared_data(), false);
 
-		std::string config;
-		AbortIfNot_2(cmd.get<std::string>("masses_config", config),
-			false);
-
-		AbortIfNot_2(create_orbital(config), false);
+		AbortIfNot_2(create_orbital(cmd), false);
 
-		AbortIfNot_2(cmd.get<std::string>("ephem_config", config),
-			false);
-
-		AbortIfNot_2(create_ephemeris(config), false);
+		AbortIfNot_2(create_ephemeris(cmd), false);
 
 		AbortIfNot_2(_init_time(), false);
 
+		std::string config;
 		AbortIfNot_2(cmd.get<std::string>("telem_config", config),
 			false);
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "EphemerisManager.h"
 #include "EventCycle.h"
 #include "CommandLine/CommandLine.h"
 #include "SharedData.h"
@@ -18,9 +19,9 @@ namespace Crescent
 
 		~Simulation();
 
-		bool create_ephemeris(const std::string& ephem_config);
+		bool create_ephemeris(const CommandLine& cmd);
 
-		bool create_orbital(const std::string& masses_config);
+		bool create_orbital(const CommandLine& cmd);
 
 		bool create_shared_data();
 
@@ -44,6 +45,12 @@ namespace Crescent
 		 */
 		Handle<EventCycle> _cycle;
 
+		/**
+		 * Propagates the ephemerides of all bodies
+		 */
+		Handle<EphemerisManager>
+			_ephemeris;
+
 		/**
 		 * True if initialized
 		 */
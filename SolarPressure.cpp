@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <cmath>
+
+#include "abort.h"
+#include "SolarPressure.h"
+
+namespace Crescent
+{
+	/**
+	 * The solar radiation pressure at 1 AU, N/m^2
+	 */
+	static const double pressure_1au = 4.56e-6;
+
+	/**
+	 * The astronomical unit, meters
+	 */
+	static const double au = 149597870700.0;
+
+	/**
+	 * Constructor
+	 */
+	SolarPressure::SolarPressure()
+		: _evaluations(0),
+		_occulters(),
+		_spacecraft(),
+		_sun(0),
+		_sun_radius(0.0)
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	SolarPressure::~SolarPressure()
+	{
+	}
+
+	/**
+	 * Add the accelerations due to radiation pressure of the
+	 * spacecraft within a range of bodies
+	 *
+	 * @param[in]     r      The x|y|z position columns
+	 * @param[in]     stride The length of each column
+	 * @param[in]     begin  The first body to update
+	 * @param[in]     end    One past the last body to update
+	 * @param[in,out] a      The x|y|z acceleration columns, same layout
+	 */
+	void SolarPressure::accumulate(const double* r, size_t stride,
+		size_t begin, size_t end, double* a)
+	{
+		for (auto& spacecraft : _spacecraft)
+		{
+			const size_t i = spacecraft.body;
+
+			if (i < begin || i >= end)
+				continue;
+
+			const double fraction = _illumination(r, stride, spacecraft);
+
+			if (fraction == 0.0)
+				continue;
+
+			double rho[3];
+
+			for (size_t k = 0; k < 3; k++)
+				rho[k] = r[k * stride + i] - r[k * stride + _sun];
+
+			const double d2 = rho[0] * rho[0] + rho[1] * rho[1] +
+				rho[2] * rho[2];
+
+			const double scale =
+				fraction * spacecraft.coefficient / (d2 * std::sqrt(d2));
+
+			for (size_t k = 0; k < 3; k++)
+				a[k * stride + i] += scale * rho[k];
+		}
+	}
+
+	/**
+	 * Add a body which casts a shadow
+	 *
+	 * @param[in] body   The index of the body
+	 * @param[in] radius Its radius, meters
+	 *
+	 * @return True on success
+	 */
+	bool SolarPressure::add_occulter(size_t body, double radius)
+	{
+		AbortIf(!(radius > 0.0), false, "invalid occulter radius: %g",
+			radius);
+
+		Occulter occulter;
+		occulter.body   = body;
+		occulter.radius = radius;
+
+		_occulters.push_back(occulter);
+
+		for (auto& spacecraft : _spacecraft)
+			spacecraft.shadows.resize(_occulters.size());
+
+		clear();
+		return true;
+	}
+
+	/**
+	 * Add a body which feels radiation pressure
+	 *
+	 * @param[in] body         The index of the body
+	 * @param[in] area_to_mass Its cross-sectional area over its mass,
+	 *                         m^2/kg
+	 * @param[in] reflectivity Its reflectivity coefficient, from 1
+	 *                         for a black body to 2 for a mirror
+	 *
+	 * @return True on success
+	 */
+	bool SolarPressure::add_spacecraft(size_t body, double area_to_mass,
+		double reflectivity)
+	{
+		AbortIf(!(area_to_mass >= 0.0) || !(reflectivity >= 0.0), false,
+			"invalid radiation pressure parameters: area/mass = %g, "
+			"reflectivity = %g", area_to_mass, reflectivity);
+
+		Spacecraft spacecraft;
+		spacecraft.body        = body;
+		spacecraft.coefficient =
+			reflectivity * area_to_mass * pressure_1au * au * au;
+
+		spacecraft.shadows.resize(_occulters.size());
+
+		_spacecraft.push_back(spacecraft);
+
+		clear();
+		return true;
+	}
+
+	/**
+	 * Forget all cached shadows
+	 */
+	void SolarPressure::clear()
+	{
+		for (auto& spacecraft : _spacecraft)
+		{
+			for (auto& shadow : spacecraft.shadows)
+				shadow.tol2_body = -1.0;
+		}
+	}
+
+	/**
+	 * Check whether any spacecraft feel radiation pressure
+	 *
+	 * @return True if none do
+	 */
+	bool SolarPressure::empty() const
+	{
+		return _spacecraft.empty();
+	}
+
+	/**
+	 * Get the number of times a shadow was found rather than taken
+	 * from the cache
+	 *
+	 * @return The count
+	 */
+	size_t SolarPressure::evaluations() const
+	{
+		return _evaluations;
+	}
+
+	/**
+	 * Set the source of radiation
+	 *
+	 * @param[in] body   The index of the Sun
+	 * @param[in] radius Its radius, meters
+	 *
+	 * @return True on success
+	 */
+	bool SolarPressure::set_sun(size_t body, double radius)
+	{
+		AbortIf(!(radius > 0.0), false, "invalid radius of the Sun: %g",
+			radius);
+
+		_sun        = body;
+		_sun_radius = radius;
+
+		clear();
+		return true;
+	}
+
+	/**
+	 * Compute the fraction of the solar disk left visible by an
+	 * occulter, given the apparent radius a of the Sun, the apparent
+	 * radius b of the occulter and their apparent separation c, all
+	 * in radians
+	 *
+	 * @param[in]  a      The apparent radius of the Sun
+	 * @param[in]  b      The apparent radius of the occulter
+	 * @param[in]  c      The angle between their centers
+	 * @param[out] margin The angle c may change by, with a and b held
+	 *                    fixed, before the fraction does. Zero within
+	 *                    the penumbra or an annular eclipse
+	 *
+	 * @return The visible fraction, 0 in the umbra and 1 in sunlight
+	 */
+	double SolarPressure::shadow(double a, double b, double c,
+		double* margin)
+	{
+		if (c >= a + b)
+		{
+			*margin = c - (a + b);
+			return 1.0;
+		}
+
+		if (c <= b - a)
+		{
+			*margin = (b - a) - c;
+			return 0.0;
+		}
+
+		*margin = 0.0;
+
+		if (c <= a - b)
+			return 1.0 - (b * b) / (a * a);
+
+		/*
+		 * The disks overlap partially. x is the distance from the
+		 * center of the Sun to the chord through the points where
+		 * their edges cross, and y is half its length
+		 */
+		const double x = (c * c + a * a - b * b) / (2.0 * c);
+		const double y = std::sqrt(std::max(0.0, a * a - x * x));
+
+		const double area = a * a * std::acos(std::min(1.0, x / a)) +
+			b * b * std::acos(std::min(1.0, (c - x) / b)) - c * y;
+
+		return 1.0 - area / (3.14159265358979323846 * a * a);
+	}
+
+	/**
+	 * Find the fraction of the solar disk a spacecraft sees, as the
+	 * product of that left by each occulter. A cached shadow is used
+	 * for as long as the positions of the spacecraft relative to the
+	 * Sun and the occulter stay within the distances that bound how
+	 * far the geometry can have moved towards the nearest boundary
+	 *
+	 * @param[in]     r          The x|y|z position columns
+	 * @param[in]     stride     The length of each column
+	 * @param[in,out] spacecraft The spacecraft, whose cache is updated
+	 *
+	 * @return The visible fraction
+	 */
+	double SolarPressure::_illumination(const double* r, size_t stride,
+		Spacecraft& spacecraft)
+	{
+		const size_t i = spacecraft.body;
+
+		double rho_sun[3];
+
+		for (size_t k = 0; k < 3; k++)
+			rho_sun[k] = r[k * stride + i] - r[k * stride + _sun];
+
+		double fraction = 1.0;
+
+		for (size_t o = 0; o < _occulters.size(); o++)
+		{
+			const Occulter& occulter = _occulters[o];
+			Shadow& cache = spacecraft.shadows[o];
+
+			if (occulter.body == i)
+				continue;
+
+			double rho_body[3];
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				rho_body[k] = r[k * stride + i] -
+					r[k * stride + occulter.body];
+			}
+
+			if (cache.tol2_body >= 0.0)
+			{
+				double d2_body = 0.0, d2_sun = 0.0;
+
+				for (size_t k = 0; k < 3; k++)
+				{
+					const double db = rho_body[k] - cache.rho_body[k];
+					const double ds = rho_sun[k]  - cache.rho_sun[k];
+
+					d2_body += db * db;
+					d2_sun  += ds * ds;
+				}
+
+				if (d2_body <= cache.tol2_body &&
+					d2_sun  <= cache.tol2_sun)
+				{
+					fraction *= cache.fraction;
+					continue;
+				}
+			}
+
+			_evaluations++;
+
+			const double d_sun = std::sqrt(rho_sun[0] * rho_sun[0] +
+				rho_sun[1] * rho_sun[1] + rho_sun[2] * rho_sun[2]);
+
+			const double d_body = std::sqrt(rho_body[0] * rho_body[0] +
+				rho_body[1] * rho_body[1] + rho_body[2] * rho_body[2]);
+
+			/*
+			 * Within the occulter, it blocks the Sun entirely
+			 */
+			if (d_body <= occulter.radius)
+			{
+				cache.fraction  = 0.0;
+				cache.tol2_body = -1.0;
+
+				fraction = 0.0;
+				continue;
+			}
+
+			const double a =
+				std::asin(std::min(1.0, _sun_radius / d_sun));
+			const double b = std::asin(occulter.radius / d_body);
+
+			const double cos_c = (rho_sun[0] * rho_body[0] +
+				rho_sun[1] * rho_body[1] + rho_sun[2] * rho_body[2]) /
+				(d_sun * d_body);
+
+			const double c =
+				std::acos(std::max(-1.0, std::min(1.0, cos_c)));
+
+			double margin;
+			cache.fraction = shadow(a, b, c, &margin);
+
+			fraction *= cache.fraction;
+
+			if (margin == 0.0)
+			{
+				cache.tol2_body = -1.0;
+				continue;
+			}
+
+			/*
+			 * Moving by a fraction e of the distance to a body turns
+			 * the direction to it by at most about e, and changes its
+			 * apparent radius by at most about e * tan of that radius.
+			 * Spend a quarter of the margin on each body, so the
+			 * separation of the disks cannot close the margin before
+			 * one of the positions has moved too far
+			 */
+			const double e_body =
+				std::min(0.1, 0.25 * margin / (1.0 + std::tan(b)));
+			const double e_sun  =
+				std::min(0.1, 0.25 * margin / (1.0 + std::tan(a)));
+
+			cache.tol2_body = e_body * e_body * d_body * d_body;
+			cache.tol2_sun  = e_sun  * e_sun  * d_sun  * d_sun;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				cache.rho_body[k] = rho_body[k];
+				cache.rho_sun[k]  = rho_sun[k];
+			}
+		}
+
+		return fraction;
+	}
+}
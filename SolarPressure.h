@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * @class SolarPressure
+	 *
+	 * Computes the acceleration of spacecraft due to solar radiation
+	 * pressure, for a cannonball model with a given area-to-mass ratio
+	 * and reflectivity coefficient. Sunlight is dimmed by a conical
+	 * shadow model of each occulting body (e.g. the Earth and Moon):
+	 * the fraction of the solar disk left visible is found from the
+	 * apparent radii of the Sun and the occulter and their apparent
+	 * separation, which gives umbra, penumbra and annular eclipses.
+	 * See O. Montenbruck and E. Gill, "Satellite Orbits", section
+	 * 3.4.2.
+	 *
+	 * The shadow geometry of a spacecraft changes slowly compared to
+	 * the rate at which accelerations are requested. While it is in
+	 * full sunlight or in the umbra, the angular distance to the
+	 * nearest shadow boundary is kept along with the positions
+	 * relative to the Sun and occulter at which it was found, and
+	 * converted to how far those positions may move before the
+	 * boundary could be reached. Until then the cached result stands,
+	 * at the cost of two squared distances. Only in penumbra, where
+	 * the visible fraction changes continuously, is the shadow found
+	 * on every call
+	 */
+	class SolarPressure
+	{
+
+	public:
+
+		SolarPressure();
+
+		~SolarPressure();
+
+		void accumulate(const double* r, size_t stride, size_t begin,
+			size_t end, double* a);
+
+		bool add_occulter(size_t body, double radius);
+
+		bool add_spacecraft(size_t body, double area_to_mass,
+			double reflectivity);
+
+		void clear();
+
+		bool empty() const;
+
+		size_t evaluations() const;
+
+		bool set_sun(size_t body, double radius);
+
+		static double shadow(double a, double b, double c,
+			double* margin);
+
+	private:
+
+		/**
+		 * A body which casts a shadow
+		 */
+		struct Occulter
+		{
+			/**
+			 * The index of the body
+			 */
+			size_t body;
+
+			/**
+			 * The radius of the body, meters
+			 */
+			double radius;
+		};
+
+		/**
+		 * The cached shadow cast on a spacecraft by one occulter
+		 */
+		struct Shadow
+		{
+			/**
+			 * The fraction of the solar disk visible
+			 */
+			double fraction;
+
+			/**
+			 * The position relative to the occulter at which it was
+			 * found, meters
+			 */
+			double rho_body[3];
+
+			/**
+			 * The position relative to the Sun at which it was found,
+			 * meters
+			 */
+			double rho_sun[3];
+
+			/**
+			 * The square of how far the position relative to the
+			 * occulter may move before the shadow is found again,
+			 * m^2, or negative if it must be found on every call
+			 */
+			double tol2_body;
+
+			/**
+			 * The square of how far the position relative to the Sun
+			 * may move before the shadow is found again, m^2
+			 */
+			double tol2_sun;
+		};
+
+		/**
+		 * A body feeling radiation pressure
+		 */
+		struct Spacecraft
+		{
+			/**
+			 * The index of the body
+			 */
+			size_t body;
+
+			/**
+			 * The acceleration at unit distance from the Sun in full
+			 * sunlight, i.e. the reflectivity coefficient times the
+			 * area-to-mass ratio times the solar radiation pressure
+			 * times the square of 1 AU, m^3/s^2
+			 */
+			double coefficient;
+
+			/**
+			 * The cached shadow of each occulter
+			 */
+			std::vector<Shadow>
+				shadows;
+		};
+
+		double _illumination(const double* r, size_t stride,
+			Spacecraft& spacecraft);
+
+		/**
+		 * The number of times a shadow was found rather than taken
+		 * from the cache
+		 */
+		size_t _evaluations;
+
+		/**
+		 * The bodies which cast shadows
+		 */
+		std::vector<Occulter>
+			_occulters;
+
+		/**
+		 * The bodies feeling radiation pressure
+		 */
+		std::vector<Spacecraft>
+			_spacecraft;
+
+		/**
+		 * The index of the Sun
+		 */
+		size_t _sun;
+
+		/**
+		 * The radius of the Sun, meters
+		 */
+		double _sun_radius;
+	};
+}
@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <cmath>
+
+#include "crescent.h"
+#include "SphericalHarmonics.h"
+
+namespace Crescent
+{
+	/**
+	 * Constructor
+	 */
+	SphericalHarmonics::SphericalHarmonics()
+		: _alpha(), _beta(),
+		_degree(0),
+		_gm(0.0),
+		_next_c(), _next_s(),
+		_prev_c(), _prev_s(),
+		_radius(0.0),
+		_sectoral(),
+		_z_c(), _z_s(),
+		_work()
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	SphericalHarmonics::~SphericalHarmonics()
+	{
+	}
+
+	/**
+	 * Compute the acceleration due to the terms of degree 2 and up.
+	 * Concurrent calls are safe, provided each passes its own thread
+	 * index
+	 *
+	 * @param[in]  r      The position relative to the body's center of
+	 *                    mass, in the body-fixed frame, meters
+	 * @param[out] a      The acceleration in the body-fixed frame,
+	 *                    m/s^2
+	 * @param[in]  thread The index of the calling thread, less than the
+	 *                    count passed to \ref set_threads()
+	 */
+	void SphericalHarmonics::acceleration(const double* r, double* a,
+		size_t thread)
+	{
+		a[0] = a[1] = a[2] = 0.0;
+
+		const double r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+
+		if (_degree < 2 || r2 == 0.0) return;
+
+		const double ratio = _radius / std::sqrt(r2);
+
+		/*
+		 * Drop the degrees too weak to register in double precision
+		 */
+		size_t n_max = _degree;
+
+		if (ratio < 1.0)
+		{
+			const double limit = std::log(1.0e-16) / std::log(ratio);
+
+			if (limit < double(n_max)) n_max = size_t(limit);
+		}
+
+		if (n_max < 2) return;
+
+		const double scale = _radius / r2;
+
+		const double x   = r[0] * scale;
+		const double y   = r[1] * scale;
+		const double z   = r[2] * scale;
+		const double rho = _radius * scale;
+
+		/*
+		 * Rows of degree n-1, n and n+1, each holding orders up to
+		 * n_max + 1, followed by the sums of each order
+		 */
+		const size_t size = n_max + 2;
+
+		double* work = &_work[9 * (_degree + 2) * thread];
+
+		std::fill(work, work + 9 * size, 0.0);
+
+		double* v_prev = &work[0];
+		double* w_prev = &work[size];
+		double* v      = &work[2 * size];
+		double* w      = &work[3 * size];
+		double* v_next = &work[4 * size];
+		double* w_next = &work[5 * size];
+
+		double* sum_x = &work[6 * size];
+		double* sum_y = &work[7 * size];
+		double* sum_z = &work[8 * size];
+
+		v_prev[0] = ratio;
+
+		v[0] = _alpha[index(1, 0)] * z * ratio;
+		v[1] = _sectoral[1] * x * ratio;
+		w[1] = _sectoral[1] * y * ratio;
+
+		for (size_t n = 1; n <= n_max; n++)
+		{
+			/*
+			 * Degree n+1 from degrees n and n-1
+			 */
+			const double* alpha = &_alpha[index(n + 1, 0)];
+			const double* beta  = &_beta[index(n + 1, 0)];
+
+			for (size_t m = 0; m <= n; m++)
+			{
+				v_next[m] = alpha[m] * z * v[m] - beta[m] * rho * v_prev[m];
+				w_next[m] = alpha[m] * z * w[m] - beta[m] * rho * w_prev[m];
+			}
+
+			v_next[n + 1] = _sectoral[n + 1] * (x * v[n] - y * w[n]);
+			w_next[n + 1] = _sectoral[n + 1] * (x * w[n] + y * v[n]);
+
+			if (n >= 2)
+			{
+				const size_t k = index(n, 0);
+
+				const double* prev_c = &_prev_c[k];
+				const double* prev_s = &_prev_s[k];
+				const double* next_c = &_next_c[k];
+				const double* next_s = &_next_s[k];
+				const double* z_c    = &_z_c[k];
+				const double* z_s    = &_z_s[k];
+
+				sum_x[0] -= next_c[0] * v_next[1];
+				sum_y[0] -= next_c[0] * w_next[1];
+				sum_z[0] -= z_c[0] * v_next[0] + z_s[0] * w_next[0];
+
+				for (size_t m = 1; m <= n; m++)
+				{
+					sum_x[m] += prev_c[m] * v_next[m - 1] +
+						prev_s[m] * w_next[m - 1] -
+						next_c[m] * v_next[m + 1] -
+						next_s[m] * w_next[m + 1];
+
+					sum_y[m] += prev_s[m] * v_next[m - 1] -
+						prev_c[m] * w_next[m - 1] +
+						next_s[m] * v_next[m + 1] -
+						next_c[m] * w_next[m + 1];
+
+					sum_z[m] -= z_c[m] * v_next[m] + z_s[m] * w_next[m];
+				}
+			}
+
+			std::swap(v_prev, v);
+			std::swap(w_prev, w);
+			std::swap(v, v_next);
+			std::swap(w, w_next);
+		}
+
+		double ax = 0.0, ay = 0.0, az = 0.0;
+
+		for (size_t m = 0; m <= n_max; m++)
+		{
+			ax += sum_x[m];
+			ay += sum_y[m];
+			az += sum_z[m];
+		}
+
+		const double g = _gm / (_radius * _radius);
+
+		a[0] = g * ax;
+		a[1] = g * ay;
+		a[2] = g * az;
+	}
+
+	/**
+	 * Get the degree and order of the expansion
+	 *
+	 * @return The degree
+	 */
+	size_t SphericalHarmonics::degree() const
+	{
+		return _degree;
+	}
+
+	/**
+	 * Get the gravitational parameter the coefficients are scaled to
+	 *
+	 * @return GM, m^3/s^2
+	 */
+	double SphericalHarmonics::gm() const
+	{
+		return _gm;
+	}
+
+	/**
+	 * Initialize from a set of coefficients
+	 *
+	 * @param[in] degree The degree and order of the expansion
+	 * @param[in] gm     Gravitational parameter the coefficients are
+	 *                   scaled to, m^3/s^2
+	 * @param[in] radius Reference radius, meters
+	 * @param[in] c      Normalized cosine coefficients, indexed by
+	 *                   \ref index(), up to \a degree
+	 * @param[in] s      Normalized sine coefficients, same layout
+	 *
+	 * @return True on success
+	 */
+	bool SphericalHarmonics::init(size_t degree, double gm,
+		double radius,
+		const std::vector<double>& c,
+		const std::vector<double>& s)
+	{
+		AbortIf(!(gm > 0.0) || !(radius > 0.0), false,
+			"invalid gravity field: GM = %g, R = %g", gm, radius);
+
+		AbortIf(c.size() < index(degree + 1, 0) ||
+			s.size() < index(degree + 1, 0), false,
+			"missing coefficients for degree %zu", degree);
+
+		_degree = degree;
+		_gm     = gm;
+		_radius = radius;
+
+		const size_t terms = index(degree + 1, 0);
+
+		_alpha.assign(index(degree + 2, 0), 0.0);
+		_beta.assign(index(degree + 2, 0), 0.0);
+
+		_next_c.assign(terms, 0.0);
+		_next_s.assign(terms, 0.0);
+		_prev_c.assign(terms, 0.0);
+		_prev_s.assign(terms, 0.0);
+		_z_c.assign(terms, 0.0);
+		_z_s.assign(terms, 0.0);
+
+		_sectoral.assign(degree + 2, 0.0);
+
+		_work.assign(9 * (degree + 2), 0.0);
+
+		for (size_t m = 1; m <= degree + 1; m++)
+		{
+			_sectoral[m] = m == 1 ? std::sqrt(3.0) :
+				std::sqrt((2.0 * m + 1.0) / (2.0 * m));
+		}
+
+		for (size_t n = 1; n <= degree + 1; n++)
+		{
+			for (size_t m = 0; m < n; m++)
+			{
+				const double nn = double(n), mm = double(m);
+
+				_alpha[index(n, m)] = std::sqrt((2 * nn + 1) *
+					(2 * nn - 1) / ((nn - mm) * (nn + mm)));
+
+				if (n >= m + 2)
+				{
+					_beta[index(n, m)] = std::sqrt((2 * nn + 1) *
+						(nn + mm - 1) * (nn - mm - 1) /
+						((2 * nn - 3) * (nn + mm) * (nn - mm)));
+				}
+			}
+		}
+
+		for (size_t n = 2; n <= degree; n++)
+		{
+			for (size_t m = 0; m <= n; m++)
+			{
+				const double nn = double(n), mm = double(m);
+
+				const double f = (2 * nn + 1) / (2 * nn + 3);
+
+				const size_t k = index(n, m);
+
+				const double weight_z =
+					std::sqrt(f * (nn + mm + 1) * (nn - mm + 1));
+
+				double weight_next, weight_prev = 0.0;
+
+				if (m == 0)
+					weight_next = std::sqrt(f * (nn + 1) * (nn + 2) / 2);
+				else
+				{
+					weight_next = 0.5 * std::sqrt(f * (nn + mm + 1) *
+						(nn + mm + 2));
+
+					weight_prev = 0.5 * std::sqrt((m == 1 ? 2 : 1) * f *
+						(nn - mm + 1) * (nn - mm + 2));
+				}
+
+				_next_c[k] = weight_next * c[k];
+				_next_s[k] = weight_next * s[k];
+				_prev_c[k] = weight_prev * c[k];
+				_prev_s[k] = weight_prev * s[k];
+				_z_c[k]    = weight_z * c[k];
+				_z_s[k]    = weight_z * s[k];
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Load a gravity field in the ASCII SHADR layout used by the PDS
+	 * for the GRAIL lunar fields (e.g. GRGM1200A) and others. The
+	 * first line holds the reference radius (km) and GM (km^3/s^2),
+	 * followed by the uncertainty of GM, the degree and order of the
+	 * file and the normalization state (1 for fully normalized, the
+	 * only state accepted). Every following line holds the degree,
+	 * order, C and S of one term, optionally followed by their
+	 * uncertainties. Fields may be separated by commas or blanks, and
+	 * terms missing from the file are zero
+	 *
+	 * @param[in] path   The file to read
+	 * @param[in] degree Truncate the field to this degree and order
+	 *
+	 * @return True on success
+	 */
+	bool SphericalHarmonics::load(const std::string& path, size_t degree)
+	{
+		std::vector<std::string> lines;
+		AbortIfNot(read_config(path, lines), false,
+			"unable to read gravity field '%s'", path.c_str());
+
+		AbortIf(lines.empty(), false, "empty gravity field '%s'",
+			path.c_str());
+
+		auto tokenize = [](const std::string& line,
+			std::vector<std::string>& tokens)
+		{
+			Util::split(strrep(strrep(line, ',', ' '), '\t', ' '),
+				tokens);
+		};
+
+		std::vector<std::string> tokens;
+		tokenize(lines[0], tokens);
+
+		double radius, gm;
+
+		AbortIf(tokens.size() < 2 ||
+			!Util::from_string<double>(tokens[0], radius) ||
+			!Util::from_string<double>(tokens[1], gm), false,
+			"invalid gravity field header in '%s'", path.c_str());
+
+		AbortIf(tokens.size() >= 6 && Util::trim(tokens[5]) != "1",
+			false, "'%s' is not fully normalized", path.c_str());
+
+		std::vector<double> c(index(degree + 1, 0), 0.0);
+		std::vector<double> s(c.size(), 0.0);
+
+		size_t max_degree = 0;
+
+		for (size_t i = 1; i < lines.size(); i++)
+		{
+			tokenize(lines[i], tokens);
+
+			int n, m;
+			double cnm, snm;
+
+			AbortIf(tokens.size() < 4 ||
+				!Util::from_string<int>(tokens[0], n) ||
+				!Util::from_string<int>(tokens[1], m) ||
+				!Util::from_string<double>(tokens[2], cnm) ||
+				!Util::from_string<double>(tokens[3], snm) ||
+				n < 0 || m < 0 || m > n, false,
+				"invalid term on line %zu of '%s'", i + 1, path.c_str());
+
+			max_degree = std::max(max_degree, size_t(n));
+
+			if (size_t(n) > degree) continue;
+
+			c[index(n, m)] = cnm;
+			s[index(n, m)] = snm;
+		}
+
+		AbortIf(max_degree < degree, false,
+			"'%s' only goes up to degree %zu", path.c_str(), max_degree);
+
+		AbortIfNot_2(init(degree, gm * 1.0e9, radius * 1.0e3, c, s),
+			false);
+
+		return true;
+	}
+
+	/**
+	 * Get the reference radius the coefficients are scaled to
+	 *
+	 * @return The radius, meters
+	 */
+	double SphericalHarmonics::radius() const
+	{
+		return _radius;
+	}
+
+	/**
+	 * Set the number of threads that may call \ref acceleration() at
+	 * once. Must be called after the field is initialized, which
+	 * resets it to one
+	 *
+	 * @param[in] threads The number of threads
+	 *
+	 * @return True on success
+	 */
+	bool SphericalHarmonics::set_threads(size_t threads)
+	{
+		AbortIf(threads < 1, false, "invalid thread count: %zu",
+			threads);
+
+		_work.assign(9 * (_degree + 2) * threads, 0.0);
+		return true;
+	}
+}
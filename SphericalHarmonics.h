@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * @class SphericalHarmonics
+	 *
+	 * Gravity field of an extended body, expanded in fully normalized
+	 * spherical harmonics to a chosen degree and order N:
+	 *
+	 *   U = GM/r sum_n sum_m (R/r)^n Pnm(sin phi)
+	 *                         (Cnm cos m lambda + Snm sin m lambda)
+	 *
+	 * Only the terms of degree 2 and up are evaluated; the central term
+	 * is left to the point-mass solvers. The accelerations follow
+	 * Cunningham's formulation (Montenbruck and Gill, "Satellite
+	 * Orbits", section 3.2.5) in normalized form. The solid harmonics
+	 *
+	 *   Vnm = (R/r)^(n+1) Pnm(sin phi) cos m lambda
+	 *   Wnm = (R/r)^(n+1) Pnm(sin phi) sin m lambda
+	 *
+	 * are built one degree at a time by a recursion in the Cartesian
+	 * coordinates, so each evaluation costs O(N^2) with no
+	 * trigonometric functions, there is no singularity at the poles,
+	 * and only three degrees are in memory at once. The loops over
+	 * order carry no dependencies, so they pipeline (and vectorize)
+	 * well. Every coefficient of the recursion and of the acceleration
+	 * sums is tabulated when the field is loaded.
+	 *
+	 * Terms fall off as (R/r)^n, so for a target at distance r the sum
+	 * is cut at the degree where (R/r)^n drops below 1e-16. A spacecraft
+	 * in low orbit pays for the full field, while distant bodies pay
+	 * for a few degrees at most
+	 */
+	class SphericalHarmonics
+	{
+
+	public:
+
+		SphericalHarmonics();
+
+		~SphericalHarmonics();
+
+		void acceleration(const double* r, double* a, size_t thread);
+
+		size_t degree() const;
+
+		double gm() const;
+
+		bool init(size_t degree, double gm, double radius,
+			const std::vector<double>& c,
+			const std::vector<double>& s);
+
+		bool load(const std::string& path, size_t degree);
+
+		double radius() const;
+
+		bool set_threads(size_t threads);
+
+		/**
+		 * Get the index of a term in the packed triangular tables
+		 *
+		 * @param[in] n The degree
+		 * @param[in] m The order, at most \a n
+		 *
+		 * @return The index
+		 */
+		static size_t index(size_t n, size_t m)
+		{
+			return n * (n + 1) / 2 + m;
+		}
+
+	private:
+
+		/**
+		 * Recursion coefficients of the solid harmonics from one
+		 * degree to the next, up to degree N+1
+		 */
+		std::vector<double>
+			_alpha, _beta;
+
+		/**
+		 * The degree and order N of the expansion
+		 */
+		size_t _degree;
+
+		/**
+		 * Gravitational parameter the coefficients are scaled to,
+		 * m^3/s^2
+		 */
+		double _gm;
+
+		/**
+		 * The cosine and sine coefficients of each term (n, m) up to
+		 * degree N, premultiplied by the weight of the harmonic of
+		 * degree n+1 and order m+1 in the x and y accelerations
+		 */
+		std::vector<double>
+			_next_c, _next_s;
+
+		/**
+		 * As \ref _next_c and \ref _next_s, for the harmonic of
+		 * order m-1
+		 */
+		std::vector<double>
+			_prev_c, _prev_s;
+
+		/**
+		 * Reference radius the coefficients are scaled to, meters
+		 */
+		double _radius;
+
+		/**
+		 * Factors relating each sectoral harmonic to the one before
+		 * it
+		 */
+		std::vector<double>
+			_sectoral;
+
+		/**
+		 * As \ref _next_c and \ref _next_s, for the harmonic of
+		 * order m in the z acceleration
+		 */
+		std::vector<double>
+			_z_c, _z_s;
+
+		/**
+		 * Rows of the recursion and the sums of each order for
+		 * \ref acceleration(), a run of 9 (N+2) entries per thread
+		 */
+		std::vector<double>
+			_work;
+	};
+}
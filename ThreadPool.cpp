@@ -0,0 +1,112 @@
+#include "ThreadPool.h"
+
+namespace Crescent
+{
+	/**
+	 * Constructor
+	 *
+	 * @param[in] nthreads The total number of threads, including the
+	 *                     one that calls \ref run(). Values less than
+	 *                     1 are treated as 1
+	 */
+	ThreadPool::ThreadPool(size_t nthreads)
+		: _start(),
+		_done(),
+		_generation(0),
+		_job(nullptr),
+		_mutex(),
+		_pending(0),
+		_stop(false),
+		_threads()
+	{
+		for (size_t i = 1; i < nthreads; i++)
+			_threads.emplace_back(&ThreadPool::_worker, this, i);
+	}
+
+	/**
+	 * Destructor. Joins all workers
+	 */
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+
+		_start.notify_all();
+
+		for (auto& thread : _threads)
+			thread.join();
+	}
+
+	/**
+	 * Run a job on every thread and wait for all of them to finish
+	 *
+	 * @param[in] job The job to run. It is called once per thread
+	 *                with that thread's index
+	 */
+	void ThreadPool::run(const Job& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			_job = &job;
+			_pending = _threads.size();
+			_generation++;
+		}
+
+		_start.notify_all();
+
+		job(0);
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_done.wait(lock, [this] { return _pending == 0; });
+
+		_job = nullptr;
+	}
+
+	/**
+	 * Get the total number of threads
+	 *
+	 * @return The number of threads, including the caller
+	 */
+	size_t ThreadPool::size() const
+	{
+		return _threads.size() + 1;
+	}
+
+	/**
+	 * Worker thread main loop
+	 *
+	 * @param[in] index The index of this thread
+	 */
+	void ThreadPool::_worker(size_t index)
+	{
+		size_t seen = 0;
+
+		while (true)
+		{
+			const Job* job = nullptr;
+
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_start.wait(lock, [&] {
+					return _stop || _generation != seen; });
+
+				if (_stop) return;
+
+				seen = _generation;
+				job  = _job;
+			}
+
+			(*job)(index);
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_pending--;
+			}
+
+			_done.notify_one();
+		}
+	}
+}
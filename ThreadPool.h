@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * A fixed set of persistent worker threads. Each call to \ref run()
+	 * hands the same job to every thread (the calling thread acts as
+	 * thread 0) and blocks until all of them have finished. Jobs are
+	 * told their thread index, so work can be partitioned statically
+	 * and the results stay reproducible for a given thread count
+	 */
+	class ThreadPool
+	{
+
+	public:
+
+		/**
+		 * A job, which is passed the index of the thread running it
+		 */
+		using Job = std::function<void(size_t)>;
+
+		ThreadPool(size_t nthreads);
+
+		ThreadPool(const ThreadPool& other) = delete;
+
+		ThreadPool& operator=(const ThreadPool& other) = delete;
+
+		~ThreadPool();
+
+		void run(const Job& job);
+
+		size_t size() const;
+
+	private:
+
+		void _worker(size_t index);
+
+		/**
+		 * Signals the workers that a new job (or shutdown) is
+		 * available
+		 */
+		std::condition_variable _start;
+
+		/**
+		 * Signals the caller that all workers are done
+		 */
+		std::condition_variable _done;
+
+		/**
+		 * Incremented each time a job is posted
+		 */
+		size_t _generation;
+
+		/**
+		 * The job currently being run
+		 */
+		const Job* _job;
+
+		/**
+		 * Guards all shared state
+		 */
+		std::mutex _mutex;
+
+		/**
+		 * Number of workers that have yet to finish the current
+		 * job
+		 */
+		size_t _pending;
+
+		/**
+		 * True once the pool is being destroyed
+		 */
+		bool _stop;
+
+		/**
+		 * The worker threads (excludes the calling thread)
+		 */
+		std::vector<std::thread>
+			_threads;
+	};
+}
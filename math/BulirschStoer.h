@@ -0,0 +1,490 @@
+#ifndef __BULIRSCH_STOER_H__
+#define __BULIRSCH_STOER_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * @class BulirschStoer
+	 *
+	 * Gragg-Bulirsch-Stoer extrapolation integrator. Each step is
+	 * crossed several times with Gragg's modified midpoint rule using
+	 * 2, 4, 6, ... substeps, and the results are extrapolated to zero
+	 * substep size with Aitken-Neville polynomial extrapolation in
+	 * h^2. The difference between the last two extrapolated values
+	 * estimates the error.
+	 *
+	 * Both the step size and the number of extrapolation columns
+	 * (the order) are chosen to minimize the work per unit time,
+	 * following E. Hairer, S. P. Norsett and G. Wanner, "Solving
+	 * Ordinary Differential Equations I", section II.9. For smooth
+	 * problems at tight tolerances this takes very long steps.
+	 *
+	 * The state is a flat array of doubles. All work buffers are sized
+	 * by \ref resize() so that stepping never allocates
+	 */
+	class BulirschStoer
+	{
+
+	public:
+
+		/**
+		 * The maximum number of rows in the extrapolation table
+		 */
+		static const size_t max_rows = 8;
+
+		BulirschStoer();
+
+		~BulirschStoer();
+
+		const double* derivative() const;
+
+		void invalidate();
+
+		template <typename Deriv>
+		bool propagate(Deriv&& deriv, double t, double dt, double* x);
+
+		void resize(size_t size);
+
+		bool set_tolerance(double rtol, double atol);
+
+		double step_size() const;
+
+	private:
+
+		template <typename Deriv>
+		void _midpoint(Deriv&& deriv, double t, double h, size_t steps,
+			const double* x, double* out);
+
+		/**
+		 * Absolute error tolerance
+		 */
+		double _atol;
+
+		/**
+		 * Number of derivative evaluations needed to build each row
+		 * of the extrapolation table, cumulative
+		 */
+		double _cost[max_rows];
+
+		/**
+		 * dx/dt at the current state
+		 */
+		std::vector<double> _dxdt;
+
+		/**
+		 * The step size to try next, or 0 if no step has been taken
+		 */
+		double _h;
+
+		/**
+		 * Relative error tolerance
+		 */
+		double _rtol;
+
+		/**
+		 * The length of the state vector
+		 */
+		size_t _size;
+
+		/**
+		 * Number of midpoint substeps used for each row
+		 */
+		size_t _steps[max_rows];
+
+		/**
+		 * The extrapolation table. Row j holds the j-th
+		 * extrapolated value of the latest sequence
+		 */
+		std::vector<double> _table;
+
+		/**
+		 * The row at which convergence is expected next
+		 */
+		size_t _target;
+
+		/**
+		 * Scratch for the midpoint rule: two states and a
+		 * derivative
+		 */
+		std::vector<double> _tmp;
+
+		/**
+		 * True if \ref _dxdt is the derivative at the current state
+		 */
+		bool _valid;
+	};
+
+	/**
+	 * Constructor
+	 */
+	inline BulirschStoer::BulirschStoer()
+		: _atol(1e-6),
+		_dxdt(),
+		_h(0.0),
+		_rtol(1e-12),
+		_size(0),
+		_table(),
+		_target(4),
+		_tmp(),
+		_valid(false)
+	{
+		for (size_t j = 0; j < max_rows; j++)
+		{
+			_steps[j] = 2 * (j + 1);
+			_cost[j]  = j == 0 ? _steps[0] + 1.0 : _cost[j - 1] + _steps[j];
+		}
+	}
+
+	/**
+	 * Destructor
+	 */
+	inline BulirschStoer::~BulirschStoer()
+	{
+	}
+
+	/**
+	 * Get dx/dt at the current state. Valid after a successful call to
+	 * \ref propagate() until \ref invalidate() is called
+	 *
+	 * @return The derivative
+	 */
+	inline const double* BulirschStoer::derivative() const
+	{
+		return _dxdt.data();
+	}
+
+	/**
+	 * Discard the derivative cached from the previous step. Must be
+	 * called whenever the state is modified outside of \ref propagate()
+	 */
+	inline void BulirschStoer::invalidate()
+	{
+		_valid = false;
+	}
+
+	/**
+	 * Propagate the state over an interval, taking as many steps as the
+	 * tolerance requires. The step size and order carry over between
+	 * calls
+	 *
+	 * @tparam Deriv Callable with signature
+	 *               void(double t, const double* x, double* dxdt)
+	 *
+	 * @param[in]     deriv Computes the derivative of the state
+	 * @param[in]     t     The time at the start of the interval
+	 * @param[in]     dt    The length of the interval
+	 * @param[in,out] x     The state, of length \ref resize()
+	 *
+	 * @return True on success, or false if the step size underflowed
+	 */
+	template <typename Deriv>
+	bool BulirschStoer::propagate(Deriv&& deriv, double t, double dt,
+		double* x)
+	{
+		const size_t n = _size;
+
+		const double t_end = t + dt;
+
+		if (!_valid)
+		{
+			deriv(t, x, _dxdt.data());
+			_valid = true;
+		}
+
+		if (_h <= 0.0) _h = dt;
+
+		bool prev_reject = false;
+
+		while (t < t_end)
+		{
+			const double h = std::min(_h, t_end - t);
+
+			if (h <= 1e-12 * std::max(1.0, std::abs(t)))
+				return false;
+
+			double h_new[max_rows], work[max_rows];
+
+			bool   reject = false;
+			size_t k = 0;
+
+			for (k = 0; k <= _target + 1; k++)
+			{
+				double* row0 = _tmp.data() + 3 * n;
+
+				_midpoint(deriv, t, h, _steps[k], x, row0);
+
+				/*
+				 * Extrapolate, overwriting the previous sequence's
+				 * values in place as they are used up, and measure
+				 * the change made by the last column
+				 */
+				double err = 0.0;
+
+				for (size_t i = 0; i < n; i++)
+				{
+					double value = row0[i], last = value;
+
+					for (size_t j = 1; j <= k; j++)
+					{
+						const double ratio =
+							double(_steps[k]) / _steps[k - j];
+
+						const double prev = _table[(j - 1) * n + i];
+
+						_table[(j - 1) * n + i] = value;
+
+						last  = value;
+						value = value + (value - prev) /
+							(ratio * ratio - 1.0);
+					}
+
+					_table[k * n + i] = value;
+
+					if (k == 0) continue;
+
+					const double scale = _atol + _rtol *
+						std::max(std::abs(x[i]), std::abs(value));
+
+					err = std::max(err, std::abs(value - last) / scale);
+				}
+
+				if (k == 0) continue;
+
+				/*
+				 * The step that would have just met the tolerance with
+				 * this many rows, and the work per unit time it implies
+				 */
+				const double expo = 1.0 / (2 * k + 1);
+				const double fmin = std::pow(0.02, expo);
+
+				double factor = err == 0.0 ? 1.0 / fmin :
+					0.94 / std::pow(err / 0.65, expo);
+
+				factor = std::max(fmin / 4.0, std::min(1.0 / fmin, factor));
+
+				h_new[k] = h * factor;
+				work[k]  = _cost[k] / h_new[k];
+
+				const size_t kt = _target;
+
+				if (k == kt - 1 && !prev_reject)
+				{
+					if (err <= 1.0) break;
+
+					/*
+					 * Give up early if convergence by the target row
+					 * looks hopeless
+					 */
+					const double r = double(_steps[kt]) *
+						_steps[kt + 1] / (_steps[0] * _steps[0]);
+
+					if (err > r * r)
+					{
+						reject = true;
+						break;
+					}
+				}
+				else if (k == kt)
+				{
+					if (err <= 1.0) break;
+
+					const double r = double(_steps[k + 1]) / _steps[0];
+
+					if (err > r * r)
+					{
+						reject = true;
+						break;
+					}
+				}
+				else if (k == kt + 1)
+				{
+					reject = err > 1.0;
+					break;
+				}
+			}
+
+			if (reject)
+			{
+				k = std::min(k, _target);
+
+				if (k > 1 && work[k - 1] < 0.8 * work[k]) k--;
+
+				_target = std::max<size_t>(k, 2);
+				_h = h_new[k];
+
+				prev_reject = true;
+				continue;
+			}
+
+			/*
+			 * Accepted with k rows. Pick the order for the next step
+			 * by comparing the work per unit time of nearby orders,
+			 * and the step size to match
+			 */
+			size_t k_opt;
+
+			if (k == 1)
+			{
+				k_opt = 2;
+			}
+			else if (k <= _target)
+			{
+				k_opt = k;
+
+				if (work[k - 1] < 0.8 * work[k])
+					k_opt = k - 1;
+				else if (work[k] < 0.9 * work[k - 1])
+					k_opt = std::min(k + 1, max_rows - 2);
+			}
+			else
+			{
+				k_opt = k - 1;
+
+				if (k > 2 && work[k - 2] < 0.8 * work[k - 1])
+					k_opt = k - 2;
+
+				if (work[k] < 0.9 * work[k_opt])
+					k_opt = std::min(k, max_rows - 2);
+			}
+
+			double h_next;
+
+			if (prev_reject)
+			{
+				_target = std::max<size_t>(std::min(k_opt, k), 2);
+				h_next  = std::min(h, h_new[_target]);
+			}
+			else
+			{
+				if (k_opt <= k)
+					h_next = h_new[k_opt];
+				else
+					h_next = h_new[k] * _cost[k_opt] / _cost[k];
+
+				_target = std::max<size_t>(k_opt, 2);
+			}
+
+			prev_reject = false;
+
+			/*
+			 * A step cut short to land on the end of the interval
+			 * says little about how large the next one may be
+			 */
+			if (h == _h || h_next < _h)
+				_h = h_next;
+
+			const double* result = &_table[k * n];
+
+			for (size_t i = 0; i < n; i++)
+				x[i] = result[i];
+
+			t = (h == t_end - t) ? t_end : t + h;
+
+			deriv(t, x, _dxdt.data());
+		}
+
+		return true;
+	}
+
+	/**
+	 * Set the length of the state vector and allocate work buffers.
+	 * Discards the cached derivative and step size
+	 *
+	 * @param[in] size The number of elements in the state
+	 */
+	inline void BulirschStoer::resize(size_t size)
+	{
+		_size = size;
+
+		_dxdt.assign(size, 0.0);
+		_table.assign(max_rows * size, 0.0);
+		_tmp.assign(4 * size, 0.0);
+
+		_h = 0.0;
+		_valid = false;
+	}
+
+	/**
+	 * Set the error tolerance. A step is accepted if, for every element
+	 * of the state, the error estimate is below atol + rtol * |x|
+	 *
+	 * @param[in] rtol Relative tolerance
+	 * @param[in] atol Absolute tolerance
+	 *
+	 * @return True on success
+	 */
+	inline bool BulirschStoer::set_tolerance(double rtol, double atol)
+	{
+		if (rtol < 0.0 || atol < 0.0 || rtol + atol <= 0.0)
+			return false;
+
+		_rtol = rtol;
+		_atol = atol;
+
+		return true;
+	}
+
+	/**
+	 * Get the step size that will be tried next
+	 *
+	 * @return The step size, or 0 if no step has been taken yet
+	 */
+	inline double BulirschStoer::step_size() const
+	{
+		return _h;
+	}
+
+	/**
+	 * Cross a step with Gragg's modified midpoint rule, including the
+	 * final smoothing step. Uses the cached derivative at \a x
+	 *
+	 * @param[in]  deriv Computes the derivative of the state
+	 * @param[in]  t     The time at the start of the step
+	 * @param[in]  h     The step size
+	 * @param[in]  steps The number of substeps, which must be even
+	 * @param[in]  x     The state at the start of the step
+	 * @param[out] out   The state at the end of the step
+	 */
+	template <typename Deriv>
+	void BulirschStoer::_midpoint(Deriv&& deriv, double t, double h,
+		size_t steps, const double* x, double* out)
+	{
+		const size_t n = _size;
+		const double sub = h / steps;
+
+		double* z0 = _tmp.data();
+		double* z1 = z0 + n;
+		double* f  = z1 + n;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			z0[i] = x[i];
+			z1[i] = x[i] + sub * _dxdt[i];
+		}
+
+		for (size_t m = 1; m < steps; m++)
+		{
+			deriv(t + m * sub, z1, f);
+
+			for (size_t i = 0; i < n; i++)
+			{
+				const double z2 = z0[i] + 2.0 * sub * f[i];
+
+				z0[i] = z1[i];
+				z1[i] = z2;
+			}
+		}
+
+		deriv(t + h, z1, f);
+
+		for (size_t i = 0; i < n; i++)
+			out[i] = 0.5 * (z0[i] + z1[i] + sub * f[i]);
+	}
+}
+
+#endif
@@ -0,0 +1,486 @@
+#ifndef __EMBEDDED_RK_H__
+#define __EMBEDDED_RK_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * @class EmbeddedRK
+	 *
+	 * Adaptive explicit Runge-Kutta integrator. An embedded pair of
+	 * formulas shares the same stages, and the difference between the
+	 * two solutions estimates the local error of each step. Steps whose
+	 * error exceeds the tolerance are rejected and retried with a smaller
+	 * step, and the step grows again when the error falls well below
+	 * it. See E. Hairer, S. P. Norsett and G. Wanner, "Solving Ordinary
+	 * Differential Equations I", section II.4.
+	 *
+	 * The state is a flat array of doubles. All work buffers are sized
+	 * by \ref resize() so that stepping never allocates
+	 */
+	class EmbeddedRK
+	{
+
+	public:
+
+		/**
+		 * Coefficients of an embedded Runge-Kutta pair
+		 */
+		struct Tableau
+		{
+			/**
+			 * The name of this method
+			 */
+			const char* name;
+
+			/**
+			 * The number of stages
+			 */
+			size_t stages;
+
+			/**
+			 * The order of the error estimate, which sets the exponent
+			 * used to pick the next step size
+			 */
+			int order;
+
+			/**
+			 * True if the last stage is evaluated at the new state, so
+			 * that it can be reused as the first stage of the next step
+			 */
+			bool fsal;
+
+			/**
+			 * Stage coefficients, stages x stages, row-major and
+			 * strictly lower triangular
+			 */
+			std::vector<double> a;
+
+			/**
+			 * Weights of the propagated solution
+			 */
+			std::vector<double> b;
+
+			/**
+			 * Stage times as fractions of the step
+			 */
+			std::vector<double> c;
+
+			/**
+			 * Weights of the error estimate, i.e. the difference
+			 * between the two solutions' weights
+			 */
+			std::vector<double> e;
+		};
+
+		static Tableau dormand_prince54();
+
+		static Tableau fehlberg78();
+
+		EmbeddedRK(const Tableau& tableau);
+
+		~EmbeddedRK();
+
+		const double* derivative() const;
+
+		void invalidate();
+
+		template <typename Deriv>
+		bool propagate(Deriv&& deriv, double t, double dt, double* x);
+
+		void resize(size_t size);
+
+		void set_tableau(const Tableau& tableau);
+
+		bool set_tolerance(double rtol, double atol);
+
+		double step_size() const;
+
+	private:
+
+		/**
+		 * Absolute error tolerance
+		 */
+		double _atol;
+
+		/**
+		 * The step size to try next, or 0 if no step has been taken
+		 */
+		double _h;
+
+		/**
+		 * The stage derivatives, one row of \ref _size entries per
+		 * stage. Row 0 holds dx/dt at the current state
+		 */
+		std::vector<double> _k;
+
+		/**
+		 * Relative error tolerance
+		 */
+		double _rtol;
+
+		/**
+		 * The length of the state vector
+		 */
+		size_t _size;
+
+		/**
+		 * The coefficients of this method
+		 */
+		Tableau _tableau;
+
+		/**
+		 * Scratch state at which stages are evaluated, followed by
+		 * the candidate solution
+		 */
+		std::vector<double> _tmp;
+
+		/**
+		 * True if row 0 of \ref _k is dx/dt at the current state
+		 */
+		bool _valid;
+	};
+
+	/**
+	 * Dormand-Prince 5(4): a 5th order solution with a 4th order error
+	 * estimate, 7 stages, the last of which is reused on the next step
+	 *
+	 * @return The tableau
+	 */
+	inline EmbeddedRK::Tableau EmbeddedRK::dormand_prince54()
+	{
+		Tableau tableau;
+
+		tableau.name   = "dopri5";
+		tableau.stages = 7;
+		tableau.order  = 4;
+		tableau.fsal   = true;
+
+		tableau.a = {
+			0,              0,             0,              0,            0,               0,        0,
+			1.0/5,          0,             0,              0,            0,               0,        0,
+			3.0/40,         9.0/40,        0,              0,            0,               0,        0,
+			44.0/45,       -56.0/15,       32.0/9,         0,            0,               0,        0,
+			19372.0/6561,  -25360.0/2187,  64448.0/6561,  -212.0/729,    0,               0,        0,
+			9017.0/3168,   -355.0/33,      46732.0/5247,   49.0/176,    -5103.0/18656,    0,        0,
+			35.0/384,       0,             500.0/1113,     125.0/192,   -2187.0/6784,     11.0/84,  0
+		};
+
+		tableau.b = {
+			35.0/384, 0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84, 0
+		};
+
+		tableau.c = {
+			0, 1.0/5, 3.0/10, 4.0/5, 8.0/9, 1, 1
+		};
+
+		tableau.e = {
+			71.0/57600, 0, -71.0/16695, 71.0/1920, -17253.0/339200,
+			22.0/525, -1.0/40
+		};
+
+		return tableau;
+	}
+
+	/**
+	 * Runge-Kutta-Fehlberg 7(8): a 7th order solution with an error
+	 * estimate taken from the embedded 8th order formula, 13 stages
+	 *
+	 * @return The tableau
+	 */
+	inline EmbeddedRK::Tableau EmbeddedRK::fehlberg78()
+	{
+		Tableau tableau;
+
+		tableau.name   = "rkf78";
+		tableau.stages = 13;
+		tableau.order  = 7;
+		tableau.fsal   = false;
+
+		tableau.a.assign(13 * 13, 0.0);
+
+		const double rows[13][12] = {
+			{ 0 },
+			{ 2.0/27 },
+			{ 1.0/36,       1.0/12 },
+			{ 1.0/24,       0, 1.0/8 },
+			{ 5.0/12,       0, -25.0/16,   25.0/16 },
+			{ 1.0/20,       0, 0,          1.0/4,      1.0/5 },
+			{ -25.0/108,    0, 0,          125.0/108, -65.0/27,     125.0/54 },
+			{ 31.0/300,     0, 0,          0,          61.0/225,   -2.0/9,      13.0/900 },
+			{ 2,            0, 0,         -53.0/6,     704.0/45,   -107.0/9,    67.0/90,     3 },
+			{ -91.0/108,    0, 0,          23.0/108,  -976.0/135,   311.0/54,  -19.0/60,     17.0/6,  -1.0/12 },
+			{ 2383.0/4100,  0, 0,         -341.0/164,  4496.0/1025, -301.0/82,   2133.0/4100, 45.0/82,  45.0/164, 18.0/41 },
+			{ 3.0/205,      0, 0,          0,          0,          -6.0/41,    -3.0/205,    -3.0/41,   3.0/41,   6.0/41,  0 },
+			{ -1777.0/4100, 0, 0,         -341.0/164,  4496.0/1025, -289.0/82,   2193.0/4100, 51.0/82,  33.0/164, 12.0/41, 0, 1 }
+		};
+
+		for (size_t i = 0; i < 13; i++)
+		{
+			for (size_t j = 0; j < i; j++)
+				tableau.a[13 * i + j] = rows[i][j];
+		}
+
+		tableau.b = {
+			41.0/840, 0, 0, 0, 0, 34.0/105, 9.0/35, 9.0/35, 9.0/280,
+			9.0/280, 41.0/840, 0, 0
+		};
+
+		tableau.c = {
+			0, 2.0/27, 1.0/9, 1.0/6, 5.0/12, 1.0/2, 5.0/6, 1.0/6,
+			2.0/3, 1.0/3, 1, 0, 1
+		};
+
+		tableau.e = {
+			41.0/840, 0, 0, 0, 0, 0, 0, 0, 0, 0, 41.0/840, -41.0/840,
+			-41.0/840
+		};
+
+		return tableau;
+	}
+
+	/**
+	 * Constructor
+	 *
+	 * @param[in] tableau The embedded pair to use
+	 */
+	inline EmbeddedRK::EmbeddedRK(const Tableau& tableau)
+		: _atol(1e-6),
+		_h(0.0),
+		_k(),
+		_rtol(1e-12),
+		_size(0),
+		_tableau(tableau),
+		_tmp(),
+		_valid(false)
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	inline EmbeddedRK::~EmbeddedRK()
+	{
+	}
+
+	/**
+	 * Get dx/dt at the current state. Valid after a successful call to
+	 * \ref propagate() until \ref invalidate() is called
+	 *
+	 * @return The derivative
+	 */
+	inline const double* EmbeddedRK::derivative() const
+	{
+		return _k.data();
+	}
+
+	/**
+	 * Discard the derivative cached from the previous step. Must be
+	 * called whenever the state is modified outside of \ref propagate()
+	 */
+	inline void EmbeddedRK::invalidate()
+	{
+		_valid = false;
+	}
+
+	/**
+	 * Propagate the state over an interval, taking as many steps as the
+	 * tolerance requires. The step size carries over between calls, so
+	 * long intervals are crossed in few steps when the solution is
+	 * smooth
+	 *
+	 * @tparam Deriv Callable with signature
+	 *               void(double t, const double* x, double* dxdt)
+	 *
+	 * @param[in]     deriv Computes the derivative of the state
+	 * @param[in]     t     The time at the start of the interval
+	 * @param[in]     dt    The length of the interval
+	 * @param[in,out] x     The state, of length \ref resize()
+	 *
+	 * @return True on success, or false if the step size underflowed
+	 */
+	template <typename Deriv>
+	bool EmbeddedRK::propagate(Deriv&& deriv, double t, double dt,
+		double* x)
+	{
+		const size_t n = _size;
+		const size_t s = _tableau.stages;
+
+		const double* a = _tableau.a.data();
+		const double* b = _tableau.b.data();
+		const double* c = _tableau.c.data();
+		const double* e = _tableau.e.data();
+
+		double* stage = _tmp.data();
+		double* x_new = _tmp.data() + n;
+
+		const double t_end = t + dt;
+
+		if (!_valid)
+		{
+			deriv(t, x, _k.data());
+			_valid = true;
+		}
+
+		if (_h <= 0.0) _h = dt;
+
+		while (t < t_end)
+		{
+			const double h = std::min(_h, t_end - t);
+
+			if (h <= 1e-12 * std::max(1.0, std::abs(t)))
+				return false;
+
+			for (size_t i = 1; i < s; i++)
+			{
+				const double* a_i = a + i * s;
+
+				for (size_t j = 0; j < n; j++)
+					stage[j] = x[j];
+
+				for (size_t l = 0; l < i; l++)
+				{
+					if (a_i[l] == 0.0) continue;
+
+					const double  w   = h * a_i[l];
+					const double* k_l = &_k[l * n];
+
+					for (size_t j = 0; j < n; j++)
+						stage[j] += w * k_l[j];
+				}
+
+				deriv(t + c[i] * h, stage, &_k[i * n]);
+			}
+
+			/*
+			 * Form the solution and the scaled error in one pass.
+			 * The maximum norm keeps small bodies from being hidden
+			 * by large ones
+			 */
+			double err = 0.0;
+
+			for (size_t j = 0; j < n; j++)
+			{
+				double sum_b = 0.0, sum_e = 0.0;
+
+				for (size_t l = 0; l < s; l++)
+				{
+					sum_b += b[l] * _k[l * n + j];
+					sum_e += e[l] * _k[l * n + j];
+				}
+
+				x_new[j] = x[j] + h * sum_b;
+
+				const double scale = _atol + _rtol *
+					std::max(std::abs(x[j]), std::abs(x_new[j]));
+
+				err = std::max(err, std::abs(h * sum_e) / scale);
+			}
+
+			/*
+			 * Pick the next step, with a safety factor and limits on
+			 * how quickly it may change
+			 */
+			const double factor = err == 0.0 ? 5.0 :
+				std::min(5.0, std::max(0.2,
+					0.9 * std::pow(err, -1.0 / (_tableau.order + 1))));
+
+			if (err > 1.0)
+			{
+				_h = h * std::min(1.0, factor);
+				continue;
+			}
+
+			/*
+			 * A step cut short to land on the end of the interval
+			 * says little about how large the next one may be
+			 */
+			if (h == _h || h * factor < _h)
+				_h = h * factor;
+
+			for (size_t j = 0; j < n; j++)
+				x[j] = x_new[j];
+
+			t = (h == t_end - t) ? t_end : t + h;
+
+			if (_tableau.fsal)
+			{
+				const double* k_last = &_k[(s - 1) * n];
+
+				for (size_t j = 0; j < n; j++)
+					_k[j] = k_last[j];
+			}
+			else
+			{
+				deriv(t, x, _k.data());
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Set the length of the state vector and allocate work buffers.
+	 * Discards the cached derivative and step size
+	 *
+	 * @param[in] size The number of elements in the state
+	 */
+	inline void EmbeddedRK::resize(size_t size)
+	{
+		_size = size;
+
+		_k.assign(_tableau.stages * size, 0.0);
+		_tmp.assign(2 * size, 0.0);
+
+		_h = 0.0;
+		_valid = false;
+	}
+
+	/**
+	 * Switch to a different embedded pair, keeping the state size and
+	 * tolerance
+	 *
+	 * @param[in] tableau The new coefficients
+	 */
+	inline void EmbeddedRK::set_tableau(const Tableau& tableau)
+	{
+		_tableau = tableau;
+		resize(_size);
+	}
+
+	/**
+	 * Set the error tolerance. A step is accepted if, for every element
+	 * of the state, the error estimate is below atol + rtol * |x|
+	 *
+	 * @param[in] rtol Relative tolerance
+	 * @param[in] atol Absolute tolerance
+	 *
+	 * @return True on success
+	 */
+	inline bool EmbeddedRK::set_tolerance(double rtol, double atol)
+	{
+		if (rtol < 0.0 || atol < 0.0 || rtol + atol <= 0.0)
+			return false;
+
+		_rtol = rtol;
+		_atol = atol;
+
+		return true;
+	}
+
+	/**
+	 * Get the step size that will be tried next
+	 *
+	 * @return The step size, or 0 if no step has been taken yet
+	 */
+	inline double EmbeddedRK::step_size() const
+	{
+		return _h;
+	}
+}
+
+#endif
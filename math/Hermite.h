@@ -0,0 +1,90 @@
+#ifndef __HERMITE_H__
+#define __HERMITE_H__
+
+namespace Crescent
+{
+	/**
+	 * Quintic Hermite interpolation of a trajectory between two states
+	 * whose positions, velocities and accelerations are known. The
+	 * interpolated position matches all three at both ends and is
+	 * accurate to O(h^6) for smooth motion
+	 *
+	 * @param[in]  theta The fraction of the interval, in [0, 1]
+	 * @param[in]  h     The length of the interval
+	 * @param[in]  r0    Position at the start
+	 * @param[in]  v0    Velocity at the start
+	 * @param[in]  a0    Acceleration at the start
+	 * @param[in]  r1    Position at the end
+	 * @param[in]  v1    Velocity at the end
+	 * @param[in]  a1    Acceleration at the end
+	 * @param[out] r     Interpolated position
+	 * @param[out] v     Interpolated velocity
+	 */
+	inline void hermite5(double theta, double h,
+		double r0, double v0, double a0,
+		double r1, double v1, double a1,
+		double& r, double& v)
+	{
+		const double t  = theta;
+		const double t2 = t * t;
+		const double t3 = t2 * t;
+		const double t4 = t3 * t;
+		const double t5 = t4 * t;
+
+		const double h2 = h * h;
+
+		r = (1 - 10 * t3 + 15 * t4 - 6 * t5)          * r0
+		  + (t - 6 * t3 + 8 * t4 - 3 * t5)            * h  * v0
+		  + (0.5 * t2 - 1.5 * t3 + 1.5 * t4 - 0.5 * t5) * h2 * a0
+		  + (0.5 * t3 - t4 + 0.5 * t5)                * h2 * a1
+		  + (-4 * t3 + 7 * t4 - 3 * t5)               * h  * v1
+		  + (10 * t3 - 15 * t4 + 6 * t5)              * r1;
+
+		v = (-30 * t2 + 60 * t3 - 30 * t4)            / h  * r0
+		  + (1 - 18 * t2 + 32 * t3 - 15 * t4)         * v0
+		  + (t - 4.5 * t2 + 6 * t3 - 2.5 * t4)        * h  * a0
+		  + (1.5 * t2 - 4 * t3 + 2.5 * t4)            * h  * a1
+		  + (-12 * t2 + 28 * t3 - 15 * t4)            * v1
+		  + (30 * t2 - 60 * t3 + 30 * t4)             / h  * r1;
+	}
+
+	/**
+	 * As \ref hermite5(), also giving the acceleration of the
+	 * interpolant, which matches \a a0 and \a a1 at the ends and is
+	 * accurate to O(h^4)
+	 *
+	 * @param[in]  theta The fraction of the interval, in [0, 1]
+	 * @param[in]  h     The length of the interval
+	 * @param[in]  r0    Position at the start
+	 * @param[in]  v0    Velocity at the start
+	 * @param[in]  a0    Acceleration at the start
+	 * @param[in]  r1    Position at the end
+	 * @param[in]  v1    Velocity at the end
+	 * @param[in]  a1    Acceleration at the end
+	 * @param[out] r     Interpolated position
+	 * @param[out] v     Interpolated velocity
+	 * @param[out] a     Interpolated acceleration
+	 */
+	inline void hermite5(double theta, double h,
+		double r0, double v0, double a0,
+		double r1, double v1, double a1,
+		double& r, double& v, double& a)
+	{
+		hermite5(theta, h, r0, v0, a0, r1, v1, a1, r, v);
+
+		const double t  = theta;
+		const double t2 = t * t;
+		const double t3 = t2 * t;
+
+		const double h2 = h * h;
+
+		a = (-60 * t + 180 * t2 - 120 * t3)           / h2 * r0
+		  + (-36 * t + 96 * t2 - 60 * t3)             / h  * v0
+		  + (1 - 9 * t + 18 * t2 - 10 * t3)                * a0
+		  + (3 * t - 12 * t2 + 10 * t3)                    * a1
+		  + (-24 * t + 84 * t2 - 60 * t3)             / h  * v1
+		  + (60 * t - 180 * t2 + 120 * t3)            / h2 * r1;
+	}
+}
+
+#endif
@@ -0,0 +1,551 @@
+#ifndef __KEPLER_H__
+#define __KEPLER_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * Evaluate the Stumpff functions c2(z) = (1 - cos(sqrt(z))) / z and
+	 * c3(z) = (sqrt(z) - sin(sqrt(z))) / sqrt(z)^3, continued to
+	 * negative z with hyperbolic functions. Near z = 0 their series
+	 * are used to avoid cancellation
+	 *
+	 * @param[in]  z  The argument
+	 * @param[out] c2 c2(z)
+	 * @param[out] c3 c3(z)
+	 */
+	inline void stumpff(double z, double& c2, double& c3)
+	{
+		if (z > 1e-3)
+		{
+			const double s = std::sqrt(z);
+
+			c2 = (1.0 - std::cos(s)) / z;
+			c3 = (s - std::sin(s)) / (s * z);
+		}
+		else if (z < -1e-3)
+		{
+			const double s = std::sqrt(-z);
+
+			c2 = (1.0 - std::cosh(s)) / z;
+			c3 = (std::sinh(s) - s) / (s * -z);
+		}
+		else
+		{
+			c2 = 1.0 / 2  - z * (1.0 / 24  - z * (1.0 / 720  - z / 40320));
+			c3 = 1.0 / 6  - z * (1.0 / 120 - z * (1.0 / 5040 - z / 362880));
+		}
+	}
+
+	/**
+	 * Drop whole revolutions from the time of flight of an elliptic
+	 * orbit, which leaves the final state unchanged but keeps the
+	 * universal anomaly within one revolution
+	 *
+	 * @param[in] mu    The gravitational parameter of the central body
+	 * @param[in] alpha The reciprocal of the semi-major axis
+	 * @param[in] dt    The time of flight
+	 *
+	 * @return The time of flight, reduced to within half a period of
+	 *         zero
+	 */
+	inline double kepler_reduce(double mu, double alpha, double dt)
+	{
+		if (alpha > 1e-12)
+		{
+			const double two_pi = 6.28318530717958648;
+
+			const double period =
+				two_pi / (std::sqrt(mu) * alpha * std::sqrt(alpha));
+
+			return std::remainder(dt, period);
+		}
+
+		return dt;
+	}
+
+	/**
+	 * Starting guess for the universal anomaly, following D. A.
+	 * Vallado, "Fundamentals of Astrodynamics and Applications",
+	 * algorithm 8, for elliptic orbits. Otherwise it is the smallest of
+	 * the straight-line guess sqrt(mu) dt / r0, the parabolic guess
+	 * (6 sqrt(mu) dt)^(1/3) and Vallado's hyperbolic guess, which are
+	 * each best for short, moderate and long flights respectively
+	 *
+	 * @param[in] mu    The gravitational parameter of the central body
+	 * @param[in] alpha The reciprocal of the semi-major axis
+	 * @param[in] r0    The initial distance from the central body
+	 * @param[in] rv    r0 . v0 / sqrt(mu)
+	 * @param[in] dt    The time of flight, reduced by
+	 *                  \ref kepler_reduce()
+	 *
+	 * @return The guess
+	 */
+	inline double kepler_guess(double mu, double alpha, double r0,
+		double rv, double dt)
+	{
+		const double sqrt_mu = std::sqrt(mu);
+
+		if (alpha > 1e-12)
+			return sqrt_mu * dt * alpha;
+
+		double chi = sqrt_mu * dt / r0;
+
+		const double cubic = std::cbrt(6.0 * sqrt_mu * dt);
+
+		if (std::abs(cubic) < std::abs(chi))
+			chi = cubic;
+
+		if (alpha < -1e-12)
+		{
+			const double a    = 1.0 / alpha;
+			const double sign = dt < 0.0 ? -1.0 : 1.0;
+
+			const double hyper = sign * std::sqrt(-a) *
+				std::log(-2.0 * mu * alpha * dt / (rv * sqrt_mu +
+				sign * std::sqrt(-mu * a) * (1.0 - r0 * alpha)));
+
+			if (std::isfinite(hyper) && hyper * sign > 0.0 &&
+				std::abs(hyper) < std::abs(chi))
+			{
+				chi = hyper;
+			}
+		}
+
+		return chi;
+	}
+
+	/**
+	 * Take one step towards the root of the universal Kepler equation
+	 * with the Laguerre-Conway method. Unlike plain Newton iteration,
+	 * it is robust for nearly parabolic orbits (see B. A. Conway, "An
+	 * improved algorithm due to Laguerre for the solution of Kepler's
+	 * equation", Celestial Mechanics 39, 1986). Since the equation is
+	 * increasing in the anomaly (its derivative is the distance from the
+	 * central body), every evaluation also narrows a bracket around the
+	 * root, and steps that would leave the bracket are replaced by
+	 * bisection. This keeps hyperbolic orbits, where the equation grows
+	 * exponentially, from being thrown far off
+	 *
+	 * @param[in]     alpha      The reciprocal of the semi-major axis
+	 * @param[in]     r0         The initial distance from the central
+	 *                           body
+	 * @param[in]     rv         r0 . v0 / sqrt(mu)
+	 * @param[in]     sqrt_mu_dt sqrt(mu) times the time of flight
+	 * @param[in,out] chi        The universal anomaly
+	 * @param[in,out] lo         Lower end of the bracket, initially 0
+	 *                           for positive flight times and -inf
+	 *                           otherwise
+	 * @param[in,out] hi         Upper end of the bracket, initially
+	 *                           +inf for positive flight times and 0
+	 *                           otherwise
+	 *
+	 * @return The change made to \a chi
+	 */
+	inline double kepler_iterate(double alpha, double r0, double rv,
+		double sqrt_mu_dt, double& chi, double& lo, double& hi)
+	{
+		const double n = 5.0;
+
+		const double chi2 = chi * chi;
+		const double psi  = chi2 * alpha;
+		const double beta = 1.0 - alpha * r0;
+
+		double c2, c3;
+		stumpff(psi, c2, c3);
+
+		/*
+		 * The equation and its first two derivatives. F' is the
+		 * distance from the central body
+		 */
+		const double f   = rv * chi2 * c2 + beta * chi2 * chi * c3 +
+			r0 * chi - sqrt_mu_dt;
+		const double df  = rv * chi * (1.0 - psi * c3) + beta * chi2 * c2 +
+			r0;
+		const double d2f = rv * (1.0 - psi * c2) +
+			beta * chi * (1.0 - psi * c3);
+
+		const double root = std::sqrt(std::abs((n - 1) * (n - 1) * df * df -
+			n * (n - 1) * f * d2f));
+
+		if (f == 0.0)
+			return 0.0;
+
+		if (f < 0.0)
+			lo = chi;
+		else
+			hi = chi;
+
+		double next = chi - n * f / (df + (df < 0.0 ? -root : root));
+
+		if (!(next >= lo && next <= hi))
+			next = 0.5 * (lo + hi);
+
+		const double step = next - chi;
+
+		chi = next;
+		return step;
+	}
+
+	/**
+	 * Map a two-body state forward through the Lagrange coefficients
+	 * once the universal anomaly is known
+	 *
+	 * @param[in]  mu    The gravitational parameter of the central body
+	 * @param[in]  alpha The reciprocal of the semi-major axis
+	 * @param[in]  r0    The initial distance from the central body
+	 * @param[in]  rv    r0 . v0 / sqrt(mu)
+	 * @param[in]  dt    The time of flight
+	 * @param[in]  chi   The universal anomaly
+	 * @param[out] fg    The coefficients f, g, fdot and gdot, so that
+	 *                   r = f r0 + g v0 and v = fdot r0 + gdot v0
+	 */
+	inline void kepler_lagrange(double mu, double alpha, double r0,
+		double rv, double dt, double chi, double* fg)
+	{
+		const double sqrt_mu = std::sqrt(mu);
+
+		const double chi2 = chi * chi;
+		const double psi  = chi2 * alpha;
+
+		double c2, c3;
+		stumpff(psi, c2, c3);
+
+		const double r = chi2 * c2 + rv * chi * (1.0 - psi * c3) +
+			r0 * (1.0 - psi * c2);
+
+		fg[0] = 1.0 - chi2 * c2 / r0;
+		fg[1] = dt - chi2 * chi * c3 / sqrt_mu;
+		fg[2] = sqrt_mu / (r * r0) * chi * (psi * c3 - 1.0);
+		fg[3] = 1.0 - chi2 * c2 / r;
+	}
+
+	/**
+	 * @class KeplerBatch
+	 *
+	 * Propagates many two-body states at once with the universal
+	 * variable formulation of Kepler's equation. The states are held in
+	 * structure-of-arrays form, with the same column layout as the
+	 * x|y|z|vx|vy|vz block of a \ref BodyArray, and the root finder is
+	 * run on all of them together: every iteration sweeps the states
+	 * that have yet to converge, which drop out as they do. Setup and
+	 * the final mapping through the Lagrange coefficients are
+	 * straight-line loops over the columns.
+	 *
+	 * Work buffers are kept between calls, so propagating batches of
+	 * the same size never allocates
+	 */
+	class KeplerBatch
+	{
+
+	public:
+
+		/**
+		 * The most iterations taken for any state
+		 */
+		static const int max_iterations = 50;
+
+		KeplerBatch();
+
+		~KeplerBatch();
+
+		size_t propagate(size_t n, size_t stride, const double* mu,
+			const double* dt, double* x);
+
+		size_t propagate(size_t n, size_t stride, const double* mu,
+			double dt, double* x);
+
+	private:
+
+		template <typename Dt>
+		size_t _propagate(size_t n, size_t stride, const double* mu,
+			Dt&& dt, double* x);
+
+		/**
+		 * Indices of the states still being iterated
+		 */
+		std::vector<size_t>
+			_active;
+
+		/**
+		 * Reciprocal of the semi-major axis of each state
+		 */
+		std::vector<double> _alpha;
+
+		/**
+		 * The universal anomaly of each state
+		 */
+		std::vector<double> _chi;
+
+		/**
+		 * Time of flight of each state, less whole revolutions
+		 */
+		std::vector<double> _dt;
+
+		/**
+		 * Upper end of the bracket around each state's anomaly
+		 */
+		std::vector<double> _hi;
+
+		/**
+		 * Lower end of the bracket around each state's anomaly
+		 */
+		std::vector<double> _lo;
+
+		/**
+		 * Initial distance of each state from its central body
+		 */
+		std::vector<double> _r0;
+
+		/**
+		 * r0 . v0 / sqrt(mu) of each state
+		 */
+		std::vector<double> _rv;
+	};
+
+	/**
+	 * Propagate a two-body state with the universal variable
+	 * formulation of Kepler's equation, which holds for elliptic,
+	 * parabolic and hyperbolic orbits alike (see D. A. Vallado,
+	 * "Fundamentals of Astrodynamics and Applications", algorithm 8).
+	 * The universal anomaly is found by the Laguerre-Conway method
+	 *
+	 * @param[in]  mu The gravitational parameter of the central body
+	 * @param[in]  r0 Position relative to the central body, 3 elements
+	 * @param[in]  v0 Velocity relative to the central body, 3 elements
+	 * @param[in]  dt The time of flight, which may be negative
+	 * @param[out] r  Position after dt, 3 elements
+	 * @param[out] v  Velocity after dt, 3 elements
+	 *
+	 * @return True on success, or false if the iteration did not
+	 *         converge
+	 */
+	inline bool kepler(double mu, const double* r0, const double* v0,
+		double dt, double* r, double* v)
+	{
+		const double r0_norm =
+			std::sqrt(r0[0] * r0[0] + r0[1] * r0[1] + r0[2] * r0[2]);
+
+		const double v0_sq = v0[0] * v0[0] + v0[1] * v0[1] + v0[2] * v0[2];
+
+		const double rv = (r0[0] * v0[0] + r0[1] * v0[1] + r0[2] * v0[2])
+			/ std::sqrt(mu);
+
+		/*
+		 * Reciprocal of the semi-major axis
+		 */
+		const double alpha = 2.0 / r0_norm - v0_sq / mu;
+
+		dt = kepler_reduce(mu, alpha, dt);
+
+		const double sqrt_mu_dt = std::sqrt(mu) * dt;
+
+		double chi = kepler_guess(mu, alpha, r0_norm, rv, dt);
+
+		double lo = dt < 0.0 ? -HUGE_VAL : 0.0;
+		double hi = dt < 0.0 ? 0.0 : HUGE_VAL;
+
+		bool converged = false;
+
+		for (int i = 0; i < KeplerBatch::max_iterations; i++)
+		{
+			const double step = kepler_iterate(alpha, r0_norm, rv,
+				sqrt_mu_dt, chi, lo, hi);
+
+			if (std::abs(step) <= 1e-13 * std::max(1.0, std::abs(chi)))
+			{
+				converged = true;
+				break;
+			}
+		}
+
+		double fg[4];
+		kepler_lagrange(mu, alpha, r0_norm, rv, dt, chi, fg);
+
+		for (int k = 0; k < 3; k++)
+		{
+			r[k] = fg[0] * r0[k] + fg[1] * v0[k];
+			v[k] = fg[2] * r0[k] + fg[3] * v0[k];
+		}
+
+		return converged;
+	}
+
+	/**
+	 * Constructor
+	 */
+	inline KeplerBatch::KeplerBatch()
+		: _active(),
+		_alpha(),
+		_chi(),
+		_dt(),
+		_hi(),
+		_lo(),
+		_r0(),
+		_rv()
+	{
+	}
+
+	/**
+	 * Destructor
+	 */
+	inline KeplerBatch::~KeplerBatch()
+	{
+	}
+
+	/**
+	 * Propagate a batch of two-body states, each by its own time of
+	 * flight
+	 *
+	 * @param[in]     n      The number of states
+	 * @param[in]     stride The length of each column of \a x
+	 * @param[in]     mu     The gravitational parameter of each
+	 *                       state's central body, n elements
+	 * @param[in]     dt     The time of flight of each state, n
+	 *                       elements
+	 * @param[in,out] x      The x|y|z|vx|vy|vz columns of positions
+	 *                       and velocities relative to the central
+	 *                       bodies
+	 *
+	 * @return The number of states for which the iteration did not
+	 *         converge
+	 */
+	inline size_t KeplerBatch::propagate(size_t n, size_t stride,
+		const double* mu, const double* dt, double* x)
+	{
+		return _propagate(n, stride, mu,
+			[dt](size_t i) { return dt[i]; }, x);
+	}
+
+	/**
+	 * Propagate a batch of two-body states by a common time of flight
+	 *
+	 * @param[in]     n      The number of states
+	 * @param[in]     stride The length of each column of \a x
+	 * @param[in]     mu     The gravitational parameter of each
+	 *                       state's central body, n elements
+	 * @param[in]     dt     The time of flight
+	 * @param[in,out] x      The x|y|z|vx|vy|vz columns of positions
+	 *                       and velocities relative to the central
+	 *                       bodies
+	 *
+	 * @return The number of states for which the iteration did not
+	 *         converge
+	 */
+	inline size_t KeplerBatch::propagate(size_t n, size_t stride,
+		const double* mu, double dt, double* x)
+	{
+		return _propagate(n, stride, mu,
+			[dt](size_t) { return dt; }, x);
+	}
+
+	/**
+	 * Propagate a batch of two-body states
+	 *
+	 * @tparam Dt Callable with signature double(size_t i) which
+	 *            returns the time of flight of state i
+	 *
+	 * @param[in]     n      The number of states
+	 * @param[in]     stride The length of each column of \a x
+	 * @param[in]     mu     The gravitational parameters
+	 * @param[in]     dt     The times of flight
+	 * @param[in,out] x      The states
+	 *
+	 * @return The number of states which did not converge
+	 */
+	template <typename Dt>
+	size_t KeplerBatch::_propagate(size_t n, size_t stride,
+		const double* mu, Dt&& dt, double* x)
+	{
+		if (_chi.size() < n)
+		{
+			_active.resize(n);
+			_alpha.resize(n);
+			_chi.resize(n);
+			_dt.resize(n);
+			_hi.resize(n);
+			_lo.resize(n);
+			_r0.resize(n);
+			_rv.resize(n);
+		}
+
+		const double* rx = x;
+		const double* ry = x + stride;
+		const double* rz = x + 2 * stride;
+		const double* vx = x + 3 * stride;
+		const double* vy = x + 4 * stride;
+		const double* vz = x + 5 * stride;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			const double r0 = std::sqrt(rx[i] * rx[i] + ry[i] * ry[i] +
+				rz[i] * rz[i]);
+
+			const double v0_sq = vx[i] * vx[i] + vy[i] * vy[i] +
+				vz[i] * vz[i];
+
+			_r0[i]    = r0;
+			_rv[i]    = (rx[i] * vx[i] + ry[i] * vy[i] + rz[i] * vz[i]) /
+				std::sqrt(mu[i]);
+			_alpha[i] = 2.0 / r0 - v0_sq / mu[i];
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			_dt[i]     = kepler_reduce(mu[i], _alpha[i], dt(i));
+			_chi[i]    = kepler_guess(mu[i], _alpha[i], _r0[i], _rv[i],
+				_dt[i]);
+			_lo[i]     = _dt[i] < 0.0 ? -HUGE_VAL : 0.0;
+			_hi[i]     = _dt[i] < 0.0 ? 0.0 : HUGE_VAL;
+			_active[i] = i;
+		}
+
+		size_t active = n;
+
+		for (int iter = 0; iter < max_iterations && active > 0; iter++)
+		{
+			size_t kept = 0;
+
+			for (size_t j = 0; j < active; j++)
+			{
+				const size_t i = _active[j];
+
+				const double step = kepler_iterate(_alpha[i], _r0[i],
+					_rv[i], std::sqrt(mu[i]) * _dt[i], _chi[i], _lo[i],
+					_hi[i]);
+
+				if (std::abs(step) > 1e-13 * std::max(1.0,
+					std::abs(_chi[i])))
+				{
+					_active[kept++] = i;
+				}
+			}
+
+			active = kept;
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			double fg[4];
+			kepler_lagrange(mu[i], _alpha[i], _r0[i], _rv[i], _dt[i],
+				_chi[i], fg);
+
+			for (size_t k = 0; k < 3 * stride; k += stride)
+			{
+				const double r0 = x[k + i];
+				const double v0 = x[3 * stride + k + i];
+
+				x[k + i]              = fg[0] * r0 + fg[1] * v0;
+				x[3 * stride + k + i] = fg[2] * r0 + fg[3] * v0;
+			}
+		}
+
+		return active;
+	}
+}
+
+#endif
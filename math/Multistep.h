@@ -0,0 +1,365 @@
+#ifndef __MULTISTEP_H__
+#define __MULTISTEP_H__
+
+#include <cstddef>
+#include <vector>
+
+namespace Crescent
+{
+	/**
+	 * @class AdamsBashforthMoulton
+	 *
+	 * Fixed-step Adams-Bashforth-Moulton predictor-corrector run in
+	 * PECE mode: the k-step Adams-Bashforth formula predicts the new
+	 * state, the derivative is evaluated there, the k-step
+	 * Adams-Moulton formula corrects the prediction, and the
+	 * derivative is evaluated once more at the corrected state. Every
+	 * step therefore costs two derivative evaluations regardless of
+	 * the order k.
+	 *
+	 * The method needs the derivatives at the last k states, so it
+	 * cannot start on its own. After \ref start(), the caller takes the
+	 * first k - 1 steps with a single-step method and records each
+	 * derivative with \ref push(). The same applies after a
+	 * discontinuity (e.g. a burn), which invalidates the history
+	 */
+	class AdamsBashforthMoulton
+	{
+
+	public:
+
+		/**
+		 * The highest supported order
+		 */
+		static const size_t max_order = 12;
+
+		AdamsBashforthMoulton();
+
+		~AdamsBashforthMoulton();
+
+		const double* derivative() const;
+
+		size_t order() const;
+
+		void push(const double* dxdt);
+
+		bool ready() const;
+
+		void reset();
+
+		void resize(size_t size);
+
+		bool set_order(size_t order);
+
+		template <typename Deriv>
+		void start(Deriv&& deriv, double t, const double* x);
+
+		template <typename Deriv>
+		void step(Deriv&& deriv, double t, double h, double* x);
+
+	private:
+
+		double* _row(size_t age);
+
+		/**
+		 * Adams-Bashforth weights; entry j multiplies the derivative
+		 * from j steps ago
+		 */
+		std::vector<double> _ab;
+
+		/**
+		 * Adams-Moulton weights; entry j multiplies the derivative
+		 * at the new state for j = 0, and from j - 1 steps ago
+		 * otherwise
+		 */
+		std::vector<double> _am;
+
+		/**
+		 * The number of derivatives recorded since the last reset,
+		 * up to \ref _order
+		 */
+		size_t _count;
+
+		/**
+		 * Ring buffer holding the last \ref _order derivatives
+		 */
+		std::vector<double> _history;
+
+		/**
+		 * Row of \ref _history holding the newest derivative
+		 */
+		size_t _newest;
+
+		/**
+		 * The number of steps k
+		 */
+		size_t _order;
+
+		/**
+		 * The predicted state
+		 */
+		std::vector<double> _predicted;
+
+		/**
+		 * The length of the state vector
+		 */
+		size_t _size;
+	};
+
+	/**
+	 * Constructor
+	 */
+	inline AdamsBashforthMoulton::AdamsBashforthMoulton()
+		: _ab(),
+		_am(),
+		_count(0),
+		_history(),
+		_newest(0),
+		_order(0),
+		_predicted(),
+		_size(0)
+	{
+		set_order(8);
+	}
+
+	/**
+	 * Destructor
+	 */
+	inline AdamsBashforthMoulton::~AdamsBashforthMoulton()
+	{
+	}
+
+	/**
+	 * Get the derivative at the current state, i.e. the one most
+	 * recently recorded
+	 *
+	 * @return dx/dt
+	 */
+	inline const double* AdamsBashforthMoulton::derivative() const
+	{
+		return &_history[_newest * _size];
+	}
+
+	/**
+	 * Get the number of steps k, which is also the order of accuracy
+	 *
+	 * @return The order
+	 */
+	inline size_t AdamsBashforthMoulton::order() const
+	{
+		return _order;
+	}
+
+	/**
+	 * Record the derivative at the current state. Used to build up
+	 * the history while starting up
+	 *
+	 * @param[in] dxdt The derivative
+	 */
+	inline void AdamsBashforthMoulton::push(const double* dxdt)
+	{
+		_newest = (_newest + 1) % _order;
+
+		double* row = _row(0);
+
+		for (size_t i = 0; i < _size; i++)
+			row[i] = dxdt[i];
+
+		if (_count < _order) _count++;
+	}
+
+	/**
+	 * Check if enough history has been recorded to call \ref step()
+	 *
+	 * @return True if ready
+	 */
+	inline bool AdamsBashforthMoulton::ready() const
+	{
+		return _count == _order;
+	}
+
+	/**
+	 * Discard the history. Must be called whenever the state or step
+	 * size changes outside of \ref step()
+	 */
+	inline void AdamsBashforthMoulton::reset()
+	{
+		_count  = 0;
+		_newest = 0;
+	}
+
+	/**
+	 * Set the length of the state vector and allocate work buffers.
+	 * Discards the history
+	 *
+	 * @param[in] size The number of elements in the state
+	 */
+	inline void AdamsBashforthMoulton::resize(size_t size)
+	{
+		_size = size;
+
+		_history.assign(_order * size, 0.0);
+		_predicted.assign(size, 0.0);
+
+		reset();
+	}
+
+	/**
+	 * Set the number of steps k. The weights are built from the
+	 * backward-difference forms of the two formulas (see Hairer,
+	 * Norsett and Wanner, "Solving Ordinary Differential Equations
+	 * I", section III.1). Discards the history
+	 *
+	 * @param[in] order The number of steps, 1 to \ref max_order
+	 *
+	 * @return True on success
+	 */
+	inline bool AdamsBashforthMoulton::set_order(size_t order)
+	{
+		if (order < 1 || order > max_order)
+			return false;
+
+		/*
+		 * Backward-difference coefficients: gamma[m] for the explicit
+		 * formula, gamma_star[m] for the implicit one
+		 */
+		double gamma[max_order], gamma_star[max_order];
+
+		for (size_t m = 0; m < order; m++)
+		{
+			gamma[m] = 1.0;
+			gamma_star[m] = m == 0 ? 1.0 : 0.0;
+
+			for (size_t j = 0; j < m; j++)
+			{
+				gamma[m]      -= gamma[j]      / (m + 1 - j);
+				gamma_star[m] -= gamma_star[j] / (m + 1 - j);
+			}
+		}
+
+		/*
+		 * Expand the differences into weights on the derivatives:
+		 * the m-th backward difference contributes (-1)^j C(m, j)
+		 * to the derivative j steps back
+		 */
+		_ab.assign(order, 0.0);
+		_am.assign(order, 0.0);
+
+		for (size_t m = 0; m < order; m++)
+		{
+			double binomial = 1.0;
+
+			for (size_t j = 0; j <= m; j++)
+			{
+				const double sign = (j % 2) ? -1.0 : 1.0;
+
+				_ab[j] += sign * binomial * gamma[m];
+				_am[j] += sign * binomial * gamma_star[m];
+
+				binomial = binomial * (m - j) / (j + 1);
+			}
+		}
+
+		_order = order;
+		resize(_size);
+
+		return true;
+	}
+
+	/**
+	 * Discard the history and begin a new startup from the given
+	 * state, evaluating the derivative there
+	 *
+	 * @tparam Deriv Callable with signature
+	 *               void(double t, const double* x, double* dxdt)
+	 *
+	 * @param[in] deriv Computes the derivative of the state
+	 * @param[in] t     The current time
+	 * @param[in] x     The current state
+	 */
+	template <typename Deriv>
+	void AdamsBashforthMoulton::start(Deriv&& deriv, double t,
+		const double* x)
+	{
+		reset();
+
+		deriv(t, x, _row(0));
+		_count = 1;
+	}
+
+	/**
+	 * Take a single step. Requires \ref ready()
+	 *
+	 * @tparam Deriv Callable with signature
+	 *               void(double t, const double* x, double* dxdt)
+	 *
+	 * @param[in]     deriv Computes the derivative of the state
+	 * @param[in]     t     The current time
+	 * @param[in]     h     The step size, which must equal the one
+	 *                      used to build up the history
+	 * @param[in,out] x     The state
+	 */
+	template <typename Deriv>
+	void AdamsBashforthMoulton::step(Deriv&& deriv, double t, double h,
+		double* x)
+	{
+		const size_t n = _size;
+		const size_t k = _order;
+
+		double* xp = _predicted.data();
+
+		/*
+		 * Predict
+		 */
+		for (size_t i = 0; i < n; i++)
+			xp[i] = x[i];
+
+		for (size_t j = 0; j < k; j++)
+		{
+			const double  w = h * _ab[j];
+			const double* f = _row(j);
+
+			for (size_t i = 0; i < n; i++)
+				xp[i] += w * f[i];
+		}
+
+		/*
+		 * Evaluate. The oldest derivative is not needed by the
+		 * corrector, so its row is recycled for the new one
+		 */
+		_newest = (_newest + 1) % k;
+
+		deriv(t + h, xp, _row(0));
+
+		/*
+		 * Correct
+		 */
+		for (size_t j = 0; j < k; j++)
+		{
+			const double  w = h * _am[j];
+			const double* f = _row(j);
+
+			for (size_t i = 0; i < n; i++)
+				x[i] += w * f[i];
+		}
+
+		/*
+		 * Evaluate
+		 */
+		deriv(t + h, x, _row(0));
+	}
+
+	/**
+	 * Get the derivative recorded a given number of steps ago
+	 *
+	 * @param[in] age 0 for the newest, up to order - 1
+	 *
+	 * @return The row of the history buffer
+	 */
+	inline double* AdamsBashforthMoulton::_row(size_t age)
+	{
+		return &_history[((_newest + _order - age) % _order) * _size];
+	}
+}
+
+#endif
@@ -1,57 +1,166 @@
 #ifndef __RK4_H__
 #define __RK4_H__
 
-#include "Event.h"
-#include "crescent.h"
-#include "Vector.h"
+#include <array>
+#include <cstddef>
+#include <vector>
 
 namespace Crescent
 {
 	/**
-	 * Implements the 4th order Runge-Kutta method
+	 * State size which selects a length set at run time with
+	 * \ref RK4::resize()
+	 */
+	const size_t dynamic_size = 0;
+
+	/**
+	 * Stage storage of an \ref RK4 with a state of N elements, which
+	 * lives inside the integrator
 	 */
 	template <size_t N>
-	class RK4
+	class RK4Storage
 	{
 
 	public:
 
 		/**
-		 * A function F which can be registered with \ref register_dxdt
-		 * where dx/dt = F(t,x)
+		 * @return A pointer to 4 * N doubles
 		 */
-		using Function =
-			Vector<N>(*)(double time, const Vector<N>&);
+		double* data() { return _data.data(); }
 
-		RK4(double step_size);
+		/**
+		 * @return A pointer to the stage buffers
+		 */
+		const double* data() const { return _data.data(); }
 
-		~RK4();
+		/**
+		 * Fixed-size storage cannot be resized
+		 *
+		 * @param[in] size The requested state length
+		 *
+		 * @return True if \a size is N
+		 */
+		bool resize(size_t size) { return size == N; }
+
+		/**
+		 * @return The state length
+		 */
+		size_t size() const { return N; }
+
+	private:
+
+		/**
+		 * The stage buffers
+		 */
+		std::array<double, 4 * N> _data;
+	};
+
+	/**
+	 * Stage storage of an \ref RK4 whose state length is set at run
+	 * time, allocated on the heap
+	 */
+	template <>
+	class RK4Storage<dynamic_size>
+	{
+
+	public:
 
-		int64 propagate_to(int64 t_now,
-			int64 dt,
-			const Vector<N>& in,
-			Vector<N>& out);
+		/**
+		 * Constructor
+		 */
+		RK4Storage() : _data(), _size(0)
+		{
+		}
 
-		bool register_dxdt(Function func);
+		/**
+		 * @return A pointer to 4 * size() doubles
+		 */
+		double* data() { return _data.data(); }
+
+		/**
+		 * @return A pointer to the stage buffers
+		 */
+		const double* data() const { return _data.data(); }
 
-		int64 step(int64 t_now,
-			const Vector<N>& in,
-			Vector<N>& out);
+		/**
+		 * Allocate stage buffers for a state of the given length
+		 *
+		 * @param[in] size The state length
+		 *
+		 * @return True on success
+		 */
+		bool resize(size_t size)
+		{
+			_data.assign(4 * size, 0.0);
+			_size = size;
+
+			return true;
+		}
+
+		/**
+		 * @return The state length
+		 */
+		size_t size() const { return _size; }
 
 	private:
 
 		/**
-		 * Computes the derivative dx/dt
+		 * The stage buffers
 		 */
-		Function _func;
+		std::vector<double> _data;
+
+		/**
+		 * The state length
+		 */
+		size_t _size;
+	};
+
+	/**
+	 * Implements the 4th order Runge-Kutta method over a flat state of
+	 * N doubles, or of a length chosen at run time if N is
+	 * \ref dynamic_size. Stage buffers are kept between steps, so
+	 * stepping never allocates
+	 */
+	template <size_t N = dynamic_size>
+	class RK4
+	{
+
+	public:
+
+		RK4(double step_size);
+
+		~RK4();
+
+		const double* derivative() const;
+
+		template <typename Deriv>
+		double propagate(Deriv&& deriv, double t, size_t steps,
+			double* x);
+
+		bool resize(size_t size);
+
+		bool set_step_size(double step_size);
+
+		size_t size() const;
+
+		template <typename Deriv>
+		void step(Deriv&& deriv, double t, double* x);
+
+	private:
 
 		/**
 		 * The step size (seconds)
 		 */
 		double _step_size;
-	};
 
-#endif
+		/**
+		 * Four rows of stage buffers: the first stage's derivative,
+		 * the weighted sum of stages, the current stage's derivative
+		 * and the state at which it is evaluated
+		 */
+		RK4Storage<N>
+			_storage;
+	};
 
 	/**
 	 * Constructor
@@ -60,7 +169,7 @@ namespace Crescent
 	 */
 	template <size_t N>
 	RK4<N>::RK4(double step_size)
-		: _func(nullptr), _step_size(step_size)
+		: _step_size(step_size), _storage()
 	{
 	}
 
@@ -73,69 +182,132 @@ namespace Crescent
 	}
 
 	/**
-	 * Propagate for the specified interval
+	 * Get dx/dt at the start of the most recent step
+	 *
+	 * @return The derivative
+	 */
+	template <size_t N>
+	const double* RK4<N>::derivative() const
+	{
+		return _storage.data();
+	}
+
+	/**
+	 * Take several steps
+	 *
+	 * @tparam Deriv Callable with signature
+	 *               void(double t, const double* x, double* dxdt)
 	 *
-	 * @param[in]  t_now The current simulation time
-	 * @param[in]  dt    Propagate for this long
-	 * @param[in]  in    The input state vector, valid at \a t_now
-	 * @param[out] out   The propagated state vector
+	 * @param[in]     deriv Computes the derivative of the state
+	 * @param[in]     t     The current time
+	 * @param[in]     steps The number of steps to take
+	 * @param[in,out] x     The state
 	 *
-	 * @return The next time to call this function, or -1
-	 *         on error
+	 * @return The time at the end of the last step
 	 */
 	template <size_t N>
-	int64 RK4<N>::propagate_to(int64 t_now,
-		int64 dt,
-		const Vector<N>& in,
-		Vector<N>& out)
+	template <typename Deriv>
+	double RK4<N>::propagate(Deriv&& deriv, double t, size_t steps,
+		double* x)
 	{
-		int64 t_next = t_now;
+		for (size_t i = 0; i < steps; i++)
+			step(deriv, t + i * _step_size, x);
 
-		for (int64 i = 0; i < dt; i++)
-			t_next = step(t_now + i, in, out);
+		return t + steps * _step_size;
+	}
 
-		return t_next;
+	/**
+	 * Set the length of the state. Only meaningful if N is
+	 * \ref dynamic_size
+	 *
+	 * @param[in] size The number of elements in the state
+	 *
+	 * @return True on success
+	 */
+	template <size_t N>
+	bool RK4<N>::resize(size_t size)
+	{
+		return _storage.resize(size);
 	}
 
 	/**
-	 * Assign the function which computes the derivative of
-	 * the state vector
+	 * Set the step size
+	 *
+	 * @param[in] step_size The step size (seconds)
 	 *
 	 * @return True on success
 	 */
 	template <size_t N>
-	bool RK4<N>::register_dxdt(Function func)
+	bool RK4<N>::set_step_size(double step_size)
 	{
-		if (!func) return false;
-		_func = func;
+		if (step_size <= 0.0) return false;
 
+		_step_size = step_size;
 		return true;
 	}
 
 	/**
-	 * Take a single integration step
+	 * Get the length of the state
 	 *
-	 * @return The next time to call this function, or -1
-	 *         on error
+	 * @return The number of elements
 	 */
 	template <size_t N>
-	int64 RK4<N>::step(int64 t_now,
-		const Vector<N>& in,
-		Vector<N>& out)
+	size_t RK4<N>::size() const
 	{
-		if (!_func) return -1;
+		return _storage.size();
+	}
 
-		const double t = t_now * _step_size;
+	/**
+	 * Take a single integration step
+	 *
+	 * @tparam Deriv Callable with signature
+	 *               void(double t, const double* x, double* dxdt)
+	 *
+	 * @param[in]     deriv Computes the derivative of the state
+	 * @param[in]     t     The current time
+	 * @param[in,out] x     The state
+	 */
+	template <size_t N>
+	template <typename Deriv>
+	void RK4<N>::step(Deriv&& deriv, double t, double* x)
+	{
+		const size_t n = _storage.size();
 		const double h = _step_size;
 
-		auto k1 = h * _func(t, in);
-		auto k2 = h * _func(t + h / 2, in + k1 / 2);
-		auto k3 = h * _func(t + h / 2, in + k2 / 2);
-		auto k4 = h * _func(t + h, in + k3);
+		double* k1  = _storage.data();
+		double* sum = k1  + n;
+		double* k   = sum + n;
+		double* tmp = k   + n;
+
+		deriv(t, x, k1);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			sum[i] = k1[i];
+			tmp[i] = x[i] + h / 2 * k1[i];
+		}
 
-		out = in +
-			(k1 + 2 * k2 + 2 * k3 + k4) / 6;
+		deriv(t + h / 2, tmp, k);
 
-		return t_now + 1;
+		for (size_t i = 0; i < n; i++)
+		{
+			sum[i] += 2 * k[i];
+			tmp[i]  = x[i] + h / 2 * k[i];
+		}
+
+		deriv(t + h / 2, tmp, k);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			sum[i] += 2 * k[i];
+			tmp[i]  = x[i] + h * k[i];
+		}
+
+		deriv(t + h, tmp, k);
+
+		for (size_t i = 0; i < n; i++)
+			x[i] += h / 6 * (sum[i] + k[i]);
 	}
 }
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef __ROOT_FINDING_H__
+#define __ROOT_FINDING_H__
+
+#include <cmath>
+
+namespace Crescent
+{
+	/**
+	 * Narrow a bracket around a root of a scalar function with the
+	 * Illinois variant of regula falsi. Whenever the same end of the
+	 * bracket survives twice in a row, its function value is halved so
+	 * that the other end moves too; if that still fails to halve the
+	 * bracket, the next point is taken by bisection. The bracket keeps
+	 * its sign change throughout, so on return either end may be used
+	 * to land on a known side of the root
+	 *
+	 * @param[in]     f        The function, callable as f(x)
+	 * @param[in,out] a        One end of the bracket
+	 * @param[in,out] fa       f(a)
+	 * @param[in,out] b        The other end of the bracket
+	 * @param[in,out] fb       f(b), which must differ in sign from
+	 *                         \a fa or be zero
+	 * @param[in]     tol      Stop once |b - a| is at most this
+	 * @param[in]     max_iter The most function evaluations allowed
+	 *
+	 * On return, \a fa and \a fb keep their signs but may have been
+	 * scaled down
+	 *
+	 * @return True on success, or false if \a fa and \a fb have the same
+	 *         sign or the bracket did not shrink to \a tol in time
+	 */
+	template <typename F>
+	inline bool illinois(F&& f, double& a, double& fa, double& b,
+		double& fb, double tol, int max_iter = 100)
+	{
+		if ((fa < 0.0) == (fb < 0.0) && fa != 0.0 && fb != 0.0)
+			return false;
+
+		/*
+		 * Which end survived the last step: -1 for a, +1 for b
+		 */
+		int side = 0;
+
+		double width = std::abs(b - a);
+
+		for (int i = 0; i < max_iter; i++)
+		{
+			if (std::abs(b - a) <= tol || fa == 0.0 || fb == 0.0)
+				return true;
+
+			double c = (a * fb - b * fa) / (fb - fa);
+
+			/*
+			 * Fall back on bisection every other step if regula falsi
+			 * is creeping up on the root from one side
+			 */
+			if ((i & 1) && std::abs(b - a) > 0.5 * width)
+				c = 0.5 * (a + b);
+
+			if (i & 1) width = std::abs(b - a);
+
+			if (!(c > std::fmin(a, b) && c < std::fmax(a, b)))
+				c = 0.5 * (a + b);
+
+			const double fc = f(c);
+
+			if ((fc < 0.0) == (fa < 0.0))
+			{
+				a = c; fa = fc;
+				if (side == +1) fb *= 0.5;
+				side = +1;
+			}
+			else
+			{
+				b = c; fb = fc;
+				if (side == -1) fa *= 0.5;
+				side = -1;
+			}
+		}
+
+		return std::abs(b - a) <= tol;
+	}
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef __SYMPLECTIC_H__
+#define __SYMPLECTIC_H__
+
+#include <cmath>
+#include <cstddef>
+
+namespace Crescent
+{
+	/**
+	 * @class Leapfrog
+	 *
+	 * Kick-drift-kick leapfrog (velocity Verlet) for second order
+	 * systems d^2r/dt^2 = a(r). The method is symplectic and second
+	 * order accurate, so energy errors stay bounded over long runs
+	 * instead of drifting as they do with non-symplectic methods.
+	 *
+	 * The acceleration at the end of a step is also the acceleration
+	 * at the start of the next, so each step costs exactly one force
+	 * evaluation
+	 */
+	class Leapfrog
+	{
+
+	public:
+
+		/**
+		 * Take a single step
+		 *
+		 * @tparam Accel Callable with signature
+		 *               void(double t, const double* r, double* a)
+		 *               which computes the accelerations at time t
+		 *               and positions r
+		 *
+		 * @param[in]     accel Computes the accelerations
+		 * @param[in]     t     The time at the start of the step
+		 * @param[in]     h     The step size, seconds
+		 * @param[in]     n     Length of the r, v and a arrays
+		 * @param[in,out] r     Positions
+		 * @param[in,out] v     Velocities
+		 * @param[in,out] a     On input, the accelerations at r. On
+		 *                      output, the accelerations at the new r
+		 */
+		template <typename Accel>
+		static void step(Accel&& accel, double t, double h, size_t n,
+			double* r, double* v, double* a)
+		{
+			const double half = h / 2;
+
+			for (size_t i = 0; i < n; i++)
+			{
+				v[i] += a[i] * half;
+				r[i] += v[i] * h;
+			}
+
+			accel(t + h, r, a);
+
+			for (size_t i = 0; i < n; i++)
+				v[i] += a[i] * half;
+		}
+	};
+
+	/**
+	 * @class Yoshida4
+	 *
+	 * Fourth order symplectic integrator built by composing three
+	 * leapfrog steps of sizes w1*h, w0*h and w1*h (see H. Yoshida,
+	 * "Construction of higher order symplectic integrators", Phys.
+	 * Lett. A 150, 1990). Costs three force evaluations per step,
+	 * one per substage
+	 */
+	class Yoshida4
+	{
+
+	public:
+
+		/**
+		 * Take a single step
+		 *
+		 * @tparam Accel Callable with signature
+		 *               void(double t, const double* r, double* a)
+		 *               which computes the accelerations at time t
+		 *               and positions r
+		 *
+		 * @param[in]     accel Computes the accelerations
+		 * @param[in]     t     The time at the start of the step
+		 * @param[in]     h     The step size, seconds
+		 * @param[in]     n     Length of the r, v and a arrays
+		 * @param[in,out] r     Positions
+		 * @param[in,out] v     Velocities
+		 * @param[in,out] a     On input, the accelerations at r. On
+		 *                      output, the accelerations at the new r
+		 */
+		template <typename Accel>
+		static void step(Accel&& accel, double t, double h, size_t n,
+			double* r, double* v, double* a)
+		{
+			const double cbrt2 = std::cbrt(2.0);
+
+			const double w1 = 1.0 / (2.0 - cbrt2);
+			const double w0 = -cbrt2 * w1;
+
+			Leapfrog::step(accel, t, w1 * h, n, r, v, a);
+			Leapfrog::step(accel, t + w1 * h, w0 * h, n, r, v, a);
+			Leapfrog::step(accel, t + (w1 + w0) * h, w1 * h, n, r, v, a);
+		}
+	};
+}
+
+#endif